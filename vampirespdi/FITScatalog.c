@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FITScatalog.h"
+
+
+
+
+void FITScatalog_init(
+    FITScatalog *catalog
+)
+{
+    catalog->file = NULL;
+    catalog->nbfile = 0;
+    catalog->capacity = 0;
+    arena_init(&catalog->arena, 0);
+}
+
+
+
+
+FITSfileinfo *FITScatalog_add(
+    FITScatalog *catalog,
+    const FITSfileinfo *finfo
+)
+{
+    if (catalog->nbfile == catalog->capacity) {
+        long new_capacity = (catalog->capacity == 0) ? 256 : 2 * catalog->capacity;
+        FITSfileinfo *temp = realloc(catalog->file, sizeof(FITSfileinfo) * new_capacity);
+        if (temp == NULL) {
+            perror("Failed to reallocate memory");
+            return NULL;
+        }
+        catalog->file = temp;
+        catalog->capacity = new_capacity;
+    }
+
+    FITSfileinfo *dest = &catalog->file[catalog->nbfile];
+    *dest = *finfo;
+
+    long nbframe = finfo->naxes[2];
+
+    dest->fname = arena_strdup(&catalog->arena, finfo->fname);
+    dest->kw = arena_memdup(&catalog->arena, finfo->kw, sizeof(FITSkeyword) * finfo->nbkey);
+    dest->kwhash = arena_memdup(&catalog->arena, finfo->kwhash, sizeof(int) * finfo->kwhashsize);
+    dest->destframeidx = arena_alloc(&catalog->arena, sizeof(int) * nbframe);
+    dest->frametime = NULL;
+    if (finfo->frametime != NULL) {
+        dest->frametime = arena_memdup(&catalog->arena, finfo->frametime, sizeof(double) * nbframe);
+    }
+
+    if (dest->fname == NULL || dest->kw == NULL || dest->kwhash == NULL || dest->destframeidx == NULL
+            || (finfo->frametime != NULL && dest->frametime == NULL)) {
+        fprintf(stderr, "Memory allocation failed for catalog entry %s\n", finfo->fname);
+        return NULL;
+    }
+
+    for (long frame_idx = 0; frame_idx < nbframe; frame_idx++) {
+        dest->destframeidx[frame_idx] = -1;
+    }
+    dest->selected = 0;
+
+    catalog->nbfile++;
+    return dest;
+}
+
+
+
+
+void FITScatalog_free(
+    FITScatalog *catalog
+)
+{
+    free(catalog->file);
+    arena_free(&catalog->arena);
+    catalog->file = NULL;
+    catalog->nbfile = 0;
+    catalog->capacity = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef _VAMPIRES_PDI__FITSCATALOG_H
+#define _VAMPIRES_PDI__FITSCATALOG_H
+
+#include "arena.h"
+#include "scanFITSfiles.h"
+
+
+// Catalog of FITS files
+// File array grows as needed. File names, keywords, keyword hash
+// tables, frame times and destination frame indices of all files are
+// stored in a single arena, released by FITScatalog_free.
+struct FITScatalog {
+    FITSfileinfo *file;
+    long nbfile;
+    long capacity;
+    ARENA arena;
+};
+
+
+
+/**
+ * @brief Initializes empty catalog.
+ */
+void FITScatalog_init(
+    FITScatalog *catalog
+);
+
+/**
+ * @brief Appends a copy of finfo to catalog.
+ *
+ * All arrays of finfo are deep-copied to the catalog arena.
+ * destframeidx is allocated with naxes[2] entries set to -1.
+ * Pointers to previous entries are invalidated if the file array grows;
+ * use indices to refer to entries.
+ *
+ * @return Pointer to new entry, NULL on allocation failure.
+ */
+FITSfileinfo *FITScatalog_add(
+    FITScatalog *catalog,
+    const FITSfileinfo *finfo
+);
+
+/**
+ * @brief Frees catalog and all its arena memory.
+ */
+void FITScatalog_free(
+    FITScatalog *catalog
+);
+
+
+#endif
@@ -0,0 +1,368 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FITSindex.h"
+
+
+
+// data area items are 8-byte aligned
+#define ALIGN8(x) (((x) + 7) & ~((uint64_t) 7))
+
+
+
+
+int FITSindex_open(
+    FITSindex *index,
+    const char *fname,
+    uint64_t projhash
+)
+{
+    memset(index, 0, sizeof(FITSindex));
+
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(FITSindexheader)) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Error mapping index file");
+        return -1;
+    }
+
+    const FITSindexheader *header = (const FITSindexheader *) map;
+    if (memcmp(header->magic, FITSINDEX_MAGIC, sizeof(FITSINDEX_MAGIC)) != 0
+            || header->version != FITSINDEX_VERSION
+            || header->kwsize != sizeof(FITSkeyword)
+            || header->filesize != (uint64_t) st.st_size
+            || header->projhash != projhash
+            || header->nbentry > (st.st_size - sizeof(FITSindexheader)) / sizeof(FITSindexentry)) {
+        printf("Ignoring invalid or outdated index file %s\n", fname);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    index->map = map;
+    index->mapsize = st.st_size;
+    index->header = header;
+    index->entry = (const FITSindexentry *)((const char *) map + sizeof(FITSindexheader));
+    index->nbentry = header->nbentry;
+
+    return 0;
+}
+
+
+
+
+// returns path string of entry, NULL if offset is out of map
+static const char *entry_path(
+    const FITSindex *index,
+    const FITSindexentry *entry
+)
+{
+    if (entry->pathoffset >= index->mapsize) {
+        return NULL;
+    }
+    const char *path = (const char *) index->map + entry->pathoffset;
+    if (memchr(path, '\0', index->mapsize - entry->pathoffset) == NULL) {
+        return NULL;
+    }
+    return path;
+}
+
+
+const FITSindexentry *FITSindex_lookup(
+    const FITSindex *index,
+    const char *path
+)
+{
+    // binary search, entries are sorted by path
+    long lo = 0;
+    long hi = index->nbentry - 1;
+    while (lo <= hi) {
+        long mid = lo + (hi - lo) / 2;
+        const char *midpath = entry_path(index, &index->entry[mid]);
+        if (midpath == NULL) {
+            return NULL;
+        }
+        int cmp = strcmp(path, midpath);
+        if (cmp == 0) {
+            return &index->entry[mid];
+        }
+        if (cmp < 0) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+
+
+
+int FITSindex_match(
+    const FITSindexentry *entry,
+    const FILESTAMP *fstamp,
+    const FILESTAMP *tstamp
+)
+{
+    return (entry->fsize == fstamp->size)
+           && (entry->fmtime_ns == fstamp->mtime_ns)
+           && (entry->tsize == tstamp->size)
+           && (entry->tmtime_ns == tstamp->mtime_ns);
+}
+
+
+
+
+int FITSindex_restore(
+    const FITSindex *index,
+    const FITSindexentry *entry,
+    FITSfileinfo *finfo
+)
+{
+    const char *path = entry_path(index, entry);
+
+    if (path == NULL
+            || entry->naxis < 0 || entry->naxis > 8
+            || entry->nbkey < 0 || entry->nbkey > FITSMAXNCARD
+            || entry->nbframe < 0
+            || (entry->nbframe != 0 && entry->nbframe != entry->naxes[2])
+            || entry->kwoffset > index->mapsize
+            || (uint64_t) entry->nbkey > (index->mapsize - entry->kwoffset) / sizeof(FITSkeyword)
+            || entry->timeoffset > index->mapsize
+            || (uint64_t) entry->nbframe > (index->mapsize - entry->timeoffset) / sizeof(double)) {
+        return 2;
+    }
+
+    finfo->fname = strdup(path);
+    finfo->kw = (FITSkeyword *) malloc(sizeof(FITSkeyword) * (entry->nbkey > 0 ? entry->nbkey : 1));
+    // no frame times were indexed for files without timing data
+    finfo->frametime = NULL;
+    if (entry->nbframe > 0) {
+        finfo->frametime = (double *) malloc(sizeof(double) * entry->nbframe);
+    }
+    if (finfo->fname == NULL || finfo->kw == NULL
+            || (entry->nbframe > 0 && finfo->frametime == NULL)) {
+        free(finfo->fname);
+        free(finfo->kw);
+        free(finfo->frametime);
+        finfo->fname = NULL;
+        finfo->kw = NULL;
+        finfo->frametime = NULL;
+        return 2;
+    }
+
+    finfo->bitpix = entry->bitpix;
+    finfo->naxis = entry->naxis;
+    for (int i = 0; i < 8; i++) {
+        finfo->naxes[i] = entry->naxes[i];
+    }
+    finfo->dataoffset = entry->dataoffset;
+    finfo->compressed = entry->compressed;
+    finfo->bscale = entry->bscale;
+    finfo->bzero = entry->bzero;
+    finfo->nbkey = entry->nbkey;
+    finfo->kwhash = NULL;
+    finfo->kwhashsize = 0;
+    memcpy(finfo->kw, (const char *) index->map + entry->kwoffset, sizeof(FITSkeyword) * entry->nbkey);
+    if (finfo->frametime != NULL) {
+        memcpy(finfo->frametime, (const char *) index->map + entry->timeoffset, sizeof(double) * entry->nbframe);
+    }
+
+    finfo->fstamp.size = entry->fsize;
+    finfo->fstamp.mtime_ns = entry->fmtime_ns;
+    finfo->tstamp.size = entry->tsize;
+    finfo->tstamp.mtime_ns = entry->tmtime_ns;
+
+    finfo->selected = 0;
+    finfo->destframeidx = NULL;
+
+    return 1;
+}
+
+
+
+
+static int compare_finfo_fname(const void *a, const void *b)
+{
+    return strcmp((*(const FITSfileinfo * const *) a)->fname,
+                  (*(const FITSfileinfo * const *) b)->fname);
+}
+
+
+// write zero padding up to 8-byte alignment
+static int write_pad(FILE *fp, uint64_t *offset)
+{
+    static const char zeros[8] = {0};
+    uint64_t aligned = ALIGN8(*offset);
+    if (aligned > *offset) {
+        if (fwrite(zeros, 1, aligned - *offset, fp) != aligned - *offset) {
+            return -1;
+        }
+    }
+    *offset = aligned;
+    return 0;
+}
+
+
+int FITSindex_write(
+    const char *fname,
+    uint64_t projhash,
+    const FITSfileinfo *finfo,
+    long nbfile
+)
+{
+    // entries are sorted by path for binary search
+    const FITSfileinfo **sorted = (const FITSfileinfo **) malloc(sizeof(FITSfileinfo *) * (nbfile > 0 ? nbfile : 1));
+    FITSindexentry *entry = (FITSindexentry *) calloc(nbfile > 0 ? nbfile : 1, sizeof(FITSindexentry));
+    if (sorted == NULL || entry == NULL) {
+        free(sorted);
+        free(entry);
+        return -1;
+    }
+    for (long i = 0; i < nbfile; i++) {
+        sorted[i] = &finfo[i];
+    }
+    qsort(sorted, nbfile, sizeof(FITSfileinfo *), compare_finfo_fname);
+
+
+    // First pass: compute data area layout
+    uint64_t offset = sizeof(FITSindexheader) + nbfile * sizeof(FITSindexentry);
+    for (long i = 0; i < nbfile; i++) {
+        const FITSfileinfo *fi = sorted[i];
+        int64_t nbframe = (fi->frametime != NULL) ? fi->naxes[2] : 0;
+
+        offset = ALIGN8(offset);
+        entry[i].pathoffset = offset;
+        offset += strlen(fi->fname) + 1;
+
+        offset = ALIGN8(offset);
+        entry[i].kwoffset = offset;
+        offset += fi->nbkey * sizeof(FITSkeyword);
+
+        offset = ALIGN8(offset);
+        entry[i].timeoffset = offset;
+        offset += nbframe * sizeof(double);
+
+        entry[i].fsize = fi->fstamp.size;
+        entry[i].fmtime_ns = fi->fstamp.mtime_ns;
+        entry[i].tsize = fi->tstamp.size;
+        entry[i].tmtime_ns = fi->tstamp.mtime_ns;
+        entry[i].bitpix = fi->bitpix;
+        entry[i].naxis = fi->naxis;
+        for (int k = 0; k < 8; k++) {
+            entry[i].naxes[k] = fi->naxes[k];
+        }
+        entry[i].dataoffset = fi->dataoffset;
+        entry[i].compressed = fi->compressed;
+        entry[i].bscale = fi->bscale;
+        entry[i].bzero = fi->bzero;
+        entry[i].nbkey = fi->nbkey;
+        entry[i].nbframe = nbframe;
+    }
+
+    FITSindexheader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FITSINDEX_MAGIC, sizeof(FITSINDEX_MAGIC));
+    header.version = FITSINDEX_VERSION;
+    header.kwsize = sizeof(FITSkeyword);
+    header.nbentry = nbfile;
+    header.filesize = offset;
+    header.projhash = projhash;
+
+
+    // Second pass: write to temporary file
+    size_t tmplen = strlen(fname) + 16;
+    char *tmpfname = (char *) malloc(tmplen);
+    if (tmpfname == NULL) {
+        free(sorted);
+        free(entry);
+        return -1;
+    }
+    snprintf(tmpfname, tmplen, "%s.tmp%d", fname, (int) getpid());
+
+    FILE *fp = fopen(tmpfname, "wb");
+    if (fp == NULL) {
+        perror("Error creating index file");
+        free(tmpfname);
+        free(sorted);
+        free(entry);
+        return -1;
+    }
+
+    int writeOK = 1;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1
+            || (nbfile > 0 && fwrite(entry, sizeof(FITSindexentry), nbfile, fp) != (size_t) nbfile)) {
+        writeOK = 0;
+    }
+    offset = sizeof(FITSindexheader) + nbfile * sizeof(FITSindexentry);
+    for (long i = 0; i < nbfile && writeOK; i++) {
+        const FITSfileinfo *fi = sorted[i];
+        size_t pathlen = strlen(fi->fname) + 1;
+
+        if (write_pad(fp, &offset) != 0 || fwrite(fi->fname, 1, pathlen, fp) != pathlen) {
+            writeOK = 0;
+            break;
+        }
+        offset += pathlen;
+
+        if (write_pad(fp, &offset) != 0
+                || fwrite(fi->kw, sizeof(FITSkeyword), fi->nbkey, fp) != (size_t) fi->nbkey) {
+            writeOK = 0;
+            break;
+        }
+        offset += fi->nbkey * sizeof(FITSkeyword);
+
+        if (write_pad(fp, &offset) != 0
+                || fwrite(fi->frametime, sizeof(double), entry[i].nbframe, fp) != (size_t) entry[i].nbframe) {
+            writeOK = 0;
+            break;
+        }
+        offset += entry[i].nbframe * sizeof(double);
+    }
+
+    if (fclose(fp) != 0) {
+        writeOK = 0;
+    }
+
+    int retval = 0;
+    if (!writeOK || rename(tmpfname, fname) != 0) {
+        perror("Error writing index file");
+        unlink(tmpfname);
+        retval = -1;
+    }
+
+    free(tmpfname);
+    free(sorted);
+    free(entry);
+
+    return retval;
+}
+
+
+
+
+void FITSindex_close(
+    FITSindex *index
+)
+{
+    if (index->map != NULL) {
+        munmap(index->map, index->mapsize);
+    }
+    memset(index, 0, sizeof(FITSindex));
+}
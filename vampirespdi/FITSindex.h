@@ -0,0 +1,138 @@
+#ifndef _VAMPIRES_PDI__FITSINDEX_H
+#define _VAMPIRES_PDI__FITSINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scanFITSfiles.h"
+
+
+#define FITSINDEX_MAGIC   "VPDIIDX"
+#define FITSINDEX_VERSION 3
+
+
+// On-disk header index cache
+//
+// Binary file, read with mmap. Layout:
+//   FITSindexheader
+//   FITSindexentry[nbentry], sorted by path
+//   data area: path strings, FITSkeyword records, frame times
+// All offsets are in bytes from start of file.
+// Data area items are 8-byte aligned.
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t kwsize;     // sizeof(FITSkeyword), layout check
+    uint64_t nbentry;
+    uint64_t filesize;
+    uint64_t projhash;   // keyword projection used to build index
+} FITSindexheader;
+
+typedef struct {
+    uint64_t pathoffset; // nul-terminated path
+    int64_t  fsize;      // FITS file stamp
+    int64_t  fmtime_ns;
+    int64_t  tsize;      // timing file stamp
+    int64_t  tmtime_ns;
+    int32_t  bitpix;
+    int32_t  naxis;
+    int64_t  naxes[8];
+    int64_t  dataoffset; // image data unit offset, -1 if unknown
+    int32_t  compressed;
+    int32_t  pad;
+    double   bscale;
+    double   bzero;
+    int64_t  nbkey;
+    uint64_t kwoffset;   // nbkey FITSkeyword records
+    int64_t  nbframe;
+    uint64_t timeoffset; // nbframe double frame times
+} FITSindexentry;
+
+
+typedef struct FITSindex {
+    void   *map;         // NULL if no index loaded
+    size_t  mapsize;
+    const FITSindexheader *header;
+    const FITSindexentry  *entry;
+    long    nbentry;
+} FITSindex;
+
+
+
+/**
+ * @brief Maps index file to memory.
+ *
+ * If the file does not exist, is not a valid index, or was built with a
+ * different keyword projection, index is initialized empty and lookups
+ * return NULL.
+ *
+ * @param projhash Keyword projection hash, see FITSkwprojection_hash.
+ * @return 0 if index loaded, -1 otherwise.
+ */
+int FITSindex_open(
+    FITSindex *index,
+    const char *fname,
+    uint64_t projhash
+);
+
+/**
+ * @brief Finds entry for file path.
+ * @return Pointer to entry within map, NULL if not found.
+ */
+const FITSindexentry *FITSindex_lookup(
+    const FITSindex *index,
+    const char *path
+);
+
+/**
+ * @brief Checks if index entry is up to date with file stamps.
+ * @return 1 if FITS and timing file stamps match, 0 otherwise.
+ */
+int FITSindex_match(
+    const FITSindexentry *entry,
+    const FILESTAMP *fstamp,
+    const FILESTAMP *tstamp
+);
+
+/**
+ * @brief Fills finfo from index entry.
+ *
+ * finfo->fname, finfo->kw and finfo->frametime are allocated and copied from the map,
+ * so finfo remains valid after FITSindex_close.
+ *
+ * Entries whose frame time count differs from naxes[2] are rejected.
+ *
+ * @return 1 on success (same convention as scan_FITSfile), 2 on error.
+ */
+int FITSindex_restore(
+    const FITSindex *index,
+    const FITSindexentry *entry,
+    FITSfileinfo *finfo
+);
+
+/**
+ * @brief Writes index file for array of scanned files.
+ *
+ * File is written to a temporary name, then renamed, so that
+ * concurrent readers never see a partial index.
+ *
+ * @param projhash Keyword projection hash used when scanning finfo.
+ * @return 0 on success, -1 on failure.
+ */
+int FITSindex_write(
+    const char *fname,
+    uint64_t projhash,
+    const FITSfileinfo *finfo,
+    long nbfile
+);
+
+/**
+ * @brief Unmaps index file.
+ */
+void FITSindex_close(
+    FITSindex *index
+);
+
+
+#endif
@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FITSkeylookup.h"
+
+
+
+
+// FNV-1a hash of keyword name
+static uint32_t keyname_hash(const char *keyname)
+{
+    uint32_t hash = 2166136261U;
+    for (const char *c = keyname; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char) *c) * 16777619U;
+    }
+    return hash;
+}
+
+
+
+
+int FITSfileinfo_buildkwhash(
+    FITSfileinfo *finfo
+)
+{
+    free(finfo->kwhash);
+
+    // power of 2, at most half full
+    int size = 8;
+    while (size < 2 * finfo->nbkey) {
+        size *= 2;
+    }
+
+    finfo->kwhash = (int *) malloc(sizeof(int) * size);
+    if (finfo->kwhash == NULL) {
+        finfo->kwhashsize = 0;
+        return -1;
+    }
+    finfo->kwhashsize = size;
+    for (int i = 0; i < size; i++) {
+        finfo->kwhash[i] = -1;
+    }
+
+    for (int kwi = 0; kwi < finfo->nbkey; kwi++) {
+        uint32_t slot = keyname_hash(finfo->kw[kwi].keyname) & (size - 1);
+        // linear probing
+        while (finfo->kwhash[slot] != -1
+                && strcmp(finfo->kw[finfo->kwhash[slot]].keyname, finfo->kw[kwi].keyname) != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        // empty slot, or same keyword: later occurrence replaces earlier
+        finfo->kwhash[slot] = kwi;
+    }
+
+    return 0;
+}
+
+
+
+
+const FITSkeyword *FITSfileinfo_findkey(
+    const FITSfileinfo *finfo,
+    const char *keyname
+)
+{
+    if (finfo->kwhashsize == 0) {
+        return NULL;
+    }
+
+    uint32_t mask = finfo->kwhashsize - 1;
+    uint32_t slot = keyname_hash(keyname) & mask;
+    while (finfo->kwhash[slot] != -1) {
+        const FITSkeyword *kw = &finfo->kw[finfo->kwhash[slot]];
+        if (strcmp(kw->keyname, keyname) == 0) {
+            return kw;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+
+
+
+int FITSfileinfo_getdouble(
+    const FITSfileinfo *finfo,
+    const char *keyname,
+    double *value
+)
+{
+    const FITSkeyword *kw = FITSfileinfo_findkey(finfo, keyname);
+    if (kw == NULL || (kw->type != 'F' && kw->type != 'I' && kw->type != 'L')) {
+        return -1;
+    }
+    *value = kw->dval;
+    return 0;
+}
+
+
+int FITSfileinfo_getint(
+    const FITSfileinfo *finfo,
+    const char *keyname,
+    long *value
+)
+{
+    const FITSkeyword *kw = FITSfileinfo_findkey(finfo, keyname);
+    if (kw == NULL || (kw->type != 'F' && kw->type != 'I' && kw->type != 'L')) {
+        return -1;
+    }
+    *value = kw->ival;
+    return 0;
+}
+
+
+int FITSfileinfo_getstring(
+    const FITSfileinfo *finfo,
+    const char *keyname,
+    const char **value
+)
+{
+    const FITSkeyword *kw = FITSfileinfo_findkey(finfo, keyname);
+    if (kw == NULL) {
+        return -1;
+    }
+    *value = kw->value;
+    return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef _VAMPIRES_PDI__FITSKEYLOOKUP_H
+#define _VAMPIRES_PDI__FITSKEYLOOKUP_H
+
+#include "scanFITSfiles.h"
+
+
+/**
+ * @brief Builds keyword hash table of finfo.
+ *
+ * Open-addressing table over finfo->kw, built once after scan.
+ * If a keyword appears several times (e.g. in multiple HDUs), the last
+ * occurrence is indexed.
+ *
+ * @return 0 on success, -1 on allocation failure.
+ */
+int FITSfileinfo_buildkwhash(
+    FITSfileinfo *finfo
+);
+
+/**
+ * @brief Finds keyword by name.
+ * @return Pointer to keyword entry, NULL if not found.
+ */
+const FITSkeyword *FITSfileinfo_findkey(
+    const FITSfileinfo *finfo,
+    const char *keyname
+);
+
+/**
+ * @brief Reads numeric (or logical) keyword value.
+ * @return 0 on success, -1 if keyword not found or not numeric.
+ */
+int FITSfileinfo_getdouble(
+    const FITSfileinfo *finfo,
+    const char *keyname,
+    double *value
+);
+
+/**
+ * @brief Reads integer (or logical) keyword value.
+ *
+ * Float values are truncated.
+ *
+ * @return 0 on success, -1 if keyword not found or not numeric.
+ */
+int FITSfileinfo_getint(
+    const FITSfileinfo *finfo,
+    const char *keyname,
+    long *value
+);
+
+/**
+ * @brief Reads keyword value string.
+ *
+ * String values are unquoted, other types are returned as written in header.
+ *
+ * @return 0 on success, -1 if keyword not found.
+ */
+int FITSfileinfo_getstring(
+    const FITSfileinfo *finfo,
+    const char *keyname,
+    const char **value
+);
+
+
+#endif
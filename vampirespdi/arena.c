@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+
+
+#define ARENA_ALIGN 16
+
+// block header size, rounded up so that block data is aligned
+#define ARENA_HEADERSIZE ((sizeof(ARENABLOCK) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+
+
+
+void arena_init(
+    ARENA *arena,
+    size_t blocksize
+)
+{
+    arena->head = NULL;
+    arena->blocksize = (blocksize == 0) ? ARENA_BLOCKSIZE : blocksize;
+    arena->nbbytes = 0;
+}
+
+
+
+
+void *arena_alloc(
+    ARENA *arena,
+    size_t size
+)
+{
+    size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+
+    ARENABLOCK *block = arena->head;
+    if (block == NULL || block->used + size > block->size) {
+        // new block, large enough for oversized requests
+        size_t blocksize = (size > arena->blocksize) ? size : arena->blocksize;
+        block = (ARENABLOCK *) malloc(ARENA_HEADERSIZE + blocksize);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->size = blocksize;
+        block->used = 0;
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    void *ptr = (char *) block + ARENA_HEADERSIZE + block->used;
+    block->used += size;
+    arena->nbbytes += size;
+
+    return ptr;
+}
+
+
+
+
+void *arena_memdup(
+    ARENA *arena,
+    const void *src,
+    size_t size
+)
+{
+    void *ptr = arena_alloc(arena, size);
+    if (ptr != NULL && size > 0) {
+        memcpy(ptr, src, size);
+    }
+    return ptr;
+}
+
+
+char *arena_strdup(
+    ARENA *arena,
+    const char *str
+)
+{
+    return (char *) arena_memdup(arena, str, strlen(str) + 1);
+}
+
+
+
+
+void arena_free(
+    ARENA *arena
+)
+{
+    ARENABLOCK *block = arena->head;
+    while (block != NULL) {
+        ARENABLOCK *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->nbbytes = 0;
+}
@@ -0,0 +1,73 @@
+#ifndef _VAMPIRES_PDI__ARENA_H
+#define _VAMPIRES_PDI__ARENA_H
+
+#include <stddef.h>
+
+
+// Default arena block size
+#define ARENA_BLOCKSIZE (1024 * 1024)
+
+
+// Arena allocator
+// Memory is allocated from a chain of large blocks and released all at
+// once. Allocated pointers remain valid until arena_free.
+typedef struct ARENABLOCK {
+    struct ARENABLOCK *next;
+    size_t size;
+    size_t used;
+} ARENABLOCK;
+
+typedef struct {
+    ARENABLOCK *head;   // current block, NULL if empty
+    size_t blocksize;   // minimum size of new blocks
+    size_t nbbytes;     // total bytes allocated from arena
+} ARENA;
+
+
+
+/**
+ * @brief Initializes empty arena.
+ * @param blocksize Minimum block size, 0 for ARENA_BLOCKSIZE.
+ */
+void arena_init(
+    ARENA *arena,
+    size_t blocksize
+);
+
+/**
+ * @brief Allocates memory from arena, 16-byte aligned.
+ * @return Pointer to allocated memory, NULL on failure.
+ */
+void *arena_alloc(
+    ARENA *arena,
+    size_t size
+);
+
+/**
+ * @brief Copies memory to arena.
+ * @return Pointer to copy, NULL on failure.
+ */
+void *arena_memdup(
+    ARENA *arena,
+    const void *src,
+    size_t size
+);
+
+/**
+ * @brief Copies string to arena.
+ * @return Pointer to copy, NULL on failure.
+ */
+char *arena_strdup(
+    ARENA *arena,
+    const char *str
+);
+
+/**
+ * @brief Frees all memory allocated from arena.
+ */
+void arena_free(
+    ARENA *arena
+);
+
+
+#endif
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "CLIcore.h"
+
+#include "cropkernel.h"
+
+
+
+
+// Source frame size (square)
+static int64_t *naxis;
+
+// Crop size (square)
+static int64_t *cropsize;
+
+// Number of crops per frame
+static int64_t *cropnb;
+
+// Number of frames
+static int64_t *nbframe;
+
+
+
+
+// List of arguments to function
+static CLICMDARGDEF farg[] =
+{
+    {
+        CLIARG_INT64,
+        ".naxis",
+        "source frame size",
+        "1024",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &naxis,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".cropsize",
+        "crop size",
+        "128",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &cropsize,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".cropnb",
+        "number of crops per frame",
+        "4",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &cropnb,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".nbframe",
+        "number of frames",
+        "100",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &nbframe,
+        NULL
+    }
+};
+
+// CLI function initialization data
+static CLICMDDATA CLIcmddata =
+{
+    "benchcrop",                         // keyword to call function in CLI
+    "benchmark crop extraction kernel",  // description of what the function does
+    CLICMD_FIELDS_NOFPS
+};
+
+
+
+
+static double bench_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+
+// crop loop as previously used in compute_function: x outer, y inner
+static void crop_legacy(
+    const float *src,
+    long naxis1,
+    const CROPGEOM *crop,
+    float *destframe
+)
+{
+    long xsize = crop->xsize;
+    long ysize = crop->ysize;
+    for(int c=0; c<crop->cropnb; c++)
+    {
+        long ii0offset = crop->xcenter[c] - xsize/2;
+        long jj0offset = crop->ycenter[c] - ysize/2;
+        long ii1offset = c * xsize;
+        for(long ii=0; ii<xsize; ii++)
+        {
+            for(long jj=0; jj<ysize; jj++)
+            {
+                destframe[jj*xsize*crop->cropnb + ii + ii1offset] = src[(jj + jj0offset)*naxis1 + ii + ii0offset];
+            }
+        }
+    }
+}
+
+
+static void bench_report(
+    const char *label,
+    double dt,
+    long nbpix,
+    int srcbytes
+)
+{
+    // bytes read from source + bytes written to destination
+    double nbbytes = (double) nbpix * (srcbytes + sizeof(float));
+    printf("  %-12s %8.3f ms   %6.2f GB/s\n", label, 1.0e3 * dt, 1.0e-9 * nbbytes / dt);
+}
+
+
+
+
+/**
+ * @brief Microbenchmark of crop extraction
+ *
+ * Extracts cropnb crops from nbframe synthetic frames, with the previous
+ * x-outer loop and with cropkernel for float, uint16 and int16 sources
+ * (int16 with BZERO = 32768, as unsigned FITS data), and reports throughput.
+ *
+ * @return errno_t
+ */
+static errno_t compute_function()
+{
+    DEBUG_TRACE_FSTART();
+
+    long N = *naxis;
+    long csize = *cropsize;
+    int ncrop = (int) *cropnb;
+    long nframe = *nbframe;
+    if (N < 1 || csize < 1 || csize > N || ncrop < 1 || nframe < 1) {
+        printf("invalid arguments\n");
+        return RETURN_FAILURE;
+    }
+
+    // crop centers spread along frame diagonal
+    int *xcenter = (int *) malloc(sizeof(int) * ncrop);
+    int *ycenter = (int *) malloc(sizeof(int) * ncrop);
+    long framesize = N * N;
+    long destframesize = csize * ncrop * csize;
+    float *srcf = (float *) malloc(sizeof(float) * framesize * nframe);
+    uint16_t *srcu = (uint16_t *) malloc(sizeof(uint16_t) * framesize * nframe);
+    int16_t *srci = (int16_t *) malloc(sizeof(int16_t) * framesize * nframe);
+    float *dest = (float *) malloc(sizeof(float) * destframesize * nframe);
+    if (xcenter == NULL || ycenter == NULL || srcf == NULL || srcu == NULL || srci == NULL || dest == NULL) {
+        printf("Memory allocation failed\n");
+        free(xcenter);
+        free(ycenter);
+        free(srcf);
+        free(srcu);
+        free(srci);
+        free(dest);
+        return RETURN_FAILURE;
+    }
+    for (int c = 0; c < ncrop; c++) {
+        long center = csize/2 + (ncrop > 1 ? (N - csize) * c / (ncrop - 1) : 0);
+        xcenter[c] = (int) center;
+        ycenter[c] = (int) (N - center);
+    }
+    for (long i = 0; i < framesize * nframe; i++) {
+        srcu[i] = (uint16_t) (i * 7919);
+        srci[i] = (int16_t) srcu[i];
+        srcf[i] = (float) srcu[i];
+    }
+    CROPGEOM crop = {csize, csize, ncrop, xcenter, ycenter};
+
+    long nbpix = destframesize * nframe;
+    printf("%ld frames %ld x %ld, %d crops %ld x %ld\n", nframe, N, N, ncrop, csize, csize);
+
+    // warm-up: fault in destination pages
+    for (long k = 0; k < nframe; k++) {
+        cropkernel_frame(CROPKERNEL_F32, srcf + framesize*k, N, &crop, dest + destframesize*k, 1.0f, 0.0f);
+    }
+
+    double t0 = bench_time();
+    for (long k = 0; k < nframe; k++) {
+        crop_legacy(srcf + framesize*k, N, &crop, dest + destframesize*k);
+    }
+    double t1 = bench_time();
+    bench_report("legacy f32", t1 - t0, nbpix, sizeof(float));
+
+    t0 = bench_time();
+    for (long k = 0; k < nframe; k++) {
+        cropkernel_frame(CROPKERNEL_F32, srcf + framesize*k, N, &crop, dest + destframesize*k, 1.0f, 0.0f);
+    }
+    t1 = bench_time();
+    bench_report("kernel f32", t1 - t0, nbpix, sizeof(float));
+
+    t0 = bench_time();
+    for (long k = 0; k < nframe; k++) {
+        cropkernel_frame(CROPKERNEL_U16, srcu + framesize*k, N, &crop, dest + destframesize*k, 1.0f, 0.0f);
+    }
+    t1 = bench_time();
+    bench_report("kernel u16", t1 - t0, nbpix, sizeof(uint16_t));
+
+    t0 = bench_time();
+    for (long k = 0; k < nframe; k++) {
+        cropkernel_frame(CROPKERNEL_I16, srci + framesize*k, N, &crop, dest + destframesize*k, 1.0f, 32768.0f);
+    }
+    t1 = bench_time();
+    bench_report("kernel i16+z", t1 - t0, nbpix, sizeof(int16_t));
+
+    free(xcenter);
+    free(ycenter);
+    free(srcf);
+    free(srcu);
+    free(srci);
+    free(dest);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+
+INSERT_STD_CLIfunction
+
+
+
+/** @brief Register CLI command
+*/
+errno_t
+CLIADDCMD_vampires_pdi__benchcrop()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
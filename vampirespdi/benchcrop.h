@@ -0,0 +1,6 @@
+#ifndef VAMPIRESPDI_BENCHCROP_H
+#define VAMPIRESPDI_BENCHCROP_H
+
+errno_t CLIADDCMD_vampires_pdi__benchcrop();
+
+#endif
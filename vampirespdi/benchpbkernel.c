@@ -0,0 +1,328 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "CLIcore.h"
+
+#include "blockgemm.h"
+
+
+
+
+// Crop size
+static int64_t *cropsize;
+
+// Number of crops per frame
+static int64_t *cropnb;
+
+// Number of frames
+static int64_t *nbframe;
+
+// Balancing window half-width [frames]
+static int64_t *nbnear;
+
+// Number of threads
+static int64_t *nbthread;
+
+
+
+
+// List of arguments to function
+static CLICMDARGDEF farg[] =
+{
+    {
+        CLIARG_INT64,
+        ".cropsize",
+        "crop size",
+        "512",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &cropsize,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".cropnb",
+        "number of crops per frame",
+        "4",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &cropnb,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".nbframe",
+        "number of frames",
+        "1000",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &nbframe,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".nbnear",
+        "window half-width [frames], 0 for all frames",
+        "16",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &nbnear,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".nbthread",
+        "number of threads",
+        "4",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &nbthread,
+        NULL
+    }
+};
+
+// CLI function initialization data
+static CLICMDDATA CLIcmddata =
+{
+    "benchpbkernel",                          // keyword to call function in CLI
+    "benchmark polarization balancing kernel", // description of what the function does
+    CLICMD_FIELDS_NOFPS
+};
+
+
+
+
+static double bench_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+
+// balancing loop as previously used in compute_function:
+// copy pass, one scalar pass per input frame, scaling pass
+static void pb_legacy(
+    const float *imgin,
+    float *imgout,
+    long N,
+    long xysize,
+    const double *polX,
+    const double *polY,
+    long near,
+    double *vecarray
+)
+{
+    double eps = 1e-6;
+    for (long idxout = 0; idxout < N; idxout++) {
+        long j0 = (near > 0 && idxout - near > 0) ? idxout - near : 0;
+        long j1 = (near > 0 && idxout + near < N - 1) ? idxout + near : N - 1;
+        double sum_dot_product = 0.0;
+        for (long idxin = j0; idxin <= j1; idxin++) {
+            double dot_product = polX[idxin] * polX[idxout] + polY[idxin] * polY[idxout];
+            if (dot_product > 0.0) {
+                dot_product = 0.0;
+            }
+            vecarray[idxin] = dot_product;
+            sum_dot_product += dot_product;
+        }
+        for (long idxin = j0; idxin <= j1; idxin++) {
+            vecarray[idxin] /= sum_dot_product;
+        }
+
+        memcpy(imgout + idxout * xysize, imgin + idxout * xysize, xysize * sizeof(float));
+        for (long idxin = j0; idxin <= j1; idxin++) {
+            if (fabs(vecarray[idxin]) > eps) {
+                for (long pixi = 0; pixi < xysize; pixi++) {
+                    imgout[idxout * xysize + pixi] += vecarray[idxin] * imgin[idxin * xysize + pixi];
+                }
+            }
+        }
+        for (long pixi = 0; pixi < xysize; pixi++) {
+            imgout[idxout * xysize + pixi] *= 0.5;
+        }
+    }
+}
+
+
+// same coefficients, copy and scaling folded in as CSR matrix
+static int pb_buildcsr(
+    CSRMATRIX *csr,
+    long N,
+    const double *polX,
+    const double *polY,
+    long near
+)
+{
+    double eps = 1e-6;
+    long rowmax = (near > 0 && 2 * near + 1 < N) ? 2 * near + 1 : N;
+    if (CSRMATRIX_alloc(csr, N, N, N * rowmax) != 0) {
+        return -1;
+    }
+    for (long idxout = 0; idxout < N; idxout++) {
+        long j0 = (near > 0 && idxout - near > 0) ? idxout - near : 0;
+        long j1 = (near > 0 && idxout + near < N - 1) ? idxout + near : N - 1;
+        double sum_dot_product = 0.0;
+        for (long idxin = j0; idxin <= j1; idxin++) {
+            double dot_product = polX[idxin] * polX[idxout] + polY[idxin] * polY[idxout];
+            if (dot_product < 0.0) {
+                sum_dot_product += dot_product;
+            }
+        }
+        long nz = csr->rowptr[idxout];
+        for (long idxin = j0; idxin <= j1; idxin++) {
+            double dot_product = polX[idxin] * polX[idxout] + polY[idxin] * polY[idxout];
+            double w = (dot_product < 0.0) ? dot_product / sum_dot_product : 0.0;
+            if (idxin == idxout || w > eps) {
+                csr->colidx[nz] = idxin;
+                csr->val[nz] = (float)(0.5 * w + ((idxin == idxout) ? 0.5 : 0.0));
+                nz++;
+            }
+        }
+        csr->rowptr[idxout + 1] = nz;
+    }
+    csr->nnz = csr->rowptr[N];
+    return 0;
+}
+
+
+static void bench_report(
+    const char *label,
+    double dt,
+    long nbterm,
+    long xysize
+)
+{
+    // two floating point operations per matrix entry and pixel
+    printf("  %-16s %9.3f s   %7.2f GFLOP/s\n", label, dt, 2.0e-9 * nbterm * xysize / dt);
+}
+
+
+
+
+/**
+ * @brief Microbenchmark of polarization balancing accumulate
+ *
+ * Balances a synthetic cube of nbframe frames of cropnb crops, with the
+ * previous copy / accumulate / scale loop and with the fused tiled
+ * kernel, then compares outputs through per-frame checksums.
+ *
+ * @return errno_t
+ */
+static errno_t compute_function()
+{
+    DEBUG_TRACE_FSTART();
+
+    long csize = *cropsize;
+    long N = *nbframe;
+    long near = *nbnear;
+    int nthread = (int) *nbthread;
+    if (csize < 1 || *cropnb < 1 || N < 2 || near < 0 || nthread < 1) {
+        printf("invalid arguments\n");
+        return RETURN_FAILURE;
+    }
+    long xysize = csize * csize * (*cropnb);
+
+    float *imgin = (float *) malloc(sizeof(float) * xysize * N);
+    float *imgout = (float *) malloc(sizeof(float) * xysize * N);
+    double *polX = (double *) malloc(sizeof(double) * N);
+    double *polY = (double *) malloc(sizeof(double) * N);
+    double *vecarray = (double *) malloc(sizeof(double) * N);
+    double *checksum = (double *) malloc(sizeof(double) * N);
+    if (imgin == NULL || imgout == NULL || polX == NULL || polY == NULL
+            || vecarray == NULL || checksum == NULL) {
+        printf("Memory allocation failed (%.2f GB per cube)\n", 4.0e-9 * xysize * N);
+        free(imgin);
+        free(imgout);
+        free(polX);
+        free(polY);
+        free(vecarray);
+        free(checksum);
+        return RETURN_FAILURE;
+    }
+
+    // half-wave plate cycle 0, 45, 22.5, 67.5 deg, 4 frames per position
+    const double cycle[4] = {0.0, 45.0, 22.5, 67.5};
+    for (long k = 0; k < N; k++) {
+        double WPangle = cycle[(k / 4) % 4];
+        polX[k] = cos(4.0 * WPangle * M_PI / 180.0);
+        polY[k] = sin(4.0 * WPangle * M_PI / 180.0);
+    }
+    for (long i = 0; i < xysize * N; i++) {
+        imgin[i] = (float) ((i * 7919) % 65536);
+    }
+    memset(imgout, 0, sizeof(float) * xysize * N);
+
+    CSRMATRIX csr;
+    if (pb_buildcsr(&csr, N, polX, polY, near) != 0) {
+        printf("Memory allocation failed\n");
+        free(imgin);
+        free(imgout);
+        free(polX);
+        free(polY);
+        free(vecarray);
+        free(checksum);
+        return RETURN_FAILURE;
+    }
+    printf("%ld frames x %ld pixels (%.2f GB per cube), %.1f input frames per output\n",
+           N, xysize, 4.0e-9 * xysize * N, (double) csr.nnz / N);
+
+    double t0 = bench_time();
+    pb_legacy(imgin, imgout, N, xysize, polX, polY, near, vecarray);
+    double t1 = bench_time();
+    bench_report("legacy", t1 - t0, csr.nnz, xysize);
+    for (long k = 0; k < N; k++) {
+        checksum[k] = 0.0;
+        for (long pixi = 0; pixi < xysize; pixi++) {
+            checksum[k] += imgout[k * xysize + pixi];
+        }
+    }
+
+    for (int nth = 1; nth <= nthread; nth *= 2) {
+        const float *src[1] = {imgin};
+        float *dst[1] = {imgout};
+        t0 = bench_time();
+        blockgemm_csr(&csr, src, dst, 1, xysize, nth);
+        t1 = bench_time();
+        char label[32];
+        snprintf(label, sizeof(label), "fused %2d thread", nth);
+        bench_report(label, t1 - t0, csr.nnz, xysize);
+    }
+
+    double maxrelerr = 0.0;
+    for (long k = 0; k < N; k++) {
+        double sum = 0.0;
+        for (long pixi = 0; pixi < xysize; pixi++) {
+            sum += imgout[k * xysize + pixi];
+        }
+        double relerr = fabs(sum - checksum[k]) / (fabs(checksum[k]) + 1.0);
+        if (relerr > maxrelerr) {
+            maxrelerr = relerr;
+        }
+    }
+    printf("  max frame checksum relative difference %.2e\n", maxrelerr);
+
+    CSRMATRIX_free(&csr);
+    free(imgin);
+    free(imgout);
+    free(polX);
+    free(polY);
+    free(vecarray);
+    free(checksum);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+
+INSERT_STD_CLIfunction
+
+
+
+/** @brief Register CLI command
+*/
+errno_t
+CLIADDCMD_vampires_pdi__benchpbkernel()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
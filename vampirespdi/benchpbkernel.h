@@ -0,0 +1,6 @@
+#ifndef VAMPIRESPDI_BENCHPBKERNEL_H
+#define VAMPIRESPDI_BENCHPBKERNEL_H
+
+errno_t CLIADDCMD_vampires_pdi__benchpbkernel();
+
+#endif
@@ -0,0 +1,261 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "CLIcore.h"
+
+#include "linalgebra/SingularValueDecomp.h"
+
+#include "rsvd.h"
+
+
+
+
+// Frame size
+static int64_t *framexsize;
+static int64_t *frameysize;
+
+// Number of frames
+static int64_t *nbframe;
+
+// Rank of synthetic signal
+static int64_t *sigrank;
+
+// Number of modes computed
+static int64_t *nbmode;
+
+// Number of power iterations
+static int64_t *poweriter;
+
+// Number of threads
+static int64_t *nbthread;
+
+
+
+
+// List of arguments to function
+static CLICMDARGDEF farg[] =
+{
+    {
+        CLIARG_INT64,
+        ".xsize",
+        "frame x size",
+        "512",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &framexsize,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".ysize",
+        "frame y size",
+        "128",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &frameysize,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".nbframe",
+        "number of frames",
+        "2000",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &nbframe,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".rank",
+        "rank of synthetic signal",
+        "200",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &sigrank,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".nbmode",
+        "number of modes computed",
+        "50",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &nbmode,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".poweriter",
+        "number of power iterations",
+        "2",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &poweriter,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".nbthread",
+        "number of threads",
+        "4",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &nbthread,
+        NULL
+    }
+};
+
+// CLI function initialization data
+static CLICMDDATA CLIcmddata =
+{
+    "benchrsvd",                          // keyword to call function in CLI
+    "benchmark randomized SVD vs compute_SVD", // description of what the function does
+    CLICMD_FIELDS_NOFPS
+};
+
+
+
+
+static double bench_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+
+
+
+/**
+ * @brief Microbenchmark of randomized SVD
+ *
+ * Builds a synthetic cube of geometrically decaying rank-r signal plus
+ * noise, decomposes it with compute_SVD (as in polcycleproc) and with
+ * rsvd, and reports wall times, singular value relative errors and
+ * alignment of spatial modes.
+ *
+ * @return errno_t
+ */
+static errno_t compute_function()
+{
+    DEBUG_TRACE_FSTART();
+
+    long xs = *framexsize;
+    long ys = *frameysize;
+    long N = *nbframe;
+    long R = *sigrank;
+    long k = *nbmode;
+    if (xs < 1 || ys < 1 || N < 2 || R < 1 || k < 1 || k > N) {
+        printf("invalid arguments\n");
+        return RETURN_FAILURE;
+    }
+    long P = xs * ys;
+
+    IMGID imgin = imgid_make_from_name_3D("benchrsvd_in", xs, ys, N);
+    imcreateIMGID(&imgin);
+    float *A = imgin.im->array.F;
+
+    // signal: sum of R separable modes, amplitude 0.9^r, plus noise
+    float *u = (float *) malloc(sizeof(float) * P);
+    float *v = (float *) malloc(sizeof(float) * N);
+    if (u == NULL || v == NULL) {
+        free(u);
+        free(v);
+        return RETURN_FAILURE;
+    }
+    srand(0);
+    memset(A, 0, sizeof(float) * N * P);
+    for (long r = 0; r < R; r++) {
+        float amp = (float)(100.0 * pow(0.9, r));
+        for (long p = 0; p < P; p++) {
+            u[p] = (float) rand() / RAND_MAX - 0.5f;
+        }
+        for (long i = 0; i < N; i++) {
+            v[i] = amp * ((float) rand() / RAND_MAX - 0.5f);
+        }
+        for (long i = 0; i < N; i++) {
+            for (long p = 0; p < P; p++) {
+                A[i * P + p] += v[i] * u[p];
+            }
+        }
+    }
+    for (long e = 0; e < N * P; e++) {
+        A[e] += 0.01f * ((float) rand() / RAND_MAX - 0.5f);
+    }
+    free(u);
+    free(v);
+    printf("%ld frames x %ld pixels, signal rank %ld, %ld modes\n", N, P, R, k);
+
+    // current path
+    IMGID imgU = imgid_make_from_name("benchrsvd_U");
+    IMGID imgS = imgid_make_from_name("benchrsvd_S");
+    IMGID imgV = imgid_make_from_name("benchrsvd_V");
+    double t0 = bench_time();
+    compute_SVD(imgin, &imgU, &imgS, &imgV, 0, 0.0001, 2000, -1, 0, "benchrsvd_Un", "benchrsvd_Vn");
+    double t1 = bench_time();
+    printf("  compute_SVD  %9.3f s\n", t1 - t0);
+
+    // randomized
+    RSVDCONF conf = {k, 10, (int) *poweriter, 0.0, 0.0, (int) *nbthread};
+    RSVDRESULT res;
+    float *U = (float *) malloc(sizeof(float) * k * P);
+    float *S = (float *) malloc(sizeof(float) * k);
+    t0 = bench_time();
+    int status = rsvd_compute(A, N, P, &conf, &res);
+    if (status == 0) {
+        status = rsvd_getmodes(&res, U, S, NULL, conf.nbthread);
+    }
+    t1 = bench_time();
+    long kr = res.nbmode;
+    RSVDRESULT_free(&res);
+    if (status != 0 || U == NULL || S == NULL) {
+        printf("Randomized SVD failed\n");
+        free(U);
+        free(S);
+        return RETURN_FAILURE;
+    }
+    printf("  rsvd         %9.3f s\n", t1 - t0);
+
+    // accuracy against compute_SVD, over modes both computed
+    resolveIMGID(&imgS, ERRMODE_ABORT);
+    resolveIMGID(&imgU, ERRMODE_ABORT);
+    long kc = imgS.md->size[0];
+    long kmax = (kr < kc) ? kr : kc;
+    double maxSrelerr = 0.0;
+    double minalign = 1.0;
+    for (long m = 0; m < kmax; m++) {
+        double Sref = imgS.im->array.F[m];
+        double relerr = fabs(S[m] - Sref) / Sref;
+        if (relerr > maxSrelerr) {
+            maxSrelerr = relerr;
+        }
+        double dot = 0.0;
+        for (long p = 0; p < P; p++) {
+            dot += (double) U[m * P + p] * imgU.im->array.F[m * P + p];
+        }
+        if (fabs(dot) < minalign) {
+            minalign = fabs(dot);
+        }
+    }
+    printf("  %ld modes: max singular value relative error %.2e, min mode alignment %.6f\n",
+           kmax, maxSrelerr, minalign);
+
+    free(U);
+    free(S);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+
+INSERT_STD_CLIfunction
+
+
+
+/** @brief Register CLI command
+*/
+errno_t
+CLIADDCMD_vampires_pdi__benchrsvd()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
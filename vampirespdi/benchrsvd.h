@@ -0,0 +1,6 @@
+#ifndef VAMPIRESPDI_BENCHRSVD_H
+#define VAMPIRESPDI_BENCHRSVD_H
+
+errno_t CLIADDCMD_vampires_pdi__benchrsvd();
+
+#endif
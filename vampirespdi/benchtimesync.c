@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "CLIcore.h"
+
+#include "timesync.h"
+
+
+
+
+// Number of points per stream
+static int64_t *nbpt;
+
+// Number of streams
+static int64_t *nbstream;
+
+// Synchronization tolerance
+static double *tolerance;
+
+
+
+
+// List of arguments to function
+static CLICMDARGDEF farg[] =
+{
+    {
+        CLIARG_INT64,
+        ".nbpt",
+        "number of points per stream",
+        "10000000",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &nbpt,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".K",
+        "number of streams",
+        "2",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &nbstream,
+        NULL
+    },
+    {
+        CLIARG_FLOAT64,
+        ".tol",
+        "tolerance [s]",
+        "0.001",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &tolerance,
+        NULL
+    }
+};
+
+// CLI function initialization data
+static CLICMDDATA CLIcmddata =
+{
+    "benchtimesync",                     // keyword to call function in CLI
+    "benchmark time stream sync",        // description of what the function does
+    CLICMD_FIELDS_NOFPS
+};
+
+
+
+
+static double bench_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+
+
+
+/**
+ * @brief Microbenchmark of timesync_multiway
+ *
+ * Builds K synthetic streams at 1 kHz with per-stream offset, jitter
+ * and 1% dropped frames, then reports matches/s and timestamps/s.
+ *
+ * @return errno_t
+ */
+static errno_t compute_function()
+{
+    DEBUG_TRACE_FSTART();
+
+    long N = *nbpt;
+    int K = (int) *nbstream;
+    if (N < 1 || K < 1) {
+        printf("nbpt and K must be positive\n");
+        return RETURN_FAILURE;
+    }
+
+    double **tstream = (double **) malloc(sizeof(double *) * K);
+    long *nbptstream = (long *) malloc(sizeof(long) * K);
+    int *idxtable = (int *) malloc(sizeof(int) * K * N);
+    if (tstream == NULL || nbptstream == NULL || idxtable == NULL) {
+        free(tstream);
+        free(nbptstream);
+        free(idxtable);
+        return RETURN_FAILURE;
+    }
+
+    srand(0);
+    double dt = 0.001;
+    for (int k = 0; k < K; k++) {
+        tstream[k] = (double *) malloc(sizeof(double) * N);
+        if (tstream[k] == NULL) {
+            printf("Memory allocation failed for stream %d\n", k);
+            for (int k1 = 0; k1 < k; k1++) {
+                free(tstream[k1]);
+            }
+            free(tstream);
+            free(nbptstream);
+            free(idxtable);
+            return RETURN_FAILURE;
+        }
+        long n = 0;
+        for (long i = 0; i < N; i++) {
+            if (rand() % 100 == 0) {
+                continue; // dropped frame
+            }
+            double jitter = 0.1 * dt * ((double) rand() / RAND_MAX - 0.5);
+            tstream[k][n++] = i * dt + 0.05 * dt * k + jitter;
+        }
+        nbptstream[k] = n;
+    }
+
+    double t0 = bench_time();
+    long nbmatch = timesync_multiway((const double * const *) tstream, nbptstream, K, *tolerance, idxtable, N);
+    double t1 = bench_time();
+
+    long nbtotal = 0;
+    for (int k = 0; k < K; k++) {
+        nbtotal += nbptstream[k];
+    }
+    printf("K = %d streams, %ld timestamps, tolerance %g s\n", K, nbtotal, *tolerance);
+    printf("  %ld matches in %.3f s\n", nbmatch, t1 - t0);
+    printf("  %.2f Mmatch/s   %.2f Mtimestamp/s\n", 1.0e-6 * nbmatch / (t1 - t0), 1.0e-6 * nbtotal / (t1 - t0));
+
+    for (int k = 0; k < K; k++) {
+        free(tstream[k]);
+    }
+    free(tstream);
+    free(nbptstream);
+    free(idxtable);
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+
+INSERT_STD_CLIfunction
+
+
+
+/** @brief Register CLI command
+*/
+errno_t
+CLIADDCMD_vampires_pdi__benchtimesync()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
@@ -0,0 +1,6 @@
+#ifndef VAMPIRESPDI_BENCHTIMESYNC_H
+#define VAMPIRESPDI_BENCHTIMESYNC_H
+
+errno_t CLIADDCMD_vampires_pdi__benchtimesync();
+
+#endif
@@ -0,0 +1,227 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "CLIcore.h"
+
+#include "timingdata.h"
+
+
+
+
+// Timing file to parse
+static char *timingfname;
+
+// Number of parse iterations
+static int64_t *nbiter;
+
+
+
+
+// List of arguments to function
+static CLICMDARGDEF farg[] =
+{
+    {
+        CLIARG_STR,
+        ".fname",
+        "timing file",
+        "timing.txt",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &timingfname,
+        NULL
+    },
+    {
+        CLIARG_INT64,
+        ".nbiter",
+        "number of iterations",
+        "10",
+        (FPFLAG_DEFAULT_INPUT | FPFLAG_CLI_INPUT),
+        (void **) &nbiter,
+        NULL
+    }
+};
+
+// CLI function initialization data
+static CLICMDDATA CLIcmddata =
+{
+    "benchtiming",                       // keyword to call function in CLI
+    "benchmark timing file parsers",     // description of what the function does
+    CLICMD_FIELDS_NOFPS
+};
+
+
+
+
+static double bench_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+
+
+
+// Parses file with both parsers, reports throughput and differences
+// Values are compared bit for bit.
+// returns number of differing values, -1 on error
+static long bench_parsers(
+    const char *fname,
+    long niter
+)
+{
+    struct stat st;
+    if (stat(fname, &st) != 0) {
+        perror("Error opening timing file");
+        return -1;
+    }
+
+    // count lines, upper bound for frame index
+    size_t nbline = 0;
+    {
+        FILE *fp = fopen(fname, "r");
+        if (fp == NULL) {
+            perror("Error opening timing file");
+            return -1;
+        }
+        int c;
+        while ((c = fgetc(fp)) != EOF) {
+            nbline += (c == '\n');
+        }
+        fclose(fp);
+    }
+    size_t array_size = nbline + 1;
+
+    double *time_sscanf = (double *) calloc(array_size, sizeof(double));
+    double *time_mmap = (double *) calloc(array_size, sizeof(double));
+    if (time_sscanf == NULL || time_mmap == NULL) {
+        free(time_sscanf);
+        free(time_mmap);
+        return -1;
+    }
+
+    double t0 = bench_time();
+    for (long iter = 0; iter < niter; iter++) {
+        read_time_data(fname, time_sscanf, array_size);
+    }
+    double t1 = bench_time();
+    for (long iter = 0; iter < niter; iter++) {
+        read_time_data_mmap(fname, time_mmap, array_size);
+    }
+    double t2 = bench_time();
+
+    long nbdiff = 0;
+    for (size_t i = 0; i < array_size; i++) {
+        if (memcmp(&time_sscanf[i], &time_mmap[i], sizeof(double)) != 0) {
+            nbdiff++;
+        }
+    }
+
+    double MBytes = 1.0e-6 * st.st_size * niter;
+    double Mlines = 1.0e-6 * nbline * niter;
+    printf("File %s : %ld bytes, %zu lines, %ld iterations\n", fname, (long) st.st_size, nbline, niter);
+    printf("  sscanf : %8.3f s  %8.1f MB/s  %8.2f Mlines/s\n", t1 - t0, MBytes / (t1 - t0), Mlines / (t1 - t0));
+    printf("  mmap   : %8.3f s  %8.1f MB/s  %8.2f Mlines/s\n", t2 - t1, MBytes / (t2 - t1), Mlines / (t2 - t1));
+    printf("  speedup %.2fx, %ld differing values\n", (t1 - t0) / (t2 - t1), nbdiff);
+
+    free(time_sscanf);
+    free(time_mmap);
+    return nbdiff;
+}
+
+
+
+
+// Writes synthetic timing file: unix times with 9 decimals in column 5
+// (19 significant digits), as written at ns resolution
+static int write_unixtime_file(
+    const char *fname,
+    long nbline
+)
+{
+    FILE *fp = fopen(fname, "w");
+    if (fp == NULL) {
+        perror("Error creating timing file");
+        return -1;
+    }
+    fprintf(fp, "# synthetic timing file, 9-decimal unix times\n");
+    uint64_t tns = 1718000000123456789ULL;
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (long i = 0; i < nbline; i++) {
+        // irregular frame intervals, about 1 ms
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        tns += 1000000 + state % 1000;
+        fprintf(fp, "%ld %ld %.6f %.6f %llu.%09llu %d %d\n", i, i, 1.0e-3 * i, 1.0e-3,
+                (unsigned long long)(tns / 1000000000ULL), (unsigned long long)(tns % 1000000000ULL), 0, 0);
+    }
+    if (fclose(fp) != 0) {
+        perror("Error writing timing file");
+        return -1;
+    }
+    return 0;
+}
+
+
+
+
+/**
+ * @brief Compares sscanf and mmap timing file parsers
+ *
+ * Both parsers read the same file nbiter times. Throughput is reported
+ * in MB/s and lines/s, and outputs are checked to be bit-identical.
+ * A synthetic file of 9-decimal unix times is then parsed the same way.
+ *
+ * @return errno_t
+ */
+static errno_t compute_function()
+{
+    DEBUG_TRACE_FSTART();
+
+    long niter = (*nbiter < 1) ? 1 : *nbiter;
+
+    if (bench_parsers(timingfname, niter) < 0) {
+        return RETURN_FAILURE;
+    }
+
+    // 9-decimal unix times, must agree bit for bit with sscanf
+    char unixfname[] = "/tmp/benchtiming_unixXXXXXX";
+    int fd = mkstemp(unixfname);
+    if (fd == -1) {
+        perror("Error creating timing file");
+        return RETURN_FAILURE;
+    }
+    close(fd);
+    long nbdiff = -1;
+    if (write_unixtime_file(unixfname, 100000) == 0) {
+        nbdiff = bench_parsers(unixfname, niter);
+    }
+    remove(unixfname);
+    if (nbdiff != 0) {
+        printf("ERROR: mmap parser differs from sscanf on 9-decimal unix times\n");
+        return RETURN_FAILURE;
+    }
+
+    DEBUG_TRACE_FEXIT();
+    return RETURN_SUCCESS;
+}
+
+
+INSERT_STD_CLIfunction
+
+
+
+/** @brief Register CLI command
+*/
+errno_t
+CLIADDCMD_vampires_pdi__benchtiming()
+{
+    INSERT_STD_CLIREGISTERFUNC
+
+    return RETURN_SUCCESS;
+}
@@ -0,0 +1,6 @@
+#ifndef VAMPIRESPDI_BENCHTIMING_H
+#define VAMPIRESPDI_BENCHTIMING_H
+
+errno_t CLIADDCMD_vampires_pdi__benchtiming();
+
+#endif
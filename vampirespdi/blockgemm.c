@@ -0,0 +1,659 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "blockgemm.h"
+
+
+
+
+int CSRMATRIX_alloc(
+    CSRMATRIX *csr,
+    long nrow,
+    long ncol,
+    long nnz
+)
+{
+    csr->nrow = nrow;
+    csr->ncol = ncol;
+    csr->nnz = nnz;
+    csr->rowptr = (long *) calloc(nrow + 1, sizeof(long));
+    csr->colidx = (long *) malloc(sizeof(long) * (nnz > 0 ? nnz : 1));
+    csr->val = (float *) malloc(sizeof(float) * (nnz > 0 ? nnz : 1));
+    if (csr->rowptr == NULL || csr->colidx == NULL || csr->val == NULL) {
+        CSRMATRIX_free(csr);
+        return -1;
+    }
+    return 0;
+}
+
+
+void CSRMATRIX_free(
+    CSRMATRIX *csr
+)
+{
+    free(csr->rowptr);
+    free(csr->colidx);
+    free(csr->val);
+    csr->rowptr = NULL;
+    csr->colidx = NULL;
+    csr->val = NULL;
+}
+
+
+
+
+typedef struct {
+    const float      *A;
+    const CSRMATRIX  *csr;
+    long              nrow;
+    long              ncol;
+    const float *const *B;
+    float *const     *C;
+    int               nbpair;
+    long              framesize;
+    long              maxrownnz;  // CSR: largest number of entries in a row
+    const float      *crossA;     // cross products: nrow x framesize
+    const float      *crossB;     // cross products: ncol x framesize
+    double           *Y;          // cross products: nrow x ncol
+    pthread_mutex_t   lock;       // cross products: reduction into Y
+    double           *G;          // Gram matrix: nrow x nrow, rows of crossA
+    long              pix0;       // Gram matrix: pixel range
+    long              pix1;
+    long              nbtile;
+    long              nexttile;   // next pixel tile (Gram matrix: output block) to claim
+    int               status;
+} BLOCKGEMMJOB;
+
+
+
+
+// Fused weighted sum of nbsrc source vectors, one store per output
+// Accumulators for a block of pixels stay in registers while all
+// sources are summed, so each output pixel is written once.
+void blockgemm_rowcomb(
+    float *restrict dst,
+    const float *const *src,
+    const float *coeff,
+    long nbsrc,
+    long n
+)
+{
+    long p = 0;
+
+#if defined(__AVX512F__)
+    for (; p + 64 <= n; p += 64) {
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps();
+        __m512 acc3 = _mm512_setzero_ps();
+        for (long k = 0; k < nbsrc; k++) {
+            __m512 c = _mm512_set1_ps(coeff[k]);
+            const float *s = src[k] + p;
+            acc0 = _mm512_fmadd_ps(c, _mm512_loadu_ps(s), acc0);
+            acc1 = _mm512_fmadd_ps(c, _mm512_loadu_ps(s + 16), acc1);
+            acc2 = _mm512_fmadd_ps(c, _mm512_loadu_ps(s + 32), acc2);
+            acc3 = _mm512_fmadd_ps(c, _mm512_loadu_ps(s + 48), acc3);
+        }
+        _mm512_storeu_ps(dst + p, acc0);
+        _mm512_storeu_ps(dst + p + 16, acc1);
+        _mm512_storeu_ps(dst + p + 32, acc2);
+        _mm512_storeu_ps(dst + p + 48, acc3);
+    }
+    for (; p < n; p += 16) {
+        __mmask16 mask = (n - p >= 16) ? (__mmask16) 0xFFFF : (__mmask16)((1u << (n - p)) - 1);
+        __m512 acc = _mm512_setzero_ps();
+        for (long k = 0; k < nbsrc; k++) {
+            acc = _mm512_fmadd_ps(_mm512_set1_ps(coeff[k]), _mm512_maskz_loadu_ps(mask, src[k] + p), acc);
+        }
+        _mm512_mask_storeu_ps(dst + p, mask, acc);
+    }
+#elif defined(__AVX2__) && defined(__FMA__)
+    for (; p + 32 <= n; p += 32) {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+        for (long k = 0; k < nbsrc; k++) {
+            __m256 c = _mm256_set1_ps(coeff[k]);
+            const float *s = src[k] + p;
+            acc0 = _mm256_fmadd_ps(c, _mm256_loadu_ps(s), acc0);
+            acc1 = _mm256_fmadd_ps(c, _mm256_loadu_ps(s + 8), acc1);
+            acc2 = _mm256_fmadd_ps(c, _mm256_loadu_ps(s + 16), acc2);
+            acc3 = _mm256_fmadd_ps(c, _mm256_loadu_ps(s + 24), acc3);
+        }
+        _mm256_storeu_ps(dst + p, acc0);
+        _mm256_storeu_ps(dst + p + 8, acc1);
+        _mm256_storeu_ps(dst + p + 16, acc2);
+        _mm256_storeu_ps(dst + p + 24, acc3);
+    }
+#else
+    // portable: fixed-size block, vectorized by the compiler
+    for (; p + 16 <= n; p += 16) {
+        float acc[16] = {0};
+        for (long k = 0; k < nbsrc; k++) {
+            float c = coeff[k];
+            const float *s = src[k] + p;
+            for (int j = 0; j < 16; j++) {
+                acc[j] += c * s[j];
+            }
+        }
+        memcpy(dst + p, acc, sizeof(acc));
+    }
+#endif
+
+    for (; p < n; p++) {
+        float acc = 0.0f;
+        for (long k = 0; k < nbsrc; k++) {
+            acc += coeff[k] * src[k][p];
+        }
+        dst[p] = acc;
+    }
+}
+
+
+
+
+// One pixel tile of dense product, all cube pairs
+// For each block of output rows, input rows are streamed in blocks so
+// that both the output block and input block stay in cache.
+static void dense_tile(
+    const BLOCKGEMMJOB *job,
+    long p0,
+    long np
+)
+{
+    long framesize = job->framesize;
+
+    for (long i0 = 0; i0 < job->nrow; i0 += BLOCKGEMM_BLOCKI) {
+        long i1 = (i0 + BLOCKGEMM_BLOCKI < job->nrow) ? i0 + BLOCKGEMM_BLOCKI : job->nrow;
+
+        for (int pair = 0; pair < job->nbpair; pair++) {
+            for (long i = i0; i < i1; i++) {
+                memset(job->C[pair] + i * framesize + p0, 0, sizeof(float) * np);
+            }
+        }
+
+        for (long k0 = 0; k0 < job->ncol; k0 += BLOCKGEMM_BLOCKK) {
+            long k1 = (k0 + BLOCKGEMM_BLOCKK < job->ncol) ? k0 + BLOCKGEMM_BLOCKK : job->ncol;
+
+            for (int pair = 0; pair < job->nbpair; pair++) {
+                for (long i = i0; i < i1; i++) {
+                    const float *Arow = job->A + i * job->ncol;
+                    float *restrict c = job->C[pair] + i * framesize + p0;
+                    for (long k = k0; k < k1; k++) {
+                        float a = Arow[k];
+                        if (a == 0.0f) {
+                            continue;
+                        }
+                        const float *restrict b = job->B[pair] + k * framesize + p0;
+                        for (long p = 0; p < np; p++) {
+                            c[p] += a * b[p];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+// One pixel tile of sparse product, all cube pairs
+// Input tile rows are shared by all output rows, so the tile stays in
+// cache while outputs are produced one fused pass each.
+static void csr_tile(
+    const BLOCKGEMMJOB *job,
+    long p0,
+    long np,
+    const float **srcptr
+)
+{
+    const CSRMATRIX *csr = job->csr;
+    long framesize = job->framesize;
+
+    for (int pair = 0; pair < job->nbpair; pair++) {
+        for (long i = 0; i < csr->nrow; i++) {
+            long nz0 = csr->rowptr[i];
+            long nbsrc = csr->rowptr[i + 1] - nz0;
+            for (long nz = 0; nz < nbsrc; nz++) {
+                srcptr[nz] = job->B[pair] + csr->colidx[nz0 + nz] * framesize + p0;
+            }
+            blockgemm_rowcomb(job->C[pair] + i * framesize + p0, srcptr, csr->val + nz0, nbsrc, np);
+        }
+    }
+}
+
+
+// Dot product of tile vectors, independent partial sums so that the
+// loop vectorizes without reassociation
+static double tile_dot(
+    const float *restrict a,
+    const float *restrict b,
+    long n
+)
+{
+    float acc[16] = {0};
+    long p = 0;
+    for (; p + 16 <= n; p += 16) {
+        for (int k = 0; k < 16; k++) {
+            acc[k] += a[p + k] * b[p + k];
+        }
+    }
+    double sum = 0.0;
+    for (int k = 0; k < 16; k++) {
+        sum += acc[k];
+    }
+    for (; p < n; p++) {
+        sum += a[p] * b[p];
+    }
+    return sum;
+}
+
+
+// One pixel tile of cross products, accumulated into thread buffer
+// B tile rows stay in cache while all A rows are dotted with them.
+static void crossdot_tile(
+    const BLOCKGEMMJOB *job,
+    long p0,
+    long np,
+    double *Y
+)
+{
+    long framesize = job->framesize;
+    for (long i = 0; i < job->nrow; i++) {
+        const float *restrict a = job->crossA + i * framesize + p0;
+        double *Yrow = Y + i * job->ncol;
+        for (long j = 0; j < job->ncol; j++) {
+            Yrow[j] += tile_dot(a, job->crossB + j * framesize + p0, np);
+        }
+    }
+}
+
+
+static void *crossdot_thread(
+    void *ptr
+)
+{
+    BLOCKGEMMJOB *job = (BLOCKGEMMJOB *) ptr;
+
+    double *Y = (double *) calloc((size_t) job->nrow * job->ncol + 1, sizeof(double));
+    if (Y == NULL) {
+        __atomic_store_n(&job->status, -1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    long tile;
+    while ((tile = __atomic_fetch_add(&job->nexttile, 1, __ATOMIC_RELAXED)) < job->nbtile) {
+        long p0 = tile * BLOCKGEMM_TILEP;
+        long np = (p0 + BLOCKGEMM_TILEP < job->framesize) ? BLOCKGEMM_TILEP : job->framesize - p0;
+        crossdot_tile(job, p0, np, Y);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    for (long e = 0; e < job->nrow * job->ncol; e++) {
+        job->Y[e] += Y[e];
+    }
+    pthread_mutex_unlock(&job->lock);
+    free(Y);
+    return NULL;
+}
+
+
+// 4 x 4 dot products of tile vectors, partial sums in registers
+// Each loaded value is used 4 times, unlike independent tile_dot calls.
+static void syrk_micro(
+    const float *const *a,
+    const float *const *b,
+    long n,
+    double *out
+)
+{
+    long p = 0;
+#if defined(__AVX512F__)
+    __m512 acc[16];
+    for (int k = 0; k < 16; k++) {
+        acc[k] = _mm512_setzero_ps();
+    }
+    for (; p + 16 <= n; p += 16) {
+        __m512 va[4];
+        #pragma GCC unroll 4
+        for (int ii = 0; ii < 4; ii++) {
+            va[ii] = _mm512_loadu_ps(a[ii] + p);
+        }
+        #pragma GCC unroll 4
+        for (int jj = 0; jj < 4; jj++) {
+            __m512 vb = _mm512_loadu_ps(b[jj] + p);
+            #pragma GCC unroll 4
+            for (int ii = 0; ii < 4; ii++) {
+                acc[ii * 4 + jj] = _mm512_fmadd_ps(va[ii], vb, acc[ii * 4 + jj]);
+            }
+        }
+    }
+    for (int k = 0; k < 16; k++) {
+        out[k] += _mm512_reduce_add_ps(acc[k]);
+    }
+#elif defined(__AVX2__) && defined(__FMA__)
+    // two rows of a at a time, to stay within 16 registers
+    long p1 = 0;
+    for (int i2 = 0; i2 < 4; i2 += 2) {
+        __m256 acc[8];
+        for (int k = 0; k < 8; k++) {
+            acc[k] = _mm256_setzero_ps();
+        }
+        for (p1 = 0; p1 + 8 <= n; p1 += 8) {
+            __m256 va0 = _mm256_loadu_ps(a[i2] + p1);
+            __m256 va1 = _mm256_loadu_ps(a[i2 + 1] + p1);
+            #pragma GCC unroll 4
+            for (int jj = 0; jj < 4; jj++) {
+                __m256 vb = _mm256_loadu_ps(b[jj] + p1);
+                acc[jj] = _mm256_fmadd_ps(va0, vb, acc[jj]);
+                acc[4 + jj] = _mm256_fmadd_ps(va1, vb, acc[4 + jj]);
+            }
+        }
+        for (int k = 0; k < 8; k++) {
+            float v[8];
+            _mm256_storeu_ps(v, acc[k]);
+            double sum = 0.0;
+            for (int e = 0; e < 8; e++) {
+                sum += v[e];
+            }
+            out[(i2 + k / 4) * 4 + k % 4] += sum;
+        }
+    }
+    p = p1;
+#else
+    // portable: independent partial sums, vectorized by the compiler
+    float acc[4][4][8] = {{{0}}};
+    for (; p + 8 <= n; p += 8) {
+        for (int ii = 0; ii < 4; ii++) {
+            for (int jj = 0; jj < 4; jj++) {
+                for (int k = 0; k < 8; k++) {
+                    acc[ii][jj][k] += a[ii][p + k] * b[jj][p + k];
+                }
+            }
+        }
+    }
+    for (int ii = 0; ii < 4; ii++) {
+        for (int jj = 0; jj < 4; jj++) {
+            double sum = 0.0;
+            for (int k = 0; k < 8; k++) {
+                sum += acc[ii][jj][k];
+            }
+            out[ii * 4 + jj] += sum;
+        }
+    }
+#endif
+
+    for (; p < n; p++) {
+        for (int ii = 0; ii < 4; ii++) {
+            for (int jj = 0; jj < 4; jj++) {
+                out[ii * 4 + jj] += a[ii][p] * b[jj][p];
+            }
+        }
+    }
+}
+
+
+// One output block of Gram matrix, over all pixel tiles of range
+// Rows of the block pair for one tile stay in cache while all 4 x 4
+// groups are computed; partial sums per tile are added in double.
+static void syrk_block(
+    const BLOCKGEMMJOB *job,
+    long i0,
+    long j0,
+    double *Gb
+)
+{
+    long n = job->nrow;
+    long ni = (i0 + BLOCKGEMM_SYRKBLOCK < n) ? BLOCKGEMM_SYRKBLOCK : n - i0;
+    long nj = (j0 + BLOCKGEMM_SYRKBLOCK < n) ? BLOCKGEMM_SYRKBLOCK : n - j0;
+    memset(Gb, 0, sizeof(double) * BLOCKGEMM_SYRKBLOCK * BLOCKGEMM_SYRKBLOCK);
+
+    for (long p0 = job->pix0; p0 < job->pix1; p0 += BLOCKGEMM_SYRKTILEP) {
+        long np = (p0 + BLOCKGEMM_SYRKTILEP < job->pix1) ? BLOCKGEMM_SYRKTILEP : job->pix1 - p0;
+        for (long i = 0; i < ni; i += 4) {
+            // rows past block edge repeat the last row, results dropped
+            const float *a[4];
+            for (int ii = 0; ii < 4; ii++) {
+                long row = (i + ii < ni) ? i + ii : ni - 1;
+                a[ii] = job->crossA + (i0 + row) * job->framesize + p0;
+            }
+            // diagonal block: lower triangle only
+            long jmax = (i0 == j0) ? i + 4 : nj;
+            if (jmax > nj) {
+                jmax = nj;
+            }
+            for (long j = 0; j < jmax; j += 4) {
+                const float *b[4];
+                for (int jj = 0; jj < 4; jj++) {
+                    long row = (j + jj < nj) ? j + jj : nj - 1;
+                    b[jj] = job->crossA + (j0 + row) * job->framesize + p0;
+                }
+                double out[16] = {0};
+                syrk_micro(a, b, np, out);
+                for (int ii = 0; ii < 4 && i + ii < ni; ii++) {
+                    for (int jj = 0; jj < 4 && j + jj < nj; jj++) {
+                        Gb[(i + ii) * BLOCKGEMM_SYRKBLOCK + j + jj] += out[ii * 4 + jj];
+                    }
+                }
+            }
+        }
+    }
+
+    // blocks are owned by one thread: add to both triangles directly
+    for (long i = 0; i < ni; i++) {
+        long jmax = (i0 == j0) ? i + 1 : nj;
+        for (long j = 0; j < jmax; j++) {
+            double v = Gb[i * BLOCKGEMM_SYRKBLOCK + j];
+            job->G[(i0 + i) * n + j0 + j] += v;
+            if (i0 + i != j0 + j) {
+                job->G[(j0 + j) * n + i0 + i] += v;
+            }
+        }
+    }
+}
+
+
+static void *syrk_thread(
+    void *ptr
+)
+{
+    BLOCKGEMMJOB *job = (BLOCKGEMMJOB *) ptr;
+
+    double *Gb = (double *) malloc(sizeof(double) * BLOCKGEMM_SYRKBLOCK * BLOCKGEMM_SYRKBLOCK);
+    if (Gb == NULL) {
+        __atomic_store_n(&job->status, -1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    long tile;
+    while ((tile = __atomic_fetch_add(&job->nexttile, 1, __ATOMIC_RELAXED)) < job->nbtile) {
+        // lower triangle blocks, row by row
+        long bi = 0;
+        while ((bi + 1) * (bi + 2) / 2 <= tile) {
+            bi++;
+        }
+        long bj = tile - bi * (bi + 1) / 2;
+        syrk_block(job, bi * BLOCKGEMM_SYRKBLOCK, bj * BLOCKGEMM_SYRKBLOCK, Gb);
+    }
+    free(Gb);
+    return NULL;
+}
+
+
+static void *blockgemm_thread(
+    void *ptr
+)
+{
+    BLOCKGEMMJOB *job = (BLOCKGEMMJOB *) ptr;
+
+    const float **srcptr = NULL;
+    if (job->csr != NULL) {
+        srcptr = (const float **) malloc(sizeof(float *) * (job->maxrownnz > 0 ? job->maxrownnz : 1));
+        if (srcptr == NULL) {
+            __atomic_store_n(&job->status, -1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+    }
+
+    long tile;
+    while ((tile = __atomic_fetch_add(&job->nexttile, 1, __ATOMIC_RELAXED)) < job->nbtile) {
+        long p0 = tile * BLOCKGEMM_TILEP;
+        long np = (p0 + BLOCKGEMM_TILEP < job->framesize) ? BLOCKGEMM_TILEP : job->framesize - p0;
+        if (job->csr != NULL) {
+            csr_tile(job, p0, np, srcptr);
+        } else {
+            dense_tile(job, p0, np);
+        }
+    }
+    free(srcptr);
+    return NULL;
+}
+
+
+static int blockgemm_runthreads(
+    BLOCKGEMMJOB *job,
+    int nbthread
+)
+{
+    void *(*func)(void *);
+    if (job->G != NULL) {
+        long nbblock = (job->nrow + BLOCKGEMM_SYRKBLOCK - 1) / BLOCKGEMM_SYRKBLOCK;
+        job->nbtile = nbblock * (nbblock + 1) / 2;
+        func = syrk_thread;
+    } else {
+        job->nbtile = (job->framesize + BLOCKGEMM_TILEP - 1) / BLOCKGEMM_TILEP;
+        func = (job->Y != NULL) ? crossdot_thread : blockgemm_thread;
+    }
+    job->nexttile = 0;
+    if (nbthread > job->nbtile) {
+        nbthread = (int) job->nbtile;
+    }
+    if (nbthread <= 1) {
+        func(job);
+        return job->status;
+    }
+
+    pthread_t *threads = (pthread_t *) malloc(sizeof(pthread_t) * nbthread);
+    if (threads == NULL) {
+        return -1;
+    }
+    int nbstarted = 0;
+    for (int th = 1; th < nbthread; th++) {
+        if (pthread_create(&threads[nbstarted], NULL, func, job) == 0) {
+            nbstarted++;
+        }
+    }
+    // calling thread takes its share, and all tiles if no thread started
+    func(job);
+    for (int th = 0; th < nbstarted; th++) {
+        pthread_join(threads[th], NULL);
+    }
+    free(threads);
+    return job->status;
+}
+
+
+
+
+int blockgemm_dense(
+    const float *A,
+    long nrow,
+    long ncol,
+    const float *const *B,
+    float *const *C,
+    int nbpair,
+    long framesize,
+    int nbthread
+)
+{
+    BLOCKGEMMJOB job = {0};
+    job.A = A;
+    job.nrow = nrow;
+    job.ncol = ncol;
+    job.B = B;
+    job.C = C;
+    job.nbpair = nbpair;
+    job.framesize = framesize;
+    return blockgemm_runthreads(&job, nbthread);
+}
+
+
+int blockgemm_csr(
+    const CSRMATRIX *A,
+    const float *const *B,
+    float *const *C,
+    int nbpair,
+    long framesize,
+    int nbthread
+)
+{
+    BLOCKGEMMJOB job = {0};
+    job.csr = A;
+    for (long i = 0; i < A->nrow; i++) {
+        if (A->rowptr[i + 1] - A->rowptr[i] > job.maxrownnz) {
+            job.maxrownnz = A->rowptr[i + 1] - A->rowptr[i];
+        }
+    }
+    job.nrow = A->nrow;
+    job.ncol = A->ncol;
+    job.B = B;
+    job.C = C;
+    job.nbpair = nbpair;
+    job.framesize = framesize;
+    return blockgemm_runthreads(&job, nbthread);
+}
+
+
+int blockgemm_crossdot(
+    const float *A,
+    long nrowA,
+    const float *B,
+    long nrowB,
+    long framesize,
+    double *Y,
+    int nbthread
+)
+{
+    BLOCKGEMMJOB job = {0};
+    job.crossA = A;
+    job.crossB = B;
+    job.nrow = nrowA;
+    job.ncol = nrowB;
+    job.Y = Y;
+    job.framesize = framesize;
+    memset(Y, 0, sizeof(double) * nrowA * nrowB);
+    pthread_mutex_init(&job.lock, NULL);
+    int status = blockgemm_runthreads(&job, nbthread);
+    pthread_mutex_destroy(&job.lock);
+    return status;
+}
+
+
+int blockgemm_syrk(
+    const float *A,
+    long nrow,
+    long framesize,
+    long pix0,
+    long pix1,
+    double *G,
+    int nbthread
+)
+{
+    if (pix0 < 0 || pix1 > framesize || pix1 <= pix0 || nrow < 1) {
+        return 0;
+    }
+    BLOCKGEMMJOB job = {0};
+    job.crossA = A;
+    job.nrow = nrow;
+    job.framesize = framesize;
+    job.G = G;
+    job.pix0 = pix0;
+    job.pix1 = pix1;
+    return blockgemm_runthreads(&job, nbthread);
+}
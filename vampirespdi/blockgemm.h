@@ -0,0 +1,160 @@
+#ifndef _VAMPIRES_PDI__BLOCKGEMM_H
+#define _VAMPIRES_PDI__BLOCKGEMM_H
+
+
+// Blocked multi-threaded products of a frame mixing matrix with cubes
+//
+// A cube is stored frame-major: nbframe rows of framesize pixels.
+// Output cube C = A . B mixes input frames: C_i = sum_j A_ij B_j.
+// Several cubes (e.g. cam1 and cam2) are multiplied by the same matrix
+// in one pass over it.
+// Threads own disjoint pixel column tiles, so no synchronization is
+// needed on output.
+
+
+// Pixel tile width [floats]
+#define BLOCKGEMM_TILEP 256
+
+// Frame blocking: output rows and input rows kept in cache together
+#define BLOCKGEMM_BLOCKI 64
+#define BLOCKGEMM_BLOCKK 64
+
+// Gram matrix: output block [frames], pixel tile [floats]
+#define BLOCKGEMM_SYRKBLOCK 128
+#define BLOCKGEMM_SYRKTILEP 1024
+
+
+// Compressed sparse row matrix
+typedef struct {
+    long   nrow;
+    long   ncol;
+    long   nnz;
+    long  *rowptr; // nrow+1 entries
+    long  *colidx; // nnz entries
+    float *val;    // nnz entries
+} CSRMATRIX;
+
+
+/**
+ * @brief Allocates CSR matrix.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int CSRMATRIX_alloc(
+    CSRMATRIX *csr,
+    long nrow,
+    long ncol,
+    long nnz
+);
+
+void CSRMATRIX_free(
+    CSRMATRIX *csr
+);
+
+/**
+ * @brief Fused weighted sum dst = sum_k coeff[k] src[k].
+ *
+ * Vectorized with AVX-512 or AVX2 when compiled for it, portable loop
+ * otherwise. Each output value is stored once.
+ *
+ * @param dst Output vector, n floats.
+ * @param src Source vectors, nbsrc pointers to n floats.
+ * @param coeff Source weights.
+ * @param nbsrc Number of sources.
+ * @param n Vector length.
+ */
+void blockgemm_rowcomb(
+    float *dst,
+    const float *const *src,
+    const float *coeff,
+    long nbsrc,
+    long n
+);
+
+/**
+ * @brief Dense product C[p] = A . B[p] for each cube pair p.
+ *
+ * @param A Matrix, nrow x ncol, row-major.
+ * @param nrow Number of output frames.
+ * @param ncol Number of input frames.
+ * @param B Input cubes, ncol x framesize each.
+ * @param C Output cubes, nrow x framesize each, overwritten.
+ * @param nbpair Number of cube pairs.
+ * @param framesize Number of pixels per frame.
+ * @param nbthread Number of threads.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int blockgemm_dense(
+    const float *A,
+    long nrow,
+    long ncol,
+    const float *const *B,
+    float *const *C,
+    int nbpair,
+    long framesize,
+    int nbthread
+);
+
+/**
+ * @brief Sparse product C[p] = A . B[p] for each cube pair p.
+ *
+ * Arguments as blockgemm_dense, with A in CSR format.
+ */
+int blockgemm_csr(
+    const CSRMATRIX *A,
+    const float *const *B,
+    float *const *C,
+    int nbpair,
+    long framesize,
+    int nbthread
+);
+
+
+/**
+ * @brief Cross products of frames of two cubes.
+ *
+ * Y[i * nrowB + j] = sum_p A[i][p] B[j][p], partial sums per pixel tile
+ * in single precision, accumulated in double precision.
+ * Efficient when B is small enough for a pixel tile of all its rows to
+ * stay in cache (nrowB up to a few hundred).
+ *
+ * @param A First cube, nrowA x framesize.
+ * @param B Second cube, nrowB x framesize.
+ * @param Y Output, nrowA x nrowB, overwritten.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int blockgemm_crossdot(
+    const float *A,
+    long nrowA,
+    const float *B,
+    long nrowB,
+    long framesize,
+    double *Y,
+    int nbthread
+);
+
+
+/**
+ * @brief Gram matrix of frames over a pixel range, accumulated.
+ *
+ * G[i * nrow + j] += sum_{pix0 <= p < pix1} A[i][p] A[j][p]
+ * Threads own disjoint output blocks of the lower triangle, mirrored to
+ * the upper one, and stream all pixel tiles of the range through each
+ * block. Calling over successive pixel ranges accumulates the full
+ * Gram matrix slab by slab.
+ *
+ * @param A Cube, nrow x framesize.
+ * @param G Output, nrow x nrow, added to.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int blockgemm_syrk(
+    const float *A,
+    long nrow,
+    long framesize,
+    long pix0,
+    long pix1,
+    double *G,
+    int nbthread
+);
+
+
+#endif
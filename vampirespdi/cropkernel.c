@@ -0,0 +1,360 @@
+#include <string.h>
+#include <endian.h>
+
+#include "cropkernel.h"
+
+
+
+
+int cropkernel_bitpixtype(
+    int bitpix
+)
+{
+    switch (bitpix) {
+    case 8:
+        return CROPKERNEL_U8;
+    case 16:
+        return CROPKERNEL_I16;
+    case 32:
+        return CROPKERNEL_I32;
+    case 64:
+        return CROPKERNEL_I64;
+    case -32:
+        return CROPKERNEL_F32;
+    case -64:
+        return CROPKERNEL_F64;
+    }
+    return -1;
+}
+
+
+int cropkernel_typesize(
+    int srctype
+)
+{
+    switch (srctype) {
+    case CROPKERNEL_U8:
+        return 1;
+    case CROPKERNEL_U16:
+    case CROPKERNEL_I16:
+        return 2;
+    case CROPKERNEL_I64:
+    case CROPKERNEL_F64:
+        return 8;
+    }
+    return 4;
+}
+
+
+
+
+// Row conversion loops
+// Fixed width variants let the compiler unroll and vectorize the
+// conversion without a remainder loop.
+#define CROPKERNEL_ROWFUNC(name, srctype, width)                     \
+static inline void name(                                             \
+    const srctype *restrict src,                                     \
+    float *restrict dst,                                             \
+    long w,                                                          \
+    float bscale,                                                    \
+    float bzero                                                      \
+)                                                                    \
+{                                                                    \
+    const long n = (width > 0) ? width : w;                          \
+    for (long i = 0; i < n; i++) {                                   \
+        dst[i] = (float) src[i] * bscale + bzero;                    \
+    }                                                                \
+}
+
+// Window loop, dispatching once on width
+#define CROPKERNEL_WINDOWFUNC(name, srctype)                         \
+CROPKERNEL_ROWFUNC(name##_row,     srctype, 0)                       \
+CROPKERNEL_ROWFUNC(name##_row32,   srctype, 32)                      \
+CROPKERNEL_ROWFUNC(name##_row64,   srctype, 64)                      \
+CROPKERNEL_ROWFUNC(name##_row128,  srctype, 128)                     \
+CROPKERNEL_ROWFUNC(name##_row256,  srctype, 256)                     \
+static void name(                                                    \
+    const srctype *restrict src,                                     \
+    long srcstride,                                                  \
+    float *restrict dst,                                             \
+    long dststride,                                                  \
+    long width,                                                      \
+    long height,                                                     \
+    float bscale,                                                    \
+    float bzero                                                      \
+)                                                                    \
+{                                                                    \
+    for (long j = 0; j < height; j++) {                              \
+        const srctype *s = src + j*srcstride;                        \
+        float *d = dst + j*dststride;                                \
+        switch (width) {                                             \
+        case 32:                                                     \
+            name##_row32(s, d, 32, bscale, bzero);                   \
+            break;                                                   \
+        case 64:                                                     \
+            name##_row64(s, d, 64, bscale, bzero);                   \
+            break;                                                   \
+        case 128:                                                    \
+            name##_row128(s, d, 128, bscale, bzero);                 \
+            break;                                                   \
+        case 256:                                                    \
+            name##_row256(s, d, 256, bscale, bzero);                 \
+            break;                                                   \
+        default:                                                     \
+            name##_row(s, d, width, bscale, bzero);                  \
+            break;                                                   \
+        }                                                            \
+    }                                                                \
+}
+
+CROPKERNEL_WINDOWFUNC(window_u8,  uint8_t)
+CROPKERNEL_WINDOWFUNC(window_u16, uint16_t)
+CROPKERNEL_WINDOWFUNC(window_i16, int16_t)
+CROPKERNEL_WINDOWFUNC(window_i32, int32_t)
+CROPKERNEL_WINDOWFUNC(window_i64, int64_t)
+CROPKERNEL_WINDOWFUNC(window_f32, float)
+CROPKERNEL_WINDOWFUNC(window_f64, double)
+
+
+
+
+// Big-endian (FITS on-disk) source loaders
+static inline uint8_t load_be_u8(const unsigned char *p)
+{
+    return p[0];
+}
+static inline int16_t load_be_i16(const unsigned char *p)
+{
+    uint16_t u;
+    memcpy(&u, p, sizeof(u));
+    return (int16_t) be16toh(u);
+}
+static inline int32_t load_be_i32(const unsigned char *p)
+{
+    uint32_t u;
+    memcpy(&u, p, sizeof(u));
+    return (int32_t) be32toh(u);
+}
+static inline int64_t load_be_i64(const unsigned char *p)
+{
+    uint64_t u;
+    memcpy(&u, p, sizeof(u));
+    return (int64_t) be64toh(u);
+}
+static inline float load_be_f32(const unsigned char *p)
+{
+    uint32_t u;
+    float v;
+    memcpy(&u, p, sizeof(u));
+    u = be32toh(u);
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+static inline double load_be_f64(const unsigned char *p)
+{
+    uint64_t u;
+    double v;
+    memcpy(&u, p, sizeof(u));
+    u = be64toh(u);
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+
+// Big-endian row conversion loops, same width specializations
+#define CROPKERNEL_BEROWFUNC(name, load, pixsize, width)             \
+static inline void name(                                             \
+    const unsigned char *restrict src,                               \
+    float *restrict dst,                                             \
+    long w,                                                          \
+    float bscale,                                                    \
+    float bzero                                                      \
+)                                                                    \
+{                                                                    \
+    const long n = (width > 0) ? width : w;                          \
+    for (long i = 0; i < n; i++) {                                   \
+        dst[i] = (float) load(src + (pixsize)*i) * bscale + bzero;   \
+    }                                                                \
+}
+
+#define CROPKERNEL_BEWINDOWFUNC(name, load, pixsize)                 \
+CROPKERNEL_BEROWFUNC(name##_row,     load, pixsize, 0)               \
+CROPKERNEL_BEROWFUNC(name##_row32,   load, pixsize, 32)              \
+CROPKERNEL_BEROWFUNC(name##_row64,   load, pixsize, 64)              \
+CROPKERNEL_BEROWFUNC(name##_row128,  load, pixsize, 128)             \
+CROPKERNEL_BEROWFUNC(name##_row256,  load, pixsize, 256)             \
+static void name(                                                    \
+    const unsigned char *restrict src,                               \
+    long srcstride,                                                  \
+    float *restrict dst,                                             \
+    long dststride,                                                  \
+    long width,                                                      \
+    long height,                                                     \
+    float bscale,                                                    \
+    float bzero                                                      \
+)                                                                    \
+{                                                                    \
+    for (long j = 0; j < height; j++) {                              \
+        const unsigned char *s = src + (pixsize)*j*srcstride;        \
+        float *d = dst + j*dststride;                                \
+        switch (width) {                                             \
+        case 32:                                                     \
+            name##_row32(s, d, 32, bscale, bzero);                   \
+            break;                                                   \
+        case 64:                                                     \
+            name##_row64(s, d, 64, bscale, bzero);                   \
+            break;                                                   \
+        case 128:                                                    \
+            name##_row128(s, d, 128, bscale, bzero);                 \
+            break;                                                   \
+        case 256:                                                    \
+            name##_row256(s, d, 256, bscale, bzero);                 \
+            break;                                                   \
+        default:                                                     \
+            name##_row(s, d, width, bscale, bzero);                  \
+            break;                                                   \
+        }                                                            \
+    }                                                                \
+}
+
+CROPKERNEL_BEWINDOWFUNC(window_be_u8,  load_be_u8,  1)
+CROPKERNEL_BEWINDOWFUNC(window_be_i16, load_be_i16, 2)
+CROPKERNEL_BEWINDOWFUNC(window_be_i32, load_be_i32, 4)
+CROPKERNEL_BEWINDOWFUNC(window_be_i64, load_be_i64, 8)
+CROPKERNEL_BEWINDOWFUNC(window_be_f32, load_be_f32, 4)
+CROPKERNEL_BEWINDOWFUNC(window_be_f64, load_be_f64, 8)
+
+
+
+
+void cropkernel_f32(
+    const float *restrict src,
+    long srcstride,
+    float *restrict dst,
+    long dststride,
+    long width,
+    long height
+)
+{
+    if (srcstride == width && dststride == width) {
+        memcpy(dst, src, sizeof(float) * width * height);
+        return;
+    }
+    for (long j = 0; j < height; j++) {
+        memcpy(dst + j*dststride, src + j*srcstride, sizeof(float) * width);
+    }
+}
+
+
+
+
+void cropkernel(
+    int srctype,
+    const void *src,
+    long srcstride,
+    long x0,
+    long y0,
+    float *dst,
+    long dststride,
+    long width,
+    long height,
+    float bscale,
+    float bzero
+)
+{
+    long offset = y0*srcstride + x0;
+
+    switch (srctype) {
+    case CROPKERNEL_U8:
+        window_u8((const uint8_t *) src + offset, srcstride, dst, dststride, width, height, bscale, bzero);
+        break;
+    case CROPKERNEL_U16:
+        window_u16((const uint16_t *) src + offset, srcstride, dst, dststride, width, height, bscale, bzero);
+        break;
+    case CROPKERNEL_I16:
+        window_i16((const int16_t *) src + offset, srcstride, dst, dststride, width, height, bscale, bzero);
+        break;
+    case CROPKERNEL_I32:
+        window_i32((const int32_t *) src + offset, srcstride, dst, dststride, width, height, bscale, bzero);
+        break;
+    case CROPKERNEL_I64:
+        window_i64((const int64_t *) src + offset, srcstride, dst, dststride, width, height, bscale, bzero);
+        break;
+    case CROPKERNEL_F64:
+        window_f64((const double *) src + offset, srcstride, dst, dststride, width, height, bscale, bzero);
+        break;
+    default:
+        if (bscale == 1.0f && bzero == 0.0f) {
+            cropkernel_f32((const float *) src + offset, srcstride, dst, dststride, width, height);
+        } else {
+            window_f32((const float *) src + offset, srcstride, dst, dststride, width, height, bscale, bzero);
+        }
+        break;
+    }
+}
+
+
+
+
+void cropkernel_bigendian(
+    int srctype,
+    const void *src,
+    long srcstride,
+    long x0,
+    long y0,
+    float *dst,
+    long dststride,
+    long width,
+    long height,
+    float bscale,
+    float bzero
+)
+{
+    const unsigned char *s = (const unsigned char *) src
+                             + (size_t) cropkernel_typesize(srctype) * (y0*srcstride + x0);
+
+    switch (srctype) {
+    case CROPKERNEL_U8:
+        window_be_u8(s, srcstride, dst, dststride, width, height, bscale, bzero);
+        break;
+    case CROPKERNEL_I16:
+        window_be_i16(s, srcstride, dst, dststride, width, height, bscale, bzero);
+        break;
+    case CROPKERNEL_I32:
+        window_be_i32(s, srcstride, dst, dststride, width, height, bscale, bzero);
+        break;
+    case CROPKERNEL_I64:
+        window_be_i64(s, srcstride, dst, dststride, width, height, bscale, bzero);
+        break;
+    case CROPKERNEL_F64:
+        window_be_f64(s, srcstride, dst, dststride, width, height, bscale, bzero);
+        break;
+    default:
+        window_be_f32(s, srcstride, dst, dststride, width, height, bscale, bzero);
+        break;
+    }
+}
+
+
+
+
+void cropkernel_frame(
+    int srctype,
+    const void *frame,
+    long naxis1,
+    const CROPGEOM *crop,
+    float *destframe,
+    float bscale,
+    float bzero
+)
+{
+    long destxsize = crop->xsize * crop->cropnb;
+
+    for (int c = 0; c < crop->cropnb; c++) {
+        long x0 = crop->xcenter[c] - crop->xsize/2;
+        long y0 = crop->ycenter[c] - crop->ysize/2;
+        cropkernel(srctype, frame, naxis1, x0, y0,
+                   destframe + c*crop->xsize, destxsize,
+                   crop->xsize, crop->ysize, bscale, bzero);
+    }
+}
@@ -0,0 +1,137 @@
+#ifndef _VAMPIRES_PDI__CROPKERNEL_H
+#define _VAMPIRES_PDI__CROPKERNEL_H
+
+#include <stdint.h>
+
+
+// Source pixel types
+#define CROPKERNEL_F32 0
+#define CROPKERNEL_U16 1
+#define CROPKERNEL_I16 2
+#define CROPKERNEL_U8  3
+#define CROPKERNEL_I32 4
+#define CROPKERNEL_I64 5
+#define CROPKERNEL_F64 6
+
+
+// Crop geometry of one camera
+// Crops are placed side by side in destination frames:
+// destination frame size is (xsize * cropnb) x ysize
+typedef struct {
+    long xsize;
+    long ysize;
+    int  cropnb;
+    const int *xcenter; // cropnb crop centers, source pixel coordinates
+    const int *ycenter;
+} CROPGEOM;
+
+
+
+/**
+ * @brief Source pixel type for FITS BITPIX value.
+ * @return Pixel type, -1 if bitpix is not valid.
+ */
+int cropkernel_bitpixtype(
+    int bitpix
+);
+
+/**
+ * @brief Size of source pixel type, in bytes.
+ */
+int cropkernel_typesize(
+    int srctype
+);
+
+/**
+ * @brief Copies a width x height float window, row by row.
+ *
+ * @param src First source pixel of window.
+ * @param srcstride Source row length, in pixels.
+ * @param dst First destination pixel.
+ * @param dststride Destination row length, in pixels.
+ */
+void cropkernel_f32(
+    const float *restrict src,
+    long srcstride,
+    float *restrict dst,
+    long dststride,
+    long width,
+    long height
+);
+
+/**
+ * @brief Copies window of source of given pixel type to float destination.
+ *
+ * Destination pixels are src * bscale + bzero, so that raw FITS integer
+ * data is converted only for retained pixels.
+ * Rows are copied contiguously; row conversion loops are specialized for
+ * each source type and for common crop widths (32, 64, 128, 256) so
+ * that the compiler can fully vectorize the conversion.
+ *
+ * @param srctype Source pixel type, CROPKERNEL_*.
+ * @param src Source frame (not window) start.
+ * @param x0 Window first column in source.
+ * @param y0 Window first row in source.
+ * @param bscale Pixel scale, FITS BSCALE.
+ * @param bzero Pixel offset, FITS BZERO.
+ */
+void cropkernel(
+    int srctype,
+    const void *src,
+    long srcstride,
+    long x0,
+    long y0,
+    float *dst,
+    long dststride,
+    long width,
+    long height,
+    float bscale,
+    float bzero
+);
+
+/**
+ * @brief Same as cropkernel, for big-endian source data.
+ *
+ * Reads FITS data units as stored on disk, e.g. from a memory-mapped
+ * file: pixels are byte-swapped and converted in a single pass.
+ * CROPKERNEL_U16 is not a FITS type and is not supported.
+ */
+void cropkernel_bigendian(
+    int srctype,
+    const void *src,
+    long srcstride,
+    long x0,
+    long y0,
+    float *dst,
+    long dststride,
+    long width,
+    long height,
+    float bscale,
+    float bzero
+);
+
+/**
+ * @brief Extracts all crops of one source frame into one destination frame.
+ *
+ * Crop windows must be within source frame, see CROPGEOM_check.
+ *
+ * @param srctype Source pixel type.
+ * @param frame Source frame.
+ * @param naxis1 Source frame row length.
+ * @param crop Crop geometry.
+ * @param destframe Destination frame, (xsize * cropnb) x ysize.
+ * @param bscale Pixel scale.
+ * @param bzero Pixel offset.
+ */
+void cropkernel_frame(
+    int srctype,
+    const void *frame,
+    long naxis1,
+    const CROPGEOM *crop,
+    float *destframe,
+    float bscale,
+    float bzero
+);
+
+
+#endif
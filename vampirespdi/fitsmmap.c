@@ -0,0 +1,88 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string.h>
+
+#include "fitsmmap.h"
+#include "cropkernel.h"
+
+
+
+
+int FITSmmap_open(
+    FITSMMAP *fmap,
+    const FITSfileinfo *finfo
+)
+{
+    memset(fmap, 0, sizeof(FITSMMAP));
+
+    fmap->srctype = cropkernel_bitpixtype(finfo->bitpix);
+    if (finfo->compressed || finfo->dataoffset < 0 || fmap->srctype < 0) {
+        return -1;
+    }
+    fmap->planesize = finfo->naxes[0] * finfo->naxes[1];
+
+    int fd = open(finfo->fname, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat st;
+    size_t datasize = (size_t) cropkernel_typesize(fmap->srctype) * fmap->planesize * finfo->naxes[2];
+    if (fstat(fd, &st) != 0
+            || (size_t) st.st_size < (size_t) finfo->dataoffset + datasize) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    fmap->map = map;
+    fmap->mapsize = st.st_size;
+    fmap->data = (const unsigned char *) map + finfo->dataoffset;
+
+    return 0;
+}
+
+
+
+
+void FITSmmap_willneed(
+    const FITSMMAP *fmap,
+    long k0,
+    long k1
+)
+{
+    size_t planebytes = (size_t) cropkernel_typesize(fmap->srctype) * fmap->planesize;
+    size_t start = (size_t)(fmap->data - (const unsigned char *) fmap->map) + planebytes * k0;
+    size_t end = start + planebytes * (k1 - k0);
+
+    // madvise address must be page-aligned
+    size_t pagesize = (size_t) sysconf(_SC_PAGESIZE);
+    start -= start % pagesize;
+    if (end > fmap->mapsize) {
+        end = fmap->mapsize;
+    }
+    if (end > start) {
+        madvise((char *) fmap->map + start, end - start, MADV_WILLNEED);
+    }
+}
+
+
+
+
+void FITSmmap_close(
+    FITSMMAP *fmap
+)
+{
+    if (fmap->map != NULL) {
+        munmap(fmap->map, fmap->mapsize);
+    }
+    memset(fmap, 0, sizeof(FITSMMAP));
+}
@@ -0,0 +1,52 @@
+#ifndef _VAMPIRES_PDI__FITSMMAP_H
+#define _VAMPIRES_PDI__FITSMMAP_H
+
+#include <stddef.h>
+
+#include "scanFITSfiles.h"
+
+
+// Memory-mapped image data unit of an uncompressed FITS file
+// Pixels are big-endian, in the BITPIX type of the image
+typedef struct {
+    void  *map;         // NULL if not mapped
+    size_t mapsize;
+    const unsigned char *data; // first pixel of data unit
+    int    srctype;     // CROPKERNEL_* pixel type
+    long   planesize;   // pixels per frame plane
+} FITSMMAP;
+
+
+/**
+ * @brief Maps FITS file for direct pixel access.
+ *
+ * Uses data unit offset recorded at scan time (finfo->dataoffset).
+ * The mapping is advised for sequential access.
+ *
+ * @return 0 on success, -1 if file cannot be read directly
+ * (compressed, offset unknown, unsupported BITPIX, truncated file or
+ * mapping failure): caller should fall back to cfitsio.
+ */
+int FITSmmap_open(
+    FITSMMAP *fmap,
+    const FITSfileinfo *finfo
+);
+
+/**
+ * @brief Advises kernel that frame planes k0 to k1-1 will be read soon.
+ */
+void FITSmmap_willneed(
+    const FITSMMAP *fmap,
+    long k0,
+    long k1
+);
+
+/**
+ * @brief Unmaps file.
+ */
+void FITSmmap_close(
+    FITSMMAP *fmap
+);
+
+
+#endif
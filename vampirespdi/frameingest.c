@@ -0,0 +1,1069 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frameingest.h"
+#include "fitsmmap.h"
+
+
+
+// Chunk data layouts
+#define CHUNK_PLANE 0 // full frame planes: [frame][naxis2][naxis1]
+#define CHUNK_ROI   1 // crop windows: [crop][frame][ysize][xsize]
+#define CHUNK_BBOX  2 // bounding box of crop windows: [frame][bh][bw]
+
+
+// Chunk of frames of one file, held in a pool buffer
+typedef struct {
+    char  *data;     // raw pixels of type srctype, not scaled
+    int   *destidx;  // destination frame index of each chunk frame, -1 if not matched
+    const FITSfileinfo *finfo;
+    int    cam;
+    int    layout;
+    long   nbframe;
+    int    srctype;  // CROPKERNEL_* pixel type
+    float  bscale;   // applied at scatter
+    float  bzero;
+} INGESTCHUNK;
+
+
+// Reader job: frame range of one file
+// Uncompressed files are one job. Tile-compressed files are split in
+// runs of matched frames so that several readers decompress the same
+// cube concurrently, each with its own cfitsio handle.
+typedef struct {
+    long file;
+    long k0;         // frame range k0 to k1-1, whole file if k0 < 0
+    long k1;
+    int  first;      // first job of file
+} INGESTJOB;
+
+
+// File currently open by a reader
+typedef struct {
+    const FITSfileinfo *finfo; // NULL if none
+    fitsfile *fptr;
+    double bscale;
+    double bzero;
+    int    bbox;     // 1: read bounding box of crops in one subset
+} READERFILE;
+
+
+// Pipeline state shared by readers and workers
+typedef struct {
+    const FITSfileinfo *finfo;
+    long nbfile;
+    const CROPGEOM *crop;
+    float **dest;
+    int mode;
+
+    INGESTJOB *job;
+    long nbjob;
+    long nextjob;         // next job to be claimed by a reader
+
+    INGESTCHUNK *chunk;   // pool, queuedepth chunks
+    int   queuedepth;
+    INGESTCHUNK **freelist; // free buffers (stack)
+    int   nbfree;
+    INGESTCHUNK **ready;  // filled buffers (FIFO)
+    int   readyhead;
+    int   nbready;
+    int   nbreaderactive;
+    int   status;         // first error, 0 if none
+
+    pthread_mutex_t lock;
+    pthread_cond_t  freecond;
+    pthread_cond_t  readycond;
+
+    FRAMEINGESTHOOK framehook;
+    void *framehookarg;
+
+    long nbfileread;
+    long nbplaneread;
+    long nbfilemmap;      // files read from memory map
+    long nbfilebbox;      // compressed files read by crop bounding box
+} INGESTPIPE;
+
+
+
+
+int frameingest_parsemode(
+    const char *modestr
+)
+{
+    if (strcmp(modestr, "fullcube") == 0) {
+        return FRAMEINGEST_FULLCUBE;
+    }
+    if (strcmp(modestr, "selective") == 0) {
+        return FRAMEINGEST_SELECTIVE;
+    }
+    if (strcmp(modestr, "roi") == 0) {
+        return FRAMEINGEST_ROI;
+    }
+    if (strcmp(modestr, "mmap") == 0) {
+        return FRAMEINGEST_MMAP;
+    }
+    return -1;
+}
+
+
+
+
+int CROPGEOM_check(
+    const CROPGEOM *crop,
+    long naxis1,
+    long naxis2
+)
+{
+    for(int c=0; c<crop->cropnb; c++)
+    {
+        long x0 = crop->xcenter[c] - crop->xsize/2;
+        long y0 = crop->ycenter[c] - crop->ysize/2;
+        if (x0 < 0 || y0 < 0 || x0 + crop->xsize > naxis1 || y0 + crop->ysize > naxis2) {
+            fprintf(stderr, "crop %d [%ld:%ld, %ld:%ld] outside of %ld x %ld frame\n",
+                    c, x0, x0 + crop->xsize - 1, y0, y0 + crop->ysize - 1, naxis1, naxis2);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+
+
+// camera index of file, -1 if file is not read in this mode
+static int file_camera(
+    const FITSfileinfo *finfo,
+    int mode
+)
+{
+    int cam = finfo->selected - 1;
+    if (cam < 0 || cam > 1) {
+        // not selected: all destination indices are negative
+        return (mode == FRAMEINGEST_FULLCUBE) ? 0 : -1;
+    }
+    return cam;
+}
+
+
+// cfitsio datatype for raw pixels of given BITPIX
+static int bitpix_datatype(
+    int bitpix
+)
+{
+    switch (bitpix) {
+    case BYTE_IMG:
+        return TBYTE;
+    case SHORT_IMG:
+        return TSHORT;
+    case LONG_IMG:
+        return TINT;
+    case LONGLONG_IMG:
+        return TLONGLONG;
+    case DOUBLE_IMG:
+        return TDOUBLE;
+    }
+    return TFLOAT;
+}
+
+
+// bounding box of crop windows
+static void crop_bbox(
+    const CROPGEOM *crop,
+    long *bx0,
+    long *by0,
+    long *bw,
+    long *bh
+)
+{
+    long xmin = 0, xmax = 0, ymin = 0, ymax = 0;
+    for(int c=0; c<crop->cropnb; c++)
+    {
+        long x0 = crop->xcenter[c] - crop->xsize/2;
+        long y0 = crop->ycenter[c] - crop->ysize/2;
+        if (c == 0 || x0 < xmin) {
+            xmin = x0;
+        }
+        if (c == 0 || y0 < ymin) {
+            ymin = y0;
+        }
+        if (c == 0 || x0 + crop->xsize > xmax) {
+            xmax = x0 + crop->xsize;
+        }
+        if (c == 0 || y0 + crop->ysize > ymax) {
+            ymax = y0 + crop->ysize;
+        }
+    }
+    *bx0 = xmin;
+    *by0 = ymin;
+    *bw = xmax - xmin;
+    *bh = ymax - ymin;
+}
+
+
+// number of tiles intersecting a window
+static long window_nbtile(
+    long x0,
+    long y0,
+    long w,
+    long h,
+    const long *tiledim
+)
+{
+    return ((x0 + w - 1) / tiledim[0] - x0 / tiledim[0] + 1)
+           * ((y0 + h - 1) / tiledim[1] - y0 / tiledim[1] + 1);
+}
+
+
+// number of pixels per chunk frame
+static long chunk_framesize(
+    const FITSfileinfo *finfo,
+    const CROPGEOM *crop,
+    int mode
+)
+{
+    if (mode == FRAMEINGEST_FULLCUBE || mode == FRAMEINGEST_SELECTIVE) {
+        return finfo->naxes[0] * finfo->naxes[1];
+    }
+
+    // ROI, and mmap mode fallback
+    long framesize = crop->xsize * crop->ysize * crop->cropnb;
+    if (finfo->compressed) {
+        // compressed files may be read by bounding box
+        long bx0, by0, bw, bh;
+        crop_bbox(crop, &bx0, &by0, &bw, &bh);
+        if (bw * bh > framesize) {
+            framesize = bw * bh;
+        }
+    }
+    return framesize;
+}
+
+
+// maximum number of frames per chunk
+static long chunk_maxframe(
+    long framesize,
+    int bitpix
+)
+{
+    long maxframe = FRAMEINGEST_CHUNKMAXBYTES / (framesize * cropkernel_typesize(cropkernel_bitpixtype(bitpix)));
+    if (maxframe > FRAMEINGEST_CHUNKMAXFRAME) {
+        maxframe = FRAMEINGEST_CHUNKMAXFRAME;
+    }
+    return (maxframe < 1) ? 1 : maxframe;
+}
+
+
+
+
+// open file and move to image HDU (last HDU)
+// cfitsio scaling is disabled: pixels are read raw, BSCALE and BZERO
+// are returned to be applied to retained pixels only
+static int open_image(
+    const char *fname,
+    fitsfile **fptr,
+    double *bscale,
+    double *bzero
+)
+{
+    int status = 0;
+    int total_hdus = 0;
+
+    if (fits_open_file(fptr, fname, READONLY, &status)) {
+        fits_report_error(stderr, status);
+        return status;
+    }
+    if (fits_get_num_hdus(*fptr, &total_hdus, &status)
+            || fits_movabs_hdu(*fptr, total_hdus, NULL, &status)) {
+        fits_report_error(stderr, status);
+        int cstatus = 0;
+        fits_close_file(*fptr, &cstatus);
+        return status;
+    }
+
+    *bscale = 1.0;
+    *bzero = 0.0;
+    if (fits_read_key(*fptr, TDOUBLE, "BSCALE", bscale, NULL, &status) == KEY_NO_EXIST) {
+        status = 0;
+    }
+    if (fits_read_key(*fptr, TDOUBLE, "BZERO", bzero, NULL, &status) == KEY_NO_EXIST) {
+        status = 0;
+    }
+    if (status == 0) {
+        fits_set_bscale(*fptr, 1.0, 0.0, &status);
+    }
+    if (status != 0) {
+        fits_report_error(stderr, status);
+        int cstatus = 0;
+        fits_close_file(*fptr, &cstatus);
+        return status;
+    }
+    return 0;
+}
+
+
+
+
+// Reads frames k0 to k1-1 of open file into chunk
+// In selective and ROI modes, all frames in range are matched
+static int chunk_read(
+    const READERFILE *rf,
+    const CROPGEOM *crop,
+    int mode,
+    long k0,
+    long k1,
+    INGESTCHUNK *chunk
+)
+{
+    int status = 0;
+    fitsfile *fptr = rf->fptr;
+    const FITSfileinfo *finfo = chunk->finfo;
+    long n = k1 - k0;
+    long planesize = finfo->naxes[0] * finfo->naxes[1];
+    int datatype = bitpix_datatype(finfo->bitpix);
+    int typesize = cropkernel_typesize(chunk->srctype);
+    long inc[3] = {1, 1, 1};
+
+    chunk->nbframe = n;
+    for(long k=k0; k<k1; k++)
+    {
+        chunk->destidx[k-k0] = finfo->destframeidx[k];
+    }
+
+    if (mode == FRAMEINGEST_ROI && rf->bbox) {
+        // one subset: each intersecting tile is decompressed once
+        chunk->layout = CHUNK_BBOX;
+        long bx0, by0, bw, bh;
+        crop_bbox(crop, &bx0, &by0, &bw, &bh);
+        long fpixel[3] = {bx0+1, by0+1, k0+1};
+        long lpixel[3] = {bx0+bw, by0+bh, k1};
+        if (fits_read_subset(fptr, datatype, fpixel, lpixel, inc, NULL, chunk->data, NULL, &status)) {
+            fits_report_error(stderr, status);
+            return status;
+        }
+        return 0;
+    }
+
+    if (mode == FRAMEINGEST_ROI) {
+        chunk->layout = CHUNK_ROI;
+        long cropsize = crop->xsize * crop->ysize;
+        for(int c=0; c<crop->cropnb; c++)
+        {
+            long x0 = crop->xcenter[c] - crop->xsize/2;
+            long y0 = crop->ycenter[c] - crop->ysize/2;
+            long fpixel[3] = {x0+1, y0+1, k0+1};
+            long lpixel[3] = {x0+crop->xsize, y0+crop->ysize, k1};
+            if (fits_read_subset(fptr, datatype, fpixel, lpixel, inc, NULL,
+                                 chunk->data + typesize*cropsize*n*c, NULL, &status)) {
+                fits_report_error(stderr, status);
+                return status;
+            }
+        }
+        return 0;
+    }
+
+    // consecutive planes are contiguous on disk: one read for the range
+    chunk->layout = CHUNK_PLANE;
+    long fpixel[3] = {1, 1, k0+1};
+    if (fits_read_pix(fptr, datatype, fpixel, planesize*n, NULL, chunk->data, NULL, &status)) {
+        fits_report_error(stderr, status);
+        return status;
+    }
+    return 0;
+}
+
+
+// Scatters chunk frames into destination cube
+static void chunk_scatter(
+    const INGESTCHUNK *chunk,
+    const CROPGEOM *crop,
+    float *dest
+)
+{
+    long destxsize = crop->xsize * crop->cropnb;
+    long destframesize = destxsize * crop->ysize;
+    int typesize = cropkernel_typesize(chunk->srctype);
+
+    if (chunk->layout == CHUNK_ROI) {
+        long cropsize = crop->xsize * crop->ysize;
+        for(int c=0; c<crop->cropnb; c++)
+        {
+            for(long f=0; f<chunk->nbframe; f++)
+            {
+                if (chunk->destidx[f] < 0) {
+                    continue;
+                }
+                cropkernel(chunk->srctype, chunk->data + typesize*cropsize*(chunk->nbframe*c + f),
+                           crop->xsize, 0, 0,
+                           dest + destframesize*chunk->destidx[f] + c*crop->xsize, destxsize,
+                           crop->xsize, crop->ysize, chunk->bscale, chunk->bzero);
+            }
+        }
+        return;
+    }
+
+    if (chunk->layout == CHUNK_BBOX) {
+        long bx0, by0, bw, bh;
+        crop_bbox(crop, &bx0, &by0, &bw, &bh);
+        for(long f=0; f<chunk->nbframe; f++)
+        {
+            if (chunk->destidx[f] < 0) {
+                continue;
+            }
+            const char *frame = chunk->data + typesize*bw*bh*f;
+            for(int c=0; c<crop->cropnb; c++)
+            {
+                cropkernel(chunk->srctype, frame, bw,
+                           crop->xcenter[c] - crop->xsize/2 - bx0, crop->ycenter[c] - crop->ysize/2 - by0,
+                           dest + destframesize*chunk->destidx[f] + c*crop->xsize, destxsize,
+                           crop->xsize, crop->ysize, chunk->bscale, chunk->bzero);
+            }
+        }
+        return;
+    }
+
+    long naxis1 = chunk->finfo->naxes[0];
+    long planesize = naxis1 * chunk->finfo->naxes[1];
+    for(long f=0; f<chunk->nbframe; f++)
+    {
+        if (chunk->destidx[f] >= 0) {
+            cropkernel_frame(chunk->srctype, chunk->data + typesize*planesize*f, naxis1, crop,
+                             dest + destframesize*chunk->destidx[f], chunk->bscale, chunk->bzero);
+        }
+    }
+}
+
+
+
+
+// take buffer from pool, NULL if pipeline failed
+static INGESTCHUNK *pipe_getfree(
+    INGESTPIPE *pipe
+)
+{
+    pthread_mutex_lock(&pipe->lock);
+    while (pipe->nbfree == 0 && pipe->status == 0) {
+        pthread_cond_wait(&pipe->freecond, &pipe->lock);
+    }
+    INGESTCHUNK *chunk = NULL;
+    if (pipe->status == 0) {
+        chunk = pipe->freelist[--pipe->nbfree];
+    }
+    pthread_mutex_unlock(&pipe->lock);
+    return chunk;
+}
+
+static void pipe_putfree(
+    INGESTPIPE *pipe,
+    INGESTCHUNK *chunk
+)
+{
+    pthread_mutex_lock(&pipe->lock);
+    pipe->freelist[pipe->nbfree++] = chunk;
+    pthread_cond_signal(&pipe->freecond);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+static void pipe_putready(
+    INGESTPIPE *pipe,
+    INGESTCHUNK *chunk
+)
+{
+    pthread_mutex_lock(&pipe->lock);
+    pipe->ready[(pipe->readyhead + pipe->nbready) % pipe->queuedepth] = chunk;
+    pipe->nbready++;
+    pthread_cond_signal(&pipe->readycond);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+// NULL when all readers are done and queue is empty
+static INGESTCHUNK *pipe_getready(
+    INGESTPIPE *pipe
+)
+{
+    pthread_mutex_lock(&pipe->lock);
+    while (pipe->nbready == 0 && pipe->nbreaderactive > 0) {
+        pthread_cond_wait(&pipe->readycond, &pipe->lock);
+    }
+    INGESTCHUNK *chunk = NULL;
+    if (pipe->nbready > 0) {
+        chunk = pipe->ready[pipe->readyhead];
+        pipe->readyhead = (pipe->readyhead + 1) % pipe->queuedepth;
+        pipe->nbready--;
+    }
+    pthread_mutex_unlock(&pipe->lock);
+    return chunk;
+}
+
+static void pipe_fail(
+    INGESTPIPE *pipe,
+    int status
+)
+{
+    pthread_mutex_lock(&pipe->lock);
+    if (pipe->status == 0) {
+        pipe->status = status;
+    }
+    pthread_cond_broadcast(&pipe->freecond);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+
+
+
+// Reads matched frames of one file from memory map, straight into
+// destination cube: no pool buffer, no worker
+// Returns -1 if file cannot be mapped
+static int read_file_mmap(
+    INGESTPIPE *pipe,
+    const FITSfileinfo *finfo,
+    int cam
+)
+{
+    FITSMMAP fmap;
+    if (FITSmmap_open(&fmap, finfo) != 0) {
+        return -1;
+    }
+
+    const CROPGEOM *crop = &pipe->crop[cam];
+    float *dest = pipe->dest[cam];
+    long nbframe = finfo->naxes[2];
+    long destxsize = crop->xsize * crop->cropnb;
+    long destframesize = destxsize * crop->ysize;
+    int typesize = cropkernel_typesize(fmap.srctype);
+
+    long nbplaneread = 0;
+    long k0 = 0;
+    while (k0 < nbframe) {
+        if (finfo->destframeidx[k0] < 0) {
+            k0++;
+            continue;
+        }
+        long k1 = k0 + 1;
+        while (k1 < nbframe && k1 - k0 < FRAMEINGEST_CHUNKMAXFRAME && finfo->destframeidx[k1] >= 0) {
+            k1++;
+        }
+        FITSmmap_willneed(&fmap, k0, k1);
+
+        for(long k=k0; k<k1; k++)
+        {
+            const unsigned char *plane = fmap.data + (size_t) typesize * fmap.planesize * k;
+            float *destframe = dest + destframesize * finfo->destframeidx[k];
+            for(int c=0; c<crop->cropnb; c++)
+            {
+                cropkernel_bigendian(fmap.srctype, plane, finfo->naxes[0],
+                                     crop->xcenter[c] - crop->xsize/2, crop->ycenter[c] - crop->ysize/2,
+                                     destframe + c*crop->xsize, destxsize,
+                                     crop->xsize, crop->ysize,
+                                     (float) finfo->bscale, (float) finfo->bzero);
+            }
+            if (pipe->framehook != NULL) {
+                pipe->framehook(pipe->framehookarg, cam, finfo->destframeidx[k], destframe);
+            }
+        }
+        nbplaneread += k1 - k0;
+        k0 = k1;
+    }
+
+    FITSmmap_close(&fmap);
+
+    __atomic_fetch_add(&pipe->nbfileread, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pipe->nbplaneread, nbplaneread, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pipe->nbfilemmap, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+
+static void reader_closefile(
+    READERFILE *rf
+)
+{
+    if (rf->finfo != NULL) {
+        int status = 0;
+        fits_close_file(rf->fptr, &status);
+    }
+    rf->finfo = NULL;
+}
+
+
+// Makes finfo the reader's open file
+static int reader_openfile(
+    READERFILE *rf,
+    const FITSfileinfo *finfo,
+    const CROPGEOM *crop
+)
+{
+    if (rf->finfo == finfo) {
+        return 0;
+    }
+    reader_closefile(rf);
+
+    int status = open_image(finfo->fname, &rf->fptr, &rf->bscale, &rf->bzero);
+    if (status != 0) {
+        return status;
+    }
+    rf->finfo = finfo;
+    rf->bbox = 0;
+
+    if (finfo->compressed) {
+        // Read crop bounding box if it intersects fewer tiles than
+        // crops do separately: tiles shared by several crops, e.g.
+        // row tiles, are then decompressed once instead of per crop
+        long tiledim[3] = {1, 1, 1};
+        if (fits_get_tile_dim(rf->fptr, 3, tiledim, &status) == 0
+                && tiledim[0] > 0 && tiledim[1] > 0) {
+            long bx0, by0, bw, bh;
+            crop_bbox(crop, &bx0, &by0, &bw, &bh);
+            long nbtilecrop = 0;
+            for(int c=0; c<crop->cropnb; c++)
+            {
+                nbtilecrop += window_nbtile(crop->xcenter[c] - crop->xsize/2, crop->ycenter[c] - crop->ysize/2,
+                                            crop->xsize, crop->ysize, tiledim);
+            }
+            rf->bbox = (window_nbtile(bx0, by0, bw, bh, tiledim) < nbtilecrop);
+        }
+        status = 0;
+    }
+    return 0;
+}
+
+
+// Reads frames kstart to kend-1 of reader's open file, chunk by chunk
+static int read_range(
+    INGESTPIPE *pipe,
+    const READERFILE *rf,
+    int cam,
+    int mode,
+    long kstart,
+    long kend,
+    long *nbplaneread
+)
+{
+    const FITSfileinfo *finfo = rf->finfo;
+    const CROPGEOM *crop = &pipe->crop[cam];
+    long maxframe = chunk_maxframe(chunk_framesize(finfo, crop, mode), finfo->bitpix);
+
+    int status = 0;
+    long k0 = kstart;
+    while (k0 < kend && status == 0) {
+        if (mode != FRAMEINGEST_FULLCUBE && finfo->destframeidx[k0] < 0) {
+            k0++;
+            continue;
+        }
+        // range of frames read together
+        // fullcube: all frames; otherwise: run of consecutive matched frames
+        long k1 = k0 + 1;
+        while (k1 < kend && k1 - k0 < maxframe
+                && (mode == FRAMEINGEST_FULLCUBE || finfo->destframeidx[k1] >= 0)) {
+            k1++;
+        }
+
+        INGESTCHUNK *chunk = pipe_getfree(pipe);
+        if (chunk == NULL) {
+            break; // pipeline failed elsewhere
+        }
+        chunk->finfo = finfo;
+        chunk->cam = cam;
+        chunk->srctype = cropkernel_bitpixtype(finfo->bitpix);
+        chunk->bscale = (float) rf->bscale;
+        chunk->bzero = (float) rf->bzero;
+        status = chunk_read(rf, crop, mode, k0, k1, chunk);
+        if (status != 0) {
+            pipe_putfree(pipe, chunk);
+            break;
+        }
+        pipe_putready(pipe, chunk);
+        *nbplaneread += k1 - k0;
+        k0 = k1;
+    }
+    return status;
+}
+
+
+// Runs one reader job
+static int read_job(
+    INGESTPIPE *pipe,
+    READERFILE *rf,
+    const INGESTJOB *job
+)
+{
+    const FITSfileinfo *finfo = &pipe->finfo[job->file];
+    int cam = file_camera(finfo, pipe->mode);
+    int mode = pipe->mode;
+    long nbframe = finfo->naxes[2];
+
+    if (mode == FRAMEINGEST_MMAP) {
+        if (!finfo->compressed && read_file_mmap(pipe, finfo, cam) == 0) {
+            return 0;
+        }
+        // compressed or not mappable: read crop windows with cfitsio
+        mode = FRAMEINGEST_ROI;
+    }
+
+    int status = reader_openfile(rf, finfo, &pipe->crop[cam]);
+    if (status != 0) {
+        return status;
+    }
+
+    long nbplaneread = 0;
+    if (job->k0 < 0) {
+        status = read_range(pipe, rf, cam, mode, 0, nbframe, &nbplaneread);
+        reader_closefile(rf);
+    }
+    else {
+        // file stays open for next job, likely on same file
+        status = read_range(pipe, rf, cam, mode, job->k0, job->k1, &nbplaneread);
+    }
+
+    if (nbplaneread > 0) {
+        __atomic_fetch_add(&pipe->nbplaneread, nbplaneread, __ATOMIC_RELAXED);
+        if (job->k0 < 0 || job->first) {
+            __atomic_fetch_add(&pipe->nbfileread, 1, __ATOMIC_RELAXED);
+            if (rf->bbox && mode == FRAMEINGEST_ROI) {
+                __atomic_fetch_add(&pipe->nbfilebbox, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    return status;
+}
+
+
+static void *reader_thread(
+    void *ptr
+)
+{
+    INGESTPIPE *pipe = (INGESTPIPE *) ptr;
+    READERFILE rf;
+    memset(&rf, 0, sizeof(rf));
+
+    long job_idx;
+    while ((job_idx = __atomic_fetch_add(&pipe->nextjob, 1, __ATOMIC_RELAXED)) < pipe->nbjob) {
+        if (__atomic_load_n(&pipe->status, __ATOMIC_RELAXED) != 0) {
+            break;
+        }
+        int status = read_job(pipe, &rf, &pipe->job[job_idx]);
+        if (status != 0) {
+            fprintf(stderr, "Error reading pixels from %s\n", pipe->finfo[pipe->job[job_idx].file].fname);
+            pipe_fail(pipe, status);
+            break;
+        }
+    }
+    reader_closefile(&rf);
+
+    pthread_mutex_lock(&pipe->lock);
+    pipe->nbreaderactive--;
+    pthread_cond_broadcast(&pipe->readycond);
+    pthread_mutex_unlock(&pipe->lock);
+    return NULL;
+}
+
+
+// Lists reader jobs
+// Files without matched frame are skipped, except in fullcube mode
+// Returns NULL on allocation failure
+static INGESTJOB *build_jobs(
+    const FITSfileinfo *finfo,
+    long nbfile,
+    const CROPGEOM crop[2],
+    int mode,
+    long *nbjob
+)
+{
+    // first pass counts jobs, second pass fills them
+    INGESTJOB *job = NULL;
+    for(int pass=0; pass<2; pass++)
+    {
+        long n = 0;
+        for(long file_idx=0; file_idx<nbfile; file_idx++)
+        {
+            const FITSfileinfo *fi = &finfo[file_idx];
+            int cam = file_camera(fi, mode);
+            if (cam < 0) {
+                continue;
+            }
+            long nbframe = fi->naxes[2];
+
+            if (mode == FRAMEINGEST_FULLCUBE || !fi->compressed) {
+                long nbmatched = 0;
+                for(long k=0; k<nbframe; k++)
+                {
+                    nbmatched += (fi->destframeidx[k] >= 0);
+                }
+                if (mode == FRAMEINGEST_FULLCUBE || nbmatched > 0) {
+                    if (pass == 1) {
+                        job[n].file = file_idx;
+                        job[n].k0 = -1;
+                        job[n].k1 = -1;
+                        job[n].first = 1;
+                    }
+                    n++;
+                }
+                continue;
+            }
+
+            // compressed: one job per chunk of matched frames
+            int readmode = (mode == FRAMEINGEST_MMAP) ? FRAMEINGEST_ROI : mode;
+            long maxframe = chunk_maxframe(chunk_framesize(fi, &crop[cam], readmode), fi->bitpix);
+            int first = 1;
+            long k0 = 0;
+            while (k0 < nbframe) {
+                if (fi->destframeidx[k0] < 0) {
+                    k0++;
+                    continue;
+                }
+                long k1 = k0 + 1;
+                while (k1 < nbframe && k1 - k0 < maxframe && fi->destframeidx[k1] >= 0) {
+                    k1++;
+                }
+                if (pass == 1) {
+                    job[n].file = file_idx;
+                    job[n].k0 = k0;
+                    job[n].k1 = k1;
+                    job[n].first = first;
+                }
+                first = 0;
+                n++;
+                k0 = k1;
+            }
+        }
+
+        if (pass == 0) {
+            job = (INGESTJOB *) malloc(sizeof(INGESTJOB) * (n > 0 ? n : 1));
+            if (job == NULL) {
+                return NULL;
+            }
+        }
+        *nbjob = n;
+    }
+    return job;
+}
+
+
+static void *worker_thread(
+    void *ptr
+)
+{
+    INGESTPIPE *pipe = (INGESTPIPE *) ptr;
+
+    INGESTCHUNK *chunk;
+    while ((chunk = pipe_getready(pipe)) != NULL) {
+        const CROPGEOM *crop = &pipe->crop[chunk->cam];
+        float *dest = pipe->dest[chunk->cam];
+        chunk_scatter(chunk, crop, dest);
+        if (pipe->framehook != NULL) {
+            long destframesize = crop->xsize * crop->cropnb * crop->ysize;
+            for(long f=0; f<chunk->nbframe; f++)
+            {
+                if (chunk->destidx[f] >= 0) {
+                    pipe->framehook(pipe->framehookarg, chunk->cam, chunk->destidx[f],
+                                    dest + destframesize*chunk->destidx[f]);
+                }
+            }
+        }
+        pipe_putfree(pipe, chunk);
+    }
+    return NULL;
+}
+
+
+
+
+// pool buffer size needed for chunks of file [bytes]
+static long chunk_bytes(
+    const FITSfileinfo *finfo,
+    const CROPGEOM *crop,
+    int mode
+)
+{
+    int srctype = cropkernel_bitpixtype(finfo->bitpix);
+    long framesize = chunk_framesize(finfo, crop, mode);
+    long maxframe = chunk_maxframe(framesize, finfo->bitpix);
+    if (maxframe > finfo->naxes[2]) {
+        maxframe = finfo->naxes[2];
+    }
+    return framesize * cropkernel_typesize(srctype) * maxframe;
+}
+
+
+
+
+double frameingest_memsize(
+    const FITSfileinfo *finfo,
+    long nbfile,
+    const CROPGEOM crop[2],
+    const FRAMEINGESTCONF *conf
+)
+{
+    int mode = conf->mode;
+    int nbreadthread = (conf->nbreadthread > 0) ? conf->nbreadthread : 1;
+    int queuedepth = (conf->queuedepth > 0) ? conf->queuedepth : 1;
+    if (!fits_is_reentrant()) {
+        nbreadthread = 1;
+    }
+
+    long buffsize = 1;
+    long planebytes = 0;
+    for(long file_idx=0; file_idx<nbfile; file_idx++)
+    {
+        int cam = file_camera(&finfo[file_idx], mode);
+        int srctype = cropkernel_bitpixtype(finfo[file_idx].bitpix);
+        if (cam < 0 || srctype < 0) {
+            continue;
+        }
+        long chunkbytes = chunk_bytes(&finfo[file_idx], &crop[cam], mode);
+        if (chunkbytes > buffsize) {
+            buffsize = chunkbytes;
+        }
+        long bytes = finfo[file_idx].naxes[0] * finfo[file_idx].naxes[1] * cropkernel_typesize(srctype);
+        if (bytes > planebytes) {
+            planebytes = bytes;
+        }
+    }
+    return (double) queuedepth * buffsize + (double) nbreadthread * planebytes;
+}
+
+
+
+
+int frameingest_run(
+    const FITSfileinfo *finfo,
+    long nbfile,
+    const CROPGEOM crop[2],
+    float *dest[2],
+    const FRAMEINGESTCONF *conf
+)
+{
+    int mode = conf->mode;
+    int nbreadthread = (conf->nbreadthread > 0) ? conf->nbreadthread : 1;
+    int nbworkthread = (conf->nbworkthread > 0) ? conf->nbworkthread : 1;
+    int queuedepth = (conf->queuedepth > 0) ? conf->queuedepth : 1;
+    if (!fits_is_reentrant()) {
+        nbreadthread = 1;
+    }
+
+    // check crop windows and pixel types before reading any pixel
+    // and size pool buffers for largest chunk
+    long nbplanetotal = 0;
+    long buffsize = 1; // bytes
+    for(long file_idx=0; file_idx<nbfile; file_idx++)
+    {
+        nbplanetotal += finfo[file_idx].naxes[2];
+
+        int cam = file_camera(&finfo[file_idx], mode);
+        if (cam < 0) {
+            continue;
+        }
+        if (finfo[file_idx].selected != 0
+                && CROPGEOM_check(&crop[cam], finfo[file_idx].naxes[0], finfo[file_idx].naxes[1]) != 0) {
+            fprintf(stderr, "Invalid cam%d crop geometry for %s\n", cam+1, finfo[file_idx].fname);
+            return -1;
+        }
+        int srctype = cropkernel_bitpixtype(finfo[file_idx].bitpix);
+        if (srctype < 0) {
+            fprintf(stderr, "Invalid BITPIX %d for %s\n", finfo[file_idx].bitpix, finfo[file_idx].fname);
+            return -1;
+        }
+        long chunkbytes = chunk_bytes(&finfo[file_idx], &crop[cam], mode);
+        if (chunkbytes > buffsize) {
+            buffsize = chunkbytes;
+        }
+    }
+
+
+    INGESTPIPE pipe;
+    memset(&pipe, 0, sizeof(pipe));
+    pipe.finfo = finfo;
+    pipe.nbfile = nbfile;
+    pipe.crop = crop;
+    pipe.dest = dest;
+    pipe.mode = mode;
+    pipe.framehook = conf->framehook;
+    pipe.framehookarg = conf->framehookarg;
+    pipe.queuedepth = queuedepth;
+    pipe.nbreaderactive = nbreadthread;
+    pipe.job = build_jobs(finfo, nbfile, crop, mode, &pipe.nbjob);
+
+    // buffer pool, allocated once for the whole ingest
+    pipe.chunk = (INGESTCHUNK *) calloc(queuedepth, sizeof(INGESTCHUNK));
+    pipe.freelist = (INGESTCHUNK **) malloc(sizeof(INGESTCHUNK *) * queuedepth);
+    pipe.ready = (INGESTCHUNK **) malloc(sizeof(INGESTCHUNK *) * queuedepth);
+    pthread_t *threads = (pthread_t *) malloc(sizeof(pthread_t) * (nbreadthread + nbworkthread));
+    int allocOK = (pipe.job != NULL && pipe.chunk != NULL && pipe.freelist != NULL && pipe.ready != NULL && threads != NULL);
+    for(int i=0; i<queuedepth && allocOK; i++)
+    {
+        pipe.chunk[i].data = (char *) malloc(buffsize);
+        pipe.chunk[i].destidx = (int *) malloc(sizeof(int) * FRAMEINGEST_CHUNKMAXFRAME);
+        if (pipe.chunk[i].data == NULL || pipe.chunk[i].destidx == NULL) {
+            allocOK = 0;
+        }
+        pipe.freelist[pipe.nbfree++] = &pipe.chunk[i];
+    }
+
+    int status = 0;
+    if (!allocOK) {
+        fprintf(stderr, "Memory allocation error\n");
+        status = -1;
+    }
+    else {
+        printf("Ingest: %d reader(s), %d worker(s), %d x %.1f MB buffers\n",
+               nbreadthread, nbworkthread, queuedepth, 1.0e-6 * buffsize);
+
+        pthread_mutex_init(&pipe.lock, NULL);
+        pthread_cond_init(&pipe.freecond, NULL);
+        pthread_cond_init(&pipe.readycond, NULL);
+
+        // on thread creation failure, pipeline is aborted:
+        // started readers stop at their next buffer request
+        int nbstarted = 0;
+        for(int t=0; t<nbreadthread + nbworkthread; t++)
+        {
+            void *(*func)(void *) = (t < nbreadthread) ? reader_thread : worker_thread;
+            if (pthread_create(&threads[nbstarted], NULL, func, &pipe) != 0) {
+                perror("Error creating ingest thread");
+                pipe_fail(&pipe, -1);
+                if (t < nbreadthread) {
+                    pthread_mutex_lock(&pipe.lock);
+                    pipe.nbreaderactive--;
+                    pthread_cond_broadcast(&pipe.readycond);
+                    pthread_mutex_unlock(&pipe.lock);
+                }
+                continue;
+            }
+            nbstarted++;
+        }
+        for(int t=0; t<nbstarted; t++)
+        {
+            pthread_join(threads[t], NULL);
+        }
+
+        pthread_mutex_destroy(&pipe.lock);
+        pthread_cond_destroy(&pipe.freecond);
+        pthread_cond_destroy(&pipe.readycond);
+        status = pipe.status;
+    }
+
+    for(int i=0; i<queuedepth && pipe.chunk != NULL; i++)
+    {
+        free(pipe.chunk[i].data);
+        free(pipe.chunk[i].destidx);
+    }
+    free(pipe.job);
+    free(pipe.chunk);
+    free(pipe.freelist);
+    free(pipe.ready);
+    free(threads);
+
+    if (status == 0) {
+        printf("Ingest: %ld / %ld files read, %ld / %ld frame planes read\n",
+               pipe.nbfileread, nbfile, pipe.nbplaneread, nbplanetotal);
+        if (mode == FRAMEINGEST_MMAP) {
+            printf("Ingest: %ld files memory-mapped, %ld read with cfitsio\n",
+                   pipe.nbfilemmap, pipe.nbfileread - pipe.nbfilemmap);
+        }
+        if (pipe.nbfilebbox > 0) {
+            printf("Ingest: %ld compressed files read by crop bounding box\n", pipe.nbfilebbox);
+        }
+    }
+    return status;
+}
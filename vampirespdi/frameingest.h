@@ -0,0 +1,108 @@
+#ifndef _VAMPIRES_PDI__FRAMEINGEST_H
+#define _VAMPIRES_PDI__FRAMEINGEST_H
+
+#include "scanFITSfiles.h"
+#include "cropkernel.h"
+
+
+// Ingest modes
+#define FRAMEINGEST_FULLCUBE  0 // read whole cube, then crop matched frames
+#define FRAMEINGEST_SELECTIVE 1 // read matched frame planes only, skip unselected files
+#define FRAMEINGEST_ROI       2 // read crop windows of matched frames only, skip unselected files
+#define FRAMEINGEST_MMAP      3 // as ROI, from memory-mapped file for uncompressed files
+
+// Files are read in chunks of frames, each chunk filling one pool buffer
+// Chunk size is limited both in frames and in bytes
+#define FRAMEINGEST_CHUNKMAXFRAME 64
+#define FRAMEINGEST_CHUNKMAXBYTES (16L * 1024 * 1024)
+
+
+// Called once per destination frame, after all its crops are written
+// May be called concurrently from several ingest threads.
+typedef void (*FRAMEINGESTHOOK)(
+    void *arg,
+    int cam,
+    long destidx,
+    const float *destframe
+);
+
+
+// Ingest configuration
+//
+// Ingest is a bounded producer/consumer pipeline: reader threads read
+// chunks of frames from FITS files into buffers taken from a fixed pool,
+// worker threads scatter chunk frames into destination cubes and return
+// buffers to the pool.
+// In mmap mode, reader threads copy crop rows of uncompressed files
+// from the mapped data unit straight to destination cubes.
+// Tile-compressed files are split into runs of matched frames read by
+// all readers concurrently, each with its own cfitsio handle, so that
+// tiles are decompressed in parallel. Only tiles intersecting the crop
+// windows are decompressed.
+typedef struct {
+    int mode;         // FRAMEINGEST_FULLCUBE, _SELECTIVE, _ROI or _MMAP
+    int nbreadthread; // threads reading FITS files
+    int nbworkthread; // threads scattering frames to destination cubes
+    int queuedepth;   // number of chunk buffers in pool
+    FRAMEINGESTHOOK framehook; // optional, called on each written frame
+    void *framehookarg;
+} FRAMEINGESTCONF;
+
+
+/**
+ * @brief Converts ingest mode name to mode.
+ * @param modestr "fullcube", "selective", "roi" or "mmap".
+ * @return Ingest mode, -1 if unknown.
+ */
+int frameingest_parsemode(
+    const char *modestr
+);
+
+/**
+ * @brief Checks that all crop windows lie within a naxis1 x naxis2 frame.
+ * @return 0 if all crops are within frame, -1 otherwise.
+ */
+int CROPGEOM_check(
+    const CROPGEOM *crop,
+    long naxis1,
+    long naxis2
+);
+
+/**
+ * @brief Memory used by ingest, besides destination cubes [bytes].
+ *
+ * Chunk buffer pool, queuedepth buffers sized for the largest chunk of
+ * files to be read, plus one frame per reader thread for cfitsio tile
+ * decompression.
+ */
+double frameingest_memsize(
+    const FITSfileinfo *finfo,
+    long nbfile,
+    const CROPGEOM crop[2],
+    const FRAMEINGESTCONF *conf
+);
+
+/**
+ * @brief Reads crops of matched frames of all files into camera cubes.
+ *
+ * Files with finfo[].selected == c + 1 are written to dest[c]: frame k
+ * of the file goes to destination frame finfo[].destframeidx[k], frames
+ * with negative destination index are ignored.
+ * Crop windows are checked against frame size of all files to be read
+ * before any pixel is read.
+ *
+ * @param crop Crop geometry, one per camera.
+ * @param dest Destination cube, one per camera, (xsize * cropnb) x ysize x nbframe floats.
+ * @param conf Ingest mode and pipeline configuration.
+ * @return 0 on success, cfitsio status or -1 on failure.
+ */
+int frameingest_run(
+    const FITSfileinfo *finfo,
+    long nbfile,
+    const CROPGEOM crop[2],
+    float *dest[2],
+    const FRAMEINGESTCONF *conf
+);
+
+
+#endif
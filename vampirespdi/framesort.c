@@ -0,0 +1,339 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "framesort.h"
+
+
+
+// radix digit size
+#define RADIXBITS 8
+#define RADIXSIZE (1 << RADIXBITS)
+#define RADIXNBPASS (64 / RADIXBITS)
+
+// below this size, radix sort runs on a single thread
+#define RADIXMINPERTHREAD 65536
+
+
+
+
+// k-way heap merge of sorted runs
+// runstart has nbrun+1 entries, last one is n
+static int merge_runs(
+    double *t,
+    long *idx,
+    long n,
+    const long *runstart,
+    long nbrun
+)
+{
+    double *tout = (double *) malloc(sizeof(double) * n);
+    long *idxout = (long *) malloc(sizeof(long) * n);
+    long *pos = (long *) malloc(sizeof(long) * nbrun);  // read position in each run
+    long *heap = (long *) malloc(sizeof(long) * nbrun); // run indices, min-heap on (time, run)
+    if (tout == NULL || idxout == NULL || pos == NULL || heap == NULL) {
+        free(tout);
+        free(idxout);
+        free(pos);
+        free(heap);
+        return -1;
+    }
+
+    // ordering: by current time, then by run for stability
+    #define HEAPLESS(a, b) (t[pos[a]] < t[pos[b]] || (t[pos[a]] == t[pos[b]] && (a) < (b)))
+
+    long heapsize = nbrun;
+    for (long r = 0; r < nbrun; r++) {
+        pos[r] = runstart[r];
+        heap[r] = r;
+    }
+    for (long i = heapsize / 2 - 1; i >= 0; i--) {
+        // sift down
+        long p = i;
+        for (;;) {
+            long c = 2 * p + 1;
+            if (c >= heapsize) {
+                break;
+            }
+            if (c + 1 < heapsize && HEAPLESS(heap[c + 1], heap[c])) {
+                c++;
+            }
+            if (!HEAPLESS(heap[c], heap[p])) {
+                break;
+            }
+            long tmp = heap[p];
+            heap[p] = heap[c];
+            heap[c] = tmp;
+            p = c;
+        }
+    }
+
+    for (long i = 0; i < n; i++) {
+        long r = heap[0];
+        tout[i] = t[pos[r]];
+        idxout[i] = idx[pos[r]];
+        pos[r]++;
+        if (pos[r] == runstart[r + 1]) {
+            // run exhausted
+            heap[0] = heap[--heapsize];
+        }
+
+        long p = 0;
+        for (;;) {
+            long c = 2 * p + 1;
+            if (c >= heapsize) {
+                break;
+            }
+            if (c + 1 < heapsize && HEAPLESS(heap[c + 1], heap[c])) {
+                c++;
+            }
+            if (!HEAPLESS(heap[c], heap[p])) {
+                break;
+            }
+            long tmp = heap[p];
+            heap[p] = heap[c];
+            heap[c] = tmp;
+            p = c;
+        }
+    }
+    #undef HEAPLESS
+
+    memcpy(t, tout, sizeof(double) * n);
+    memcpy(idx, idxout, sizeof(long) * n);
+
+    free(tout);
+    free(idxout);
+    free(pos);
+    free(heap);
+    return 0;
+}
+
+
+
+
+// IEEE-754 double to unsigned key with same ordering:
+// flip sign bit of positive values, all bits of negative values
+static inline uint64_t double_to_key(double v)
+{
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    uint64_t mask = -(bits >> 63) | 0x8000000000000000ULL;
+    return bits ^ mask;
+}
+
+static inline double key_to_double(uint64_t key)
+{
+    uint64_t mask = ((key >> 63) - 1) | 0x8000000000000000ULL;
+    uint64_t bits = key ^ mask;
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+
+typedef struct {
+    const uint64_t *keyin;
+    const long     *idxin;
+    uint64_t       *keyout;
+    long           *idxout;
+    long  start;    // chunk of this thread
+    long  end;
+    int   shift;    // digit position
+    long *count;    // RADIXSIZE entries: histogram, then scatter offsets
+} RADIXTHREADARG;
+
+
+static void *radix_histogram(void *arg)
+{
+    RADIXTHREADARG *a = (RADIXTHREADARG *) arg;
+    memset(a->count, 0, sizeof(long) * RADIXSIZE);
+    for (long i = a->start; i < a->end; i++) {
+        a->count[(a->keyin[i] >> a->shift) & (RADIXSIZE - 1)]++;
+    }
+    return NULL;
+}
+
+static void *radix_scatter(void *arg)
+{
+    RADIXTHREADARG *a = (RADIXTHREADARG *) arg;
+    for (long i = a->start; i < a->end; i++) {
+        long d = (a->keyin[i] >> a->shift) & (RADIXSIZE - 1);
+        long o = a->count[d]++;
+        a->keyout[o] = a->keyin[i];
+        a->idxout[o] = a->idxin[i];
+    }
+    return NULL;
+}
+
+
+// run function on all thread args, in threads if more than one
+static void radix_runthreads(
+    void *(*func)(void *),
+    RADIXTHREADARG *targ,
+    int nbthread
+)
+{
+    if (nbthread == 1) {
+        func(&targ[0]);
+        return;
+    }
+    pthread_t *threads = (pthread_t *) malloc(sizeof(pthread_t) * nbthread);
+    int *started = (int *) calloc(nbthread, sizeof(int));
+    for (int th = 0; th < nbthread; th++) {
+        if (threads == NULL || started == NULL
+                || pthread_create(&threads[th], NULL, func, &targ[th]) != 0) {
+            func(&targ[th]);
+        } else {
+            started[th] = 1;
+        }
+    }
+    for (int th = 0; th < nbthread; th++) {
+        if (started != NULL && started[th]) {
+            pthread_join(threads[th], NULL);
+        }
+    }
+    free(threads);
+    free(started);
+}
+
+
+static int radix_sort(
+    double *t,
+    long *idx,
+    long n,
+    int nbthread
+)
+{
+    if (nbthread > n / RADIXMINPERTHREAD) {
+        nbthread = (int)(n / RADIXMINPERTHREAD);
+    }
+    if (nbthread < 1) {
+        nbthread = 1;
+    }
+
+    uint64_t *key = (uint64_t *) malloc(sizeof(uint64_t) * n);
+    uint64_t *key2 = (uint64_t *) malloc(sizeof(uint64_t) * n);
+    long *idx2 = (long *) malloc(sizeof(long) * n);
+    long *count = (long *) malloc(sizeof(long) * RADIXSIZE * nbthread);
+    RADIXTHREADARG *targ = (RADIXTHREADARG *) malloc(sizeof(RADIXTHREADARG) * nbthread);
+    if (key == NULL || key2 == NULL || idx2 == NULL || count == NULL || targ == NULL) {
+        free(key);
+        free(key2);
+        free(idx2);
+        free(count);
+        free(targ);
+        return -1;
+    }
+
+    // bits common to all keys need no pass
+    uint64_t keyor = 0;
+    uint64_t keyand = ~0ULL;
+    for (long i = 0; i < n; i++) {
+        key[i] = double_to_key(t[i]);
+        keyor |= key[i];
+        keyand &= key[i];
+    }
+    uint64_t varbits = keyor ^ keyand;
+
+    uint64_t *kin = key;
+    uint64_t *kout = key2;
+    long *iin = idx;
+    long *iout = idx2;
+
+    for (int pass = 0; pass < RADIXNBPASS; pass++) {
+        int shift = pass * RADIXBITS;
+        if (((varbits >> shift) & (RADIXSIZE - 1)) == 0) {
+            continue;
+        }
+
+        for (int th = 0; th < nbthread; th++) {
+            targ[th].keyin = kin;
+            targ[th].idxin = iin;
+            targ[th].keyout = kout;
+            targ[th].idxout = iout;
+            targ[th].start = n * th / nbthread;
+            targ[th].end = n * (th + 1) / nbthread;
+            targ[th].shift = shift;
+            targ[th].count = &count[RADIXSIZE * th];
+        }
+        radix_runthreads(radix_histogram, targ, nbthread);
+
+        // scatter offsets: digit-major, then thread order for stability
+        long offset = 0;
+        for (int d = 0; d < RADIXSIZE; d++) {
+            for (int th = 0; th < nbthread; th++) {
+                long c = count[RADIXSIZE * th + d];
+                count[RADIXSIZE * th + d] = offset;
+                offset += c;
+            }
+        }
+        radix_runthreads(radix_scatter, targ, nbthread);
+
+        uint64_t *ktmp = kin;
+        kin = kout;
+        kout = ktmp;
+        long *itmp = iin;
+        iin = iout;
+        iout = itmp;
+    }
+
+    for (long i = 0; i < n; i++) {
+        t[i] = key_to_double(kin[i]);
+    }
+    if (iin != idx) {
+        memcpy(idx, iin, sizeof(long) * n);
+    }
+
+    free(key);
+    free(key2);
+    free(idx2);
+    free(count);
+    free(targ);
+    return 0;
+}
+
+
+
+
+int framesort(
+    double *t,
+    long *idx,
+    long n,
+    int nbthread
+)
+{
+    if (n < 2) {
+        return 0;
+    }
+
+    // count sorted runs
+    long nbrun = 1;
+    for (long i = 1; i < n; i++) {
+        nbrun += (t[i] < t[i - 1]);
+    }
+    if (nbrun == 1) {
+        return 0;
+    }
+
+    if (nbrun <= n / FRAMESORT_MINRUNLEN) {
+        long *runstart = (long *) malloc(sizeof(long) * (nbrun + 1));
+        if (runstart == NULL) {
+            return -1;
+        }
+        long r = 0;
+        runstart[r++] = 0;
+        for (long i = 1; i < n; i++) {
+            if (t[i] < t[i - 1]) {
+                runstart[r++] = i;
+            }
+        }
+        runstart[r] = n;
+
+        int retval = merge_runs(t, idx, n, runstart, nbrun);
+        free(runstart);
+        return retval;
+    }
+
+    return radix_sort(t, idx, n, nbthread);
+}
@@ -0,0 +1,37 @@
+#ifndef _VAMPIRES_PDI__FRAMESORT_H
+#define _VAMPIRES_PDI__FRAMESORT_H
+
+
+// Minimum average run length for run merge
+// Below this, input is considered unordered and radix sorted
+#define FRAMESORT_MINRUNLEN 16
+
+
+/**
+ * @brief Sorts frame times ascending, permuting frame indices alongside.
+ *
+ * Drop-in replacement for quick_sort2l(t, idx, n).
+ *
+ * Frame times are collected file by file, and frames within a file are
+ * already time-ordered, so the input is a concatenation of sorted runs.
+ * Runs are detected in one pass:
+ * - single run: nothing to do
+ * - few long runs: k-way heap merge, O(n log k)
+ * - otherwise: parallel LSD radix sort on the IEEE-754 bit pattern
+ * Both sorts are stable.
+ *
+ * @param t Frame times, sorted in place.
+ * @param idx Frame indices, permuted as t.
+ * @param n Number of frames.
+ * @param nbthread Number of threads for radix sort.
+ * @return 0 on success, -1 on allocation failure (input unchanged).
+ */
+int framesort(
+    double *t,
+    long *idx,
+    long n,
+    int nbthread
+);
+
+
+#endif
@@ -0,0 +1,520 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blockgemm.h"
+#include "grampca.h"
+
+
+// Maximum QL iterations per eigenvalue
+#define GRAMPCA_MAXITER 60
+
+// Inverse iterations per eigenvector
+#define GRAMPCA_INVITER 3
+
+
+
+
+// Implicit QL iterations on symmetric tridiagonal matrix, eigenvalues
+// only. d: diagonal, replaced by eigenvalues, e: e[i] couples i and
+// i+1, destroyed.
+static int grampca_tridiag_ql(
+    double *d,
+    double *e,
+    long n
+)
+{
+    e[n - 1] = 0.0;
+    double f = 0.0;
+    double tst1 = 0.0;
+    double eps = pow(2.0, -52.0);
+    for (long l = 0; l < n; l++) {
+        if (fabs(d[l]) + fabs(e[l]) > tst1) {
+            tst1 = fabs(d[l]) + fabs(e[l]);
+        }
+        long m = l;
+        while (m < n - 1 && fabs(e[m]) > eps * tst1) {
+            m++;
+        }
+        if (m > l) {
+            int iter = 0;
+            do {
+                if (++iter > GRAMPCA_MAXITER) {
+                    return -1;
+                }
+                double g = d[l];
+                double p = (d[l + 1] - g) / (2.0 * e[l]);
+                double r = hypot(p, 1.0);
+                if (p < 0.0) {
+                    r = -r;
+                }
+                d[l] = e[l] / (p + r);
+                d[l + 1] = e[l] * (p + r);
+                double dl1 = d[l + 1];
+                double h = g - d[l];
+                for (long i = l + 2; i < n; i++) {
+                    d[i] -= h;
+                }
+                f += h;
+
+                p = d[m];
+                double c = 1.0;
+                double c2 = c;
+                double c3 = c;
+                double el1 = e[l + 1];
+                double s = 0.0;
+                double s2 = 0.0;
+                for (long i = m - 1; i >= l; i--) {
+                    c3 = c2;
+                    c2 = c;
+                    s2 = s;
+                    g = c * e[i];
+                    h = c * p;
+                    r = hypot(p, e[i]);
+                    e[i + 1] = s * r;
+                    s = e[i] / r;
+                    c = p / r;
+                    p = c * d[i] - s * g;
+                    d[i + 1] = h + s * (c * g + s * d[i]);
+                }
+                p = -s * s2 * c3 * el1 * e[l] / dl1;
+                e[l] = s * p;
+                d[l] = c * p;
+            } while (fabs(e[l]) > eps * tst1);
+        }
+        d[l] += f;
+        e[l] = 0.0;
+    }
+    return 0;
+}
+
+
+// Eigenvector of tridiagonal matrix (diag, off) for eigenvalue lambda,
+// by inverse iteration. T - lambda I is factorized once with partial
+// pivoting; iterates are orthogonalized against the nbprev vectors
+// already found, which separates close eigenvalues.
+static int grampca_tridiag_invit(
+    const double *diag,
+    const double *off,
+    long n,
+    double lambda,
+    double tnorm,
+    const double *prev,
+    long nbprev,
+    double *x
+)
+{
+    double *u0 = (double *) malloc(sizeof(double) * n);
+    double *u1 = (double *) malloc(sizeof(double) * n);
+    double *u2 = (double *) malloc(sizeof(double) * n);
+    double *mult = (double *) malloc(sizeof(double) * n);
+    char *swap = (char *) malloc(n);
+    if (u0 == NULL || u1 == NULL || u2 == NULL || mult == NULL || swap == NULL) {
+        free(u0);
+        free(u1);
+        free(u2);
+        free(mult);
+        free(swap);
+        return -1;
+    }
+
+    // LU with partial pivoting: U has two superdiagonals
+    double pivmin = tnorm * pow(2.0, -52.0);
+    double cd = diag[0] - lambda;
+    double cs = (n > 1) ? off[0] : 0.0;
+    for (long i = 0; i < n - 1; i++) {
+        double sub = off[i];
+        double nd = diag[i + 1] - lambda;
+        double ns = (i + 1 < n - 1) ? off[i + 1] : 0.0;
+        if (fabs(sub) > fabs(cd)) {
+            swap[i] = 1;
+            u0[i] = sub;
+            u1[i] = nd;
+            u2[i] = ns;
+            mult[i] = cd / sub;
+            cd = cs - mult[i] * nd;
+            cs = -mult[i] * ns;
+        } else {
+            swap[i] = 0;
+            if (fabs(cd) < pivmin) {
+                cd = (cd < 0.0) ? -pivmin : pivmin;
+            }
+            u0[i] = cd;
+            u1[i] = cs;
+            u2[i] = 0.0;
+            mult[i] = sub / cd;
+            cd = nd - mult[i] * cs;
+            cs = ns;
+        }
+    }
+    if (fabs(cd) < pivmin) {
+        cd = (cd < 0.0) ? -pivmin : pivmin;
+    }
+    u0[n - 1] = cd;
+
+    // deterministic start vector
+    uint64_t state = 0x2545F4914F6CDD1DULL + (uint64_t) nbprev;
+    for (long i = 0; i < n; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        x[i] = (double)(state >> 11) / 9007199254740992.0 - 0.5;
+    }
+
+    for (int it = 0; it < GRAMPCA_INVITER; it++) {
+        for (long i = 0; i < n - 1; i++) {
+            if (swap[i]) {
+                double tmp = x[i];
+                x[i] = x[i + 1];
+                x[i + 1] = tmp;
+            }
+            x[i + 1] -= mult[i] * x[i];
+        }
+        x[n - 1] /= u0[n - 1];
+        if (n > 1) {
+            x[n - 2] = (x[n - 2] - u1[n - 2] * x[n - 1]) / u0[n - 2];
+        }
+        for (long i = n - 3; i >= 0; i--) {
+            x[i] = (x[i] - u1[i] * x[i + 1] - u2[i] * x[i + 2]) / u0[i];
+        }
+
+        // twice is enough for orthogonality
+        for (int pass = 0; pass < 2; pass++) {
+            for (long j = 0; j < nbprev; j++) {
+                double dot = 0.0;
+                for (long i = 0; i < n; i++) {
+                    dot += prev[j * n + i] * x[i];
+                }
+                for (long i = 0; i < n; i++) {
+                    x[i] -= dot * prev[j * n + i];
+                }
+            }
+        }
+        double norm = 0.0;
+        for (long i = 0; i < n; i++) {
+            norm += x[i] * x[i];
+        }
+        norm = sqrt(norm);
+        if (!(norm > 0.0)) {
+            break;
+        }
+        for (long i = 0; i < n; i++) {
+            x[i] /= norm;
+        }
+    }
+
+    free(u0);
+    free(u1);
+    free(u2);
+    free(mult);
+    free(swap);
+    return 0;
+}
+
+
+
+
+// Matrix a is held transposed: element (r, c) of the reduction is
+// a[c * n + r], so that inner loops are contiguous.
+int grampca_symeig(
+    double *a,
+    long n,
+    long nbvec,
+    double *eigval,
+    double *eigvec
+)
+{
+    if (n < 1) {
+        return 0;
+    }
+    double *d = eigval;
+    double *e = (double *) malloc(sizeof(double) * n);
+    double *diag = (double *) malloc(sizeof(double) * n);
+    double *off = (double *) malloc(sizeof(double) * n);
+    if (e == NULL || diag == NULL || off == NULL) {
+        free(e);
+        free(diag);
+        free(off);
+        return -1;
+    }
+
+    // Householder reduction to tridiagonal form
+    // Reflector i is stored in a[i * n + 0 .. i-1], with its scale in d[i].
+    for (long j = 0; j < n; j++) {
+        d[j] = a[j * n + n - 1];
+    }
+    for (long i = n - 1; i > 0; i--) {
+        double scale = 0.0;
+        double h = 0.0;
+        for (long k = 0; k < i; k++) {
+            scale += fabs(d[k]);
+        }
+        if (scale == 0.0) {
+            e[i] = d[i - 1];
+            for (long j = 0; j < i; j++) {
+                d[j] = a[j * n + i - 1];
+                a[j * n + i] = 0.0;
+                a[i * n + j] = 0.0;
+            }
+        } else {
+            for (long k = 0; k < i; k++) {
+                d[k] /= scale;
+                h += d[k] * d[k];
+            }
+            double f = d[i - 1];
+            double g = (f > 0.0) ? -sqrt(h) : sqrt(h);
+            e[i] = scale * g;
+            h -= f * g;
+            d[i - 1] = f - g;
+            for (long j = 0; j < i; j++) {
+                e[j] = 0.0;
+            }
+            for (long j = 0; j < i; j++) {
+                f = d[j];
+                a[i * n + j] = f;
+                g = e[j] + a[j * n + j] * f;
+                for (long k = j + 1; k < i; k++) {
+                    g += a[j * n + k] * d[k];
+                    e[k] += a[j * n + k] * f;
+                }
+                e[j] = g;
+            }
+            f = 0.0;
+            for (long j = 0; j < i; j++) {
+                e[j] /= h;
+                f += e[j] * d[j];
+            }
+            double hh = f / (h + h);
+            for (long j = 0; j < i; j++) {
+                e[j] -= hh * d[j];
+            }
+            for (long j = 0; j < i; j++) {
+                f = d[j];
+                g = e[j];
+                for (long k = j; k < i; k++) {
+                    a[j * n + k] -= (f * e[k] + g * d[k]);
+                }
+                d[j] = a[j * n + i - 1];
+                a[j * n + i] = 0.0;
+            }
+        }
+        d[i] = h;
+    }
+
+    // tridiagonal matrix: diagonal left in a, off-diagonal in e
+    double tnorm = 0.0;
+    for (long i = 0; i < n; i++) {
+        diag[i] = a[i * n + i];
+        off[i] = (i < n - 1) ? e[i + 1] : 0.0;
+        double rownorm = fabs(diag[i]) + fabs(off[i]) + ((i > 0) ? fabs(off[i - 1]) : 0.0);
+        if (rownorm > tnorm) {
+            tnorm = rownorm;
+        }
+    }
+    double *h = e;
+    memcpy(h, d, sizeof(double) * n);
+
+    // eigenvalues, decreasing
+    memcpy(d, diag, sizeof(double) * n);
+    double *ework = (double *) malloc(sizeof(double) * n);
+    int status = -1;
+    if (ework != NULL) {
+        memcpy(ework, off, sizeof(double) * n);
+        status = grampca_tridiag_ql(d, ework, n);
+        free(ework);
+    }
+    if (status == 0) {
+        for (long k = 0; k < n; k++) {
+            long kmax = k;
+            for (long k1 = k + 1; k1 < n; k1++) {
+                if (d[k1] > d[kmax]) {
+                    kmax = k1;
+                }
+            }
+            double tmp = d[k];
+            d[k] = d[kmax];
+            d[kmax] = tmp;
+        }
+    }
+
+    // eigenvectors of tridiagonal matrix, close eigenvalues shifted apart
+    double sep = 10.0 * pow(2.0, -52.0) * tnorm;
+    double lambda = 0.0;
+    for (long k = 0; k < nbvec && status == 0; k++) {
+        lambda = (k > 0 && d[k] > lambda - sep) ? lambda - sep : d[k];
+        status = grampca_tridiag_invit(diag, off, n, lambda, tnorm, eigvec, k, eigvec + k * n);
+    }
+
+    // back-transformation: eigvec <- P_{n-1} ... P_1 eigvec
+    for (long r = 1; r < n && status == 0; r++) {
+        if (h[r] == 0.0) {
+            continue;
+        }
+        const double *u = a + r * n;
+        for (long k = 0; k < nbvec; k++) {
+            double *x = eigvec + k * n;
+            double g = 0.0;
+            for (long i = 0; i < r; i++) {
+                g += u[i] * x[i];
+            }
+            g /= h[r];
+            for (long i = 0; i < r; i++) {
+                x[i] -= g * u[i];
+            }
+        }
+    }
+
+    free(e);
+    free(diag);
+    free(off);
+    return status;
+}
+
+
+
+
+int grampca_compute(
+    const float *cube,
+    long nbframe,
+    long framesize,
+    const RSVDCONF *conf,
+    GRAMPCARESULT *res
+)
+{
+    memset(res, 0, sizeof(GRAMPCARESULT));
+    if (nbframe < 1 || framesize < 1 || conf->nbmode < 1) {
+        return -1;
+    }
+    int nbthread = (conf->nbthread > 0) ? conf->nbthread : 1;
+    long N = nbframe;
+    long nbvec = (conf->nbmode < N) ? conf->nbmode : N;
+
+    res->nbframe = nbframe;
+    res->framesize = framesize;
+    res->W = (double *) malloc(sizeof(double) * nbvec * N);
+    res->S = (double *) malloc(sizeof(double) * N);
+    double *G = (double *) calloc(N * N, sizeof(double));
+    if (res->W == NULL || res->S == NULL || G == NULL) {
+        free(G);
+        GRAMPCARESULT_free(res);
+        return -1;
+    }
+
+    // Gram matrix, streamed over pixel slabs
+    for (long p0 = 0; p0 < framesize; p0 += GRAMPCA_SLAB) {
+        long p1 = (p0 + GRAMPCA_SLAB < framesize) ? p0 + GRAMPCA_SLAB : framesize;
+        if (blockgemm_syrk(cube, N, framesize, p0, p1, G, nbthread) != 0) {
+            free(G);
+            GRAMPCARESULT_free(res);
+            return -1;
+        }
+    }
+    double total = 0.0;
+    for (long i = 0; i < N; i++) {
+        total += G[i * N + i];
+    }
+
+    int status = grampca_symeig(G, N, nbvec, res->S, res->W);
+    free(G);
+    if (status != 0) {
+        fprintf(stderr, "Gram matrix eigen-decomposition failed\n");
+        GRAMPCARESULT_free(res);
+        return -1;
+    }
+    for (long k = 0; k < N; k++) {
+        res->S[k] = (res->S[k] > 0.0) ? sqrt(res->S[k]) : 0.0;
+    }
+
+    // modes kept
+    long nbmode = nbvec;
+    for (long k = 0; k < nbmode; k++) {
+        if (!(res->S[k] > 0.0) || res->S[k] < conf->SVlimit * res->S[0]) {
+            nbmode = k;
+            break;
+        }
+    }
+    if (conf->energy > 0.0) {
+        double sum = 0.0;
+        long k;
+        for (k = 0; k < nbmode; k++) {
+            sum += res->S[k] * res->S[k];
+            if (sum >= conf->energy * total) {
+                k++;
+                break;
+            }
+        }
+        if (sum < conf->energy * total) {
+            printf("WARNING: %ld modes hold %.6f of squared norm, below energy %.6f\n",
+                   nbmode, (total > 0.0) ? sum / total : 0.0, conf->energy);
+        }
+        nbmode = k;
+    }
+    res->nbmode = nbmode;
+
+    printf("Gram matrix PCA: %ld x %ld, %ld modes\n", nbframe, framesize, nbmode);
+    return 0;
+}
+
+
+
+
+int grampca_getmodes(
+    const GRAMPCARESULT *res,
+    const float *cube,
+    float *U,
+    float *S,
+    float *V,
+    int nbthread
+)
+{
+    long N = res->nbframe;
+    long nbmode = res->nbmode;
+    if (nbmode < 1) {
+        return 0;
+    }
+    if (S != NULL) {
+        for (long k = 0; k < nbmode; k++) {
+            S[k] = (float) res->S[k];
+        }
+    }
+
+    // temporal coefficients: eigenvectors of Gram matrix
+    if (V != NULL) {
+        for (long e = 0; e < nbmode * N; e++) {
+            V[e] = (float) res->W[e];
+        }
+    }
+
+    // spatial modes: U_k = W_k A / S_k
+    if (U != NULL) {
+        float *M = (float *) malloc(sizeof(float) * nbmode * N);
+        if (M == NULL) {
+            return -1;
+        }
+        for (long k = 0; k < nbmode; k++) {
+            for (long i = 0; i < N; i++) {
+                M[k * N + i] = (float)(res->W[k * N + i] / res->S[k]);
+            }
+        }
+        const float *src[1] = {cube};
+        float *dst[1] = {U};
+        int status = blockgemm_dense(M, nbmode, N, src, dst, 1, res->framesize, nbthread);
+        free(M);
+        if (status != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+void GRAMPCARESULT_free(
+    GRAMPCARESULT *res
+)
+{
+    free(res->W);
+    free(res->S);
+    memset(res, 0, sizeof(GRAMPCARESULT));
+}
@@ -0,0 +1,93 @@
+#ifndef _VAMPIRES_PDI__GRAMPCA_H
+#define _VAMPIRES_PDI__GRAMPCA_H
+
+#include "rsvd.h"
+
+
+// PCA by method of snapshots, for cubes with fewer frames than pixels
+//
+// The temporal Gram matrix G = A A^T (nbframe x nbframe) is accumulated
+// over pixel slabs with a blocked SYRK, then eigen-decomposed:
+// G = W^T S^2 W. Spatial modes follow from one blocked product,
+// U_k = W_k A / S_k. Output layout is the same as rsvd.
+// Cost is O(nbframe^2 framesize) for the Gram matrix, O(nbframe^3) for
+// its tridiagonal reduction, and O(nbmode nbframe^2) for the
+// eigenvectors of the modes kept.
+
+
+// Pixel slab of Gram matrix accumulation [floats]
+#define GRAMPCA_SLAB 65536
+
+
+typedef struct {
+    long    nbframe;
+    long    framesize;
+    long    nbmode;    // modes kept
+    double *W;         // nbmode x nbframe, row k is eigenvector k
+    double *S;         // nbframe singular values, decreasing
+} GRAMPCARESULT;
+
+
+
+/**
+ * @brief Eigenvalues and leading eigenvectors of symmetric matrix.
+ *
+ * Householder reduction to tridiagonal form, eigenvalues by implicit QL
+ * iterations, eigenvectors by inverse iteration on the tridiagonal
+ * matrix, transformed back with the Householder reflectors. Only the
+ * nbvec leading eigenvectors are computed.
+ *
+ * @param a n x n symmetric matrix, destroyed.
+ * @param nbvec Number of eigenvectors.
+ * @param eigval n eigenvalues, decreasing.
+ * @param eigvec nbvec x n, row k is eigenvector k.
+ * @return 0 on success, -1 on failure.
+ */
+int grampca_symeig(
+    double *a,
+    long n,
+    long nbvec,
+    double *eigval,
+    double *eigvec
+);
+
+/**
+ * @brief Computes PCA of cube from its Gram matrix.
+ *
+ * Uses nbmode, energy, SVlimit and nbthread of conf.
+ *
+ * @param cube nbframe x framesize floats.
+ * @return 0 on success, -1 on failure.
+ */
+int grampca_compute(
+    const float *cube,
+    long nbframe,
+    long framesize,
+    const RSVDCONF *conf,
+    GRAMPCARESULT *res
+);
+
+/**
+ * @brief Writes modes of decomposition.
+ *
+ * @param cube Cube decomposed by grampca_compute.
+ * @param U res->nbmode x framesize spatial modes, may be NULL.
+ * @param S res->nbmode singular values, may be NULL.
+ * @param V res->nbmode x nbframe temporal coefficients, may be NULL.
+ * @return 0 on success, -1 on failure.
+ */
+int grampca_getmodes(
+    const GRAMPCARESULT *res,
+    const float *cube,
+    float *U,
+    float *S,
+    float *V,
+    int nbthread
+);
+
+void GRAMPCARESULT_free(
+    GRAMPCARESULT *res
+);
+
+
+#endif
@@ -0,0 +1,445 @@
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blockgemm.h"
+#include "ipca.h"
+#include "rsvd.h"
+
+
+#define IPCA_MAGIC   "VPDIIPCA"
+#define IPCA_VERSION 1
+
+
+
+
+int IPCASTATE_load(
+    IPCASTATE *st,
+    const char *fname
+)
+{
+    memset(st, 0, sizeof(IPCASTATE));
+
+    FILE *fp = fopen(fname, "rb");
+    if (fp == NULL) {
+        if (errno == ENOENT) {
+            return 1;
+        }
+        perror(fname);
+        return -1;
+    }
+
+    char magic[8];
+    int32_t version;
+    int64_t hdr[3];
+    double lasttstamp;
+    if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, IPCA_MAGIC, 8) != 0
+            || fread(&version, sizeof(version), 1, fp) != 1 || version != IPCA_VERSION
+            || fread(hdr, sizeof(int64_t), 3, fp) != 3
+            || fread(&lasttstamp, sizeof(double), 1, fp) != 1
+            || hdr[0] < 1 || hdr[1] < 0 || hdr[2] < 0) {
+        fprintf(stderr, "%s: not an incremental PCA state file\n", fname);
+        fclose(fp);
+        return -1;
+    }
+    st->framesize = hdr[0];
+    st->nbmode = hdr[1];
+    st->nbframe = hdr[2];
+    st->lasttstamp = lasttstamp;
+
+    long k = st->nbmode;
+    st->U = (float *) malloc(sizeof(float) * (k * st->framesize + 1));
+    st->S = (double *) malloc(sizeof(double) * (k + 1));
+    st->V = (float *) malloc(sizeof(float) * (k * st->nbframe + 1));
+    if (st->U == NULL || st->S == NULL || st->V == NULL
+            || fread(st->U, sizeof(float), k * st->framesize, fp) != (size_t)(k * st->framesize)
+            || fread(st->S, sizeof(double), k, fp) != (size_t) k
+            || fread(st->V, sizeof(float), k * st->nbframe, fp) != (size_t)(k * st->nbframe)) {
+        fprintf(stderr, "%s: truncated incremental PCA state file\n", fname);
+        fclose(fp);
+        IPCASTATE_free(st);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+
+
+
+int IPCASTATE_save(
+    const IPCASTATE *st,
+    const char *fname
+)
+{
+    size_t len = strlen(fname);
+    char *tmpname = (char *) malloc(len + 5);
+    if (tmpname == NULL) {
+        return -1;
+    }
+    snprintf(tmpname, len + 5, "%s.tmp", fname);
+
+    FILE *fp = fopen(tmpname, "wb");
+    if (fp == NULL) {
+        perror(tmpname);
+        free(tmpname);
+        return -1;
+    }
+    long k = st->nbmode;
+    int32_t version = IPCA_VERSION;
+    int64_t hdr[3] = {st->framesize, st->nbmode, st->nbframe};
+    int ok = (fwrite(IPCA_MAGIC, 1, 8, fp) == 8)
+             && (fwrite(&version, sizeof(version), 1, fp) == 1)
+             && (fwrite(hdr, sizeof(int64_t), 3, fp) == 3)
+             && (fwrite(&st->lasttstamp, sizeof(double), 1, fp) == 1)
+             && (fwrite(st->U, sizeof(float), k * st->framesize, fp) == (size_t)(k * st->framesize))
+             && (fwrite(st->S, sizeof(double), k, fp) == (size_t) k)
+             && (fwrite(st->V, sizeof(float), k * st->nbframe, fp) == (size_t)(k * st->nbframe));
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmpname, fname) != 0) {
+        perror(fname);
+        remove(tmpname);
+        free(tmpname);
+        return -1;
+    }
+    free(tmpname);
+    return 0;
+}
+
+
+
+
+// Removes from H (m x n) its projection on orthonormal U (k x n),
+// accumulating coefficients in L (k x m): L[j*m + i] += <H_i, U_j>
+static int ipca_deflate(
+    float *H,
+    long m,
+    const float *U,
+    long k,
+    long n,
+    double *L,
+    int nbthread
+)
+{
+    double *Yd = (double *) malloc(sizeof(double) * m * k);
+    float *Yf = (float *) malloc(sizeof(float) * m * k);
+    float *Z = (float *) malloc(sizeof(float) * m * n);
+    int status = -1;
+    if (Yd != NULL && Yf != NULL && Z != NULL
+            && blockgemm_crossdot(H, m, U, k, n, Yd, nbthread) == 0) {
+        for (long i = 0; i < m; i++) {
+            for (long j = 0; j < k; j++) {
+                L[j * m + i] += Yd[i * k + j];
+                Yf[i * k + j] = (float) Yd[i * k + j];
+            }
+        }
+        const float *src[1] = {U};
+        float *dst[1] = {Z};
+        if (blockgemm_dense(Yf, m, k, src, dst, 1, n, nbthread) == 0) {
+            for (long e = 0; e < m * n; e++) {
+                H[e] -= Z[e];
+            }
+            status = 0;
+        }
+    }
+    free(Yd);
+    free(Yf);
+    free(Z);
+    return status;
+}
+
+
+
+
+// Folds one batch of m new frames into state
+// Residual basis and core matrix grow with m: batches are kept to about
+// k frames, so that their cost stays O(m framesize k).
+static int ipca_update_batch(
+    IPCASTATE *st,
+    const float *frames,
+    long m,
+    long maxmode,
+    double forget,
+    double SVlimit,
+    int nbthread,
+    long *nbresidual
+)
+{
+    long n = st->framesize;
+    long k = st->nbmode;
+    long N = st->nbframe;
+
+    // stacked basis: k current modes, then up to m residual directions
+    float *Wst = (float *) malloc(sizeof(float) * (k + m) * n);
+    float *H = (float *) malloc(sizeof(float) * m * n);
+    double *L = (double *) calloc(k * m + 1, sizeof(double));
+    double *R = (double *) malloc(sizeof(double) * m * m);
+    if (Wst == NULL || H == NULL || L == NULL || R == NULL) {
+        free(Wst);
+        free(H);
+        free(L);
+        free(R);
+        return -1;
+    }
+
+    // residual of new frames, projected out twice for orthogonality
+    memcpy(H, frames, sizeof(float) * m * n);
+    int status = 0;
+    if (k > 0) {
+        memcpy(Wst, st->U, sizeof(float) * k * n);
+        status |= ipca_deflate(H, m, st->U, k, n, L, nbthread);
+        status |= ipca_deflate(H, m, st->U, k, n, L, nbthread);
+    }
+
+    // orthonormal residual basis J, coefficients R = J H^T (r x m)
+    float *J = Wst + k * n;
+    long r = -1;
+    if (status == 0) {
+        memcpy(J, H, sizeof(float) * m * n);
+        r = rsvd_orth(J, m, n, nbthread);
+    }
+    // Gram-based orthonormalization loses accuracy on ill-conditioned
+    // residuals, and roundoff of large modes leaks into small residual
+    // directions: project J out of U once more and re-orthonormalize
+    if (r > 0) {
+        double *Lj = (double *) calloc(k * r + 1, sizeof(double));
+        if (Lj == NULL || (k > 0 && ipca_deflate(J, r, st->U, k, n, Lj, nbthread) != 0)) {
+            r = -1;
+        } else {
+            r = rsvd_orth(J, r, n, nbthread);
+        }
+        free(Lj);
+    }
+    if (r < 0 || (r > 0 && blockgemm_crossdot(J, r, H, m, n, R, nbthread) != 0)) {
+        free(Wst);
+        free(H);
+        free(L);
+        free(R);
+        return -1;
+    }
+    free(H);
+
+    // core matrix K ((k+r) x (k+m)) = [ f S  L ; 0  R ], SVD from K K^T
+    long nr = k + r;
+    long nc = k + m;
+    double *K = (double *) calloc(nr * nc, sizeof(double));
+    double *G = (double *) malloc(sizeof(double) * nr * nr);
+    double *eigval = (double *) malloc(sizeof(double) * nr);
+    double *eigvec = (double *) malloc(sizeof(double) * nr * nr);
+    if (K == NULL || G == NULL || eigval == NULL || eigvec == NULL) {
+        status = -1;
+    }
+    if (status == 0) {
+        for (long j = 0; j < k; j++) {
+            K[j * nc + j] = forget * st->S[j];
+            for (long i = 0; i < m; i++) {
+                K[j * nc + k + i] = L[j * m + i];
+            }
+        }
+        for (long q = 0; q < r; q++) {
+            for (long i = 0; i < m; i++) {
+                K[(k + q) * nc + k + i] = R[q * m + i];
+            }
+        }
+        for (long a = 0; a < nr; a++) {
+            for (long b = 0; b <= a; b++) {
+                double sum = 0.0;
+                for (long c = 0; c < nc; c++) {
+                    sum += K[a * nc + c] * K[b * nc + c];
+                }
+                G[a * nr + b] = sum;
+                G[b * nr + a] = sum;
+            }
+        }
+        status = rsvd_symeig(G, nr, eigval, eigvec);
+    }
+    free(L);
+    free(R);
+    free(G);
+
+    // modes kept
+    long knew = (maxmode < nr) ? maxmode : nr;
+    if (status == 0) {
+        for (long q = 0; q < nr; q++) {
+            eigval[q] = (eigval[q] > 0.0) ? sqrt(eigval[q]) : 0.0;
+        }
+        for (long q = 0; q < knew; q++) {
+            if (!(eigval[q] > 0.0) || eigval[q] < SVlimit * eigval[0]) {
+                knew = q;
+                break;
+            }
+        }
+    }
+
+    float *Unew = NULL;
+    double *Snew = NULL;
+    float *Vnew = NULL;
+    float *M = NULL;
+    if (status == 0 && knew > 0) {
+        Unew = (float *) malloc(sizeof(float) * knew * n);
+        Snew = (double *) malloc(sizeof(double) * knew);
+        Vnew = (float *) malloc(sizeof(float) * knew * (N + m));
+        M = (float *) malloc(sizeof(float) * knew * nr);
+        if (Unew == NULL || Snew == NULL || Vnew == NULL || M == NULL) {
+            status = -1;
+        }
+    }
+    if (status == 0 && knew > 0) {
+        // spatial modes: rotated stacked basis, U'_q = sum_a E[a][q] W_a
+        for (long q = 0; q < knew; q++) {
+            Snew[q] = eigval[q];
+            for (long a = 0; a < nr; a++) {
+                M[q * nr + a] = (float) eigvec[a * nr + q];
+            }
+        }
+        const float *src[1] = {Wst};
+        float *dst[1] = {Unew};
+        status = blockgemm_dense(M, knew, nr, src, dst, 1, n, nbthread);
+
+        // temporal coefficients: [V 0 ; 0 I]^T K^T E_q / S_q
+        // Earlier frames enter K scaled by f: the weight is divided out of
+        // their coefficients, so that V always reconstructs frames at their
+        // actual flux.
+        for (long q = 0; q < knew && status == 0; q++) {
+            double *Kq = (double *) calloc(nc, sizeof(double));
+            if (Kq == NULL) {
+                status = -1;
+                break;
+            }
+            for (long a = 0; a < nr; a++) {
+                double e = eigvec[a * nr + q] / eigval[q];
+                for (long c = 0; c < nc; c++) {
+                    Kq[c] += K[a * nc + c] * e;
+                }
+            }
+            for (long t = 0; t < N; t++) {
+                double sum = 0.0;
+                for (long j = 0; j < k; j++) {
+                    sum += st->V[j * N + t] * Kq[j];
+                }
+                Vnew[q * (N + m) + t] = (float)(sum / forget);
+            }
+            for (long i = 0; i < m; i++) {
+                Vnew[q * (N + m) + N + i] = (float) Kq[k + i];
+            }
+            free(Kq);
+        }
+    }
+    free(Wst);
+    free(K);
+    free(eigval);
+    free(eigvec);
+    free(M);
+
+    if (status != 0) {
+        free(Unew);
+        free(Snew);
+        free(Vnew);
+        return -1;
+    }
+
+    free(st->U);
+    free(st->S);
+    free(st->V);
+    st->U = Unew;
+    st->S = Snew;
+    st->V = Vnew;
+    st->nbmode = knew;
+    st->nbframe = N + m;
+    *nbresidual += r;
+    return 0;
+}
+
+
+
+
+int ipca_update(
+    IPCASTATE *st,
+    const float *frames,
+    long nbnew,
+    long maxmode,
+    double forget,
+    double SVlimit,
+    int nbthread
+)
+{
+    if (nbnew < 1) {
+        return 0;
+    }
+    if (maxmode < 1 || st->framesize < 1 || !(forget > 0.0)) {
+        return -1;
+    }
+    if (nbthread < 1) {
+        nbthread = 1;
+    }
+
+    // earlier frames are down-weighted once per update, by first batch
+    long N = st->nbframe;
+    long nbresidual = 0;
+    long nbbatch = 0;
+    for (long i0 = 0; i0 < nbnew; i0 += maxmode) {
+        long m = (i0 + maxmode < nbnew) ? maxmode : nbnew - i0;
+        if (ipca_update_batch(st, frames + i0 * st->framesize, m, maxmode,
+                              (i0 == 0) ? forget : 1.0, SVlimit, nbthread, &nbresidual) != 0) {
+            return -1;
+        }
+        nbbatch++;
+    }
+
+    printf("Incremental PCA: %ld + %ld frames in %ld batches, %ld residual directions, %ld modes\n",
+           N, nbnew, nbbatch, nbresidual, st->nbmode);
+    return 0;
+}
+
+
+
+
+int ipca_project(
+    IPCASTATE *st,
+    const float *frames,
+    long frame0,
+    long nbframe,
+    int nbthread
+)
+{
+    long k = st->nbmode;
+    if (k < 1 || nbframe < 1) {
+        return 0;
+    }
+    if (frame0 < 0 || frame0 + nbframe > st->nbframe) {
+        return -1;
+    }
+    double *Yd = (double *) malloc(sizeof(double) * nbframe * k);
+    if (Yd == NULL) {
+        return -1;
+    }
+    if (blockgemm_crossdot(frames, nbframe, st->U, k, st->framesize, Yd, nbthread) != 0) {
+        free(Yd);
+        return -1;
+    }
+    for (long t = 0; t < nbframe; t++) {
+        for (long j = 0; j < k; j++) {
+            st->V[j * st->nbframe + frame0 + t] = (float)(Yd[t * k + j] / st->S[j]);
+        }
+    }
+    free(Yd);
+    return 0;
+}
+
+
+
+
+void IPCASTATE_free(
+    IPCASTATE *st
+)
+{
+    free(st->U);
+    free(st->S);
+    free(st->V);
+    memset(st, 0, sizeof(IPCASTATE));
+}
@@ -0,0 +1,104 @@
+#ifndef _VAMPIRES_PDI__IPCA_H
+#define _VAMPIRES_PDI__IPCA_H
+
+
+// Incremental truncated SVD of a growing frame cube (Brand update)
+//
+// The state holds the rank-k decomposition A ~ V^T S U of the frames
+// folded in so far, with the same layout as rsvd: U spatial modes
+// (framesize each), V temporal coefficients (nbframe each), both
+// mode-major. New frames are projected on U, their residual is
+// orthonormalized, and the small (k+r) x (k+m) core matrix is
+// re-diagonalized. New frames are folded in batches of at most maxmode
+// frames, so that the residual basis and core matrix stay O(k): folding
+// m frames costs O(m framesize k) for projections, orthonormalization
+// and rotation of the basis, plus O(m k^2) for the core matrices, and
+// never touches earlier frames.
+// A forgetting factor f <= 1 scales earlier singular values at each
+// update, so older frames are progressively down-weighted in the modes.
+// Their coefficients in V are kept at actual flux.
+
+
+typedef struct {
+    long    framesize;
+    long    nbmode;     // modes k
+    long    nbframe;    // frames folded in
+    double  lasttstamp; // time stamp of last frame folded in
+    float  *U;          // nbmode x framesize
+    double *S;          // nbmode
+    float  *V;          // nbmode x nbframe
+} IPCASTATE;
+
+
+
+/**
+ * @brief Loads state from file.
+ *
+ * @return 0 on success, 1 if file does not exist (state is empty),
+ * -1 on read error.
+ */
+int IPCASTATE_load(
+    IPCASTATE *st,
+    const char *fname
+);
+
+/**
+ * @brief Saves state to file.
+ *
+ * Written to a temporary file first, then renamed, so that an
+ * interrupted run leaves the previous state in place.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int IPCASTATE_save(
+    const IPCASTATE *st,
+    const char *fname
+);
+
+/**
+ * @brief Folds new frames into decomposition.
+ *
+ * An empty state (nbmode = 0) is initialized from the new frames.
+ * Frames are folded in batches of maxmode frames.
+ *
+ * @param frames nbnew x st->framesize floats.
+ * @param maxmode Maximum number of modes kept.
+ * @param forget Forgetting factor applied to earlier singular values, > 0.
+ * @param SVlimit Drop modes with singular value below SVlimit * first singular value.
+ * @return 0 on success, -1 on failure (state holds the batches folded in
+ * before failure).
+ */
+int ipca_update(
+    IPCASTATE *st,
+    const float *frames,
+    long nbnew,
+    long maxmode,
+    double forget,
+    double SVlimit,
+    int nbthread
+);
+
+/**
+ * @brief Replaces coefficients of frames by their projection on modes.
+ *
+ * V[k][frame0 + t] = <frame t, U_k> / S_k for t < nbframe, coefficients
+ * of frames as they are, e.g. after balancing changed earlier frames.
+ * Costs O(nbframe framesize k).
+ *
+ * @param frames nbframe x st->framesize floats, frames frame0 ... of state.
+ * @return 0 on success, -1 on failure.
+ */
+int ipca_project(
+    IPCASTATE *st,
+    const float *frames,
+    long frame0,
+    long nbframe,
+    int nbthread
+);
+
+void IPCASTATE_free(
+    IPCASTATE *st
+);
+
+
+#endif
@@ -0,0 +1,151 @@
+#include <math.h>
+#include <stdio.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include "memplan.h"
+#include "polbalance.h"
+
+
+// file system magic numbers, see statfs(2)
+#define TMPFS_MAGIC_NUMBER 0x01021994
+#define RAMFS_MAGIC_NUMBER 0x858458f6
+
+
+static const char *stagename[MEMPLAN_NBSTAGE] = {"ingest", "balance", "PCA", "reconstruct"};
+
+// stages whose cubes are file-backed in out-of-core execution, PCA and
+// reconstruction stages only if streamed
+static const int stagefilebacked[MEMPLAN_NBSTAGE] = {1, 1, 0, 0};
+
+
+
+
+double memplan_defaultbudget()
+{
+    long nbpage = sysconf(_SC_PHYS_PAGES);
+    long pagesize = sysconf(_SC_PAGESIZE);
+    if (nbpage <= 0 || pagesize <= 0) {
+        return 0.0;
+    }
+    return 0.8 * nbpage * pagesize;
+}
+
+
+
+
+int memplan_build(
+    MEMPLAN *plan,
+    long nbframe,
+    long framesize,
+    int nbclass,
+    int pbmode,
+    long nbmode,
+    double ingestmem,
+    int pcastream,
+    double budget,
+    int outofcore
+)
+{
+    double N = nbframe;
+    double P = framesize;
+    double K = nbclass;
+    double m = (nbmode < nbframe) ? nbmode : nbframe;
+    double cube = 4.0 * N * P; // one camera
+
+    // ingest: raw cubes, or balanced cubes directly in ingest mode
+    plan->cube[MEMPLAN_INGEST] = 2.0 * cube;
+    plan->work[MEMPLAN_INGEST] = ingestmem;
+
+    // balancing: raw and balanced cubes, except in ingest mode
+    plan->cube[MEMPLAN_BALANCE] = 4.0 * cube;
+    switch (pbmode) {
+    case POLBALANCE_DENSE:
+        plan->work[MEMPLAN_BALANCE] = 12.0 * fmin(N * N, POLBALANCE_BLOCKNNZ); // CSR row block
+        break;
+    case POLBALANCE_GEMM:
+        plan->work[MEMPLAN_BALANCE] = 16.0 * fmin(N * N, POLBALANCE_BLOCKNNZ); // CSR and dense row block
+        break;
+    case POLBALANCE_WINDOW:
+        plan->work[MEMPLAN_BALANCE] = 8.0 * K * P;
+        break;
+    case POLBALANCE_INGEST:
+        plan->cube[MEMPLAN_BALANCE] = 2.0 * cube;
+        plan->work[MEMPLAN_BALANCE] = 2.0 * 8.0 * K * P + 4.0 * K * P;
+        plan->work[MEMPLAN_INGEST] += 2.0 * 8.0 * K * P;
+        break;
+    default:
+        plan->work[MEMPLAN_BALANCE] = 12.0 * K * P;
+        break;
+    }
+
+    // PCA: covariance of smaller dimension (double in gram mode), modes
+    // and coefficients
+    double covdim = (N < P) ? N : P;
+    plan->cube[MEMPLAN_PCA] = 2.0 * cube;
+    plan->work[MEMPLAN_PCA] = 8.0 * covdim * covdim + 4.0 * P * m + 4.0 * N * m;
+
+    // reconstruction: reconstructed cam2 cube; cam1 and cam2 modes,
+    // coefficients and mixing matrices
+    plan->cube[MEMPLAN_RECONST] = 3.0 * cube;
+    plan->work[MEMPLAN_RECONST] = 12.0 * P * m + 16.0 * N * m;
+
+    plan->peak = 0.0;
+    plan->peakooc = 0.0;
+    for (int s = 0; s < MEMPLAN_NBSTAGE; s++) {
+        int filebacked = stagefilebacked[s] || pcastream;
+        double resident = filebacked ? plan->work[s] : plan->cube[s] + plan->work[s];
+        if (plan->cube[s] + plan->work[s] > plan->peak) {
+            plan->peak = plan->cube[s] + plan->work[s];
+        }
+        if (resident > plan->peakooc) {
+            plan->peakooc = resident;
+        }
+    }
+    plan->budget = budget;
+    if (outofcore == 0) {
+        plan->outofcore = 0;
+        return 0;
+    }
+    plan->outofcore = (outofcore > 0) || (plan->peak > budget);
+    if (plan->outofcore && plan->peakooc > budget) {
+        plan->outofcore = 0;
+        return -1;
+    }
+    return 0;
+}
+
+
+
+
+void memplan_print(
+    const MEMPLAN *plan
+)
+{
+    printf("Memory plan [GB]      cubes      work\n");
+    for (int s = 0; s < MEMPLAN_NBSTAGE; s++) {
+        printf("  %-16s %9.2f %9.2f\n", stagename[s], 1.0e-9 * plan->cube[s], 1.0e-9 * plan->work[s]);
+    }
+    printf("  peak %.2f GB in-core, %.2f GB out-of-core, budget %.2f GB: %s execution\n",
+           1.0e-9 * plan->peak, 1.0e-9 * plan->peakooc, 1.0e-9 * plan->budget,
+           plan->outofcore ? "out-of-core" : "in-core");
+    if (plan->peak > plan->budget && plan->peakooc > plan->budget) {
+        printf("WARNING: PCA and reconstruction stages exceed budget, out-of-core execution does not fit\n");
+    } else if (!plan->outofcore && plan->peak > plan->budget) {
+        printf("WARNING: in-core peak exceeds budget\n");
+    }
+}
+
+
+
+
+int memplan_ramdir(
+    const char *dir
+)
+{
+    struct statfs sfs;
+    if (statfs(dir, &sfs) != 0) {
+        return 0;
+    }
+    return (sfs.f_type == TMPFS_MAGIC_NUMBER || sfs.f_type == RAMFS_MAGIC_NUMBER);
+}
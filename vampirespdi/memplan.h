@@ -0,0 +1,80 @@
+#ifndef _VAMPIRES_PDI__MEMPLAN_H
+#define _VAMPIRES_PDI__MEMPLAN_H
+
+
+// Processing stages
+#define MEMPLAN_INGEST    0
+#define MEMPLAN_BALANCE   1
+#define MEMPLAN_PCA       2
+#define MEMPLAN_RECONST   3
+#define MEMPLAN_NBSTAGE   4
+
+
+// Memory footprint of processing, in bytes
+//
+// Cubes are the frame cubes (nbframe x framesize floats, per camera);
+// work is everything else resident during a stage.
+// In out-of-core execution, cubes of the ingest and balancing stages are
+// file-backed and only their work memory needs to fit in RAM. So are
+// those of PCA and reconstruction if they are streamed over pixel tiles;
+// otherwise (milk SVD) they run on whole in-memory cubes in both modes.
+typedef struct {
+    double cube[MEMPLAN_NBSTAGE];
+    double work[MEMPLAN_NBSTAGE];
+    double peak;       // largest cube + work over stages, in-core
+    double peakooc;    // largest resident memory over stages, out-of-core
+    double budget;
+    int    outofcore;  // 1 if cubes are file-backed, see above
+} MEMPLAN;
+
+
+/**
+ * @brief Default memory budget: 80% of physical memory [bytes].
+ */
+double memplan_defaultbudget();
+
+/**
+ * @brief Estimates per-stage footprint and chooses execution mode.
+ *
+ * Out-of-core execution is chosen if in-core peak exceeds budget. It is
+ * not chosen, even if requested, if in-memory PCA and reconstruction
+ * stages do not fit in budget: out-of-core execution would not help them.
+ *
+ * @param nbframe Number of matched frames.
+ * @param framesize Pixels per frame (xsize * ysize * cropnb).
+ * @param nbclass Number of half-wave plate angle classes.
+ * @param pbmode Balancing mode, POLBALANCE_*.
+ * @param nbmode Maximum number of PCA modes.
+ * @param ingestmem Ingest buffers, see frameingest_memsize [bytes].
+ * @param pcastream 1 if PCA and reconstruction stream cubes by pixel tiles.
+ * @param budget Memory budget [bytes].
+ * @param outofcore 1 to force out-of-core, 0 to force in-core, -1 for automatic.
+ * @return 0 if plan fits in budget or in-core is forced, -1 if not.
+ */
+int memplan_build(
+    MEMPLAN *plan,
+    long nbframe,
+    long framesize,
+    int nbclass,
+    int pbmode,
+    long nbmode,
+    double ingestmem,
+    int pcastream,
+    double budget,
+    int outofcore
+);
+
+void memplan_print(
+    const MEMPLAN *plan
+);
+
+/**
+ * @brief Checks whether directory is on RAM-backed file system (tmpfs, ramfs).
+ * @return 1 if RAM-backed, 0 if not or unknown.
+ */
+int memplan_ramdir(
+    const char *dir
+);
+
+
+#endif
@@ -0,0 +1,105 @@
+#include <stdlib.h>
+
+#include "blockgemm.h"
+#include "pcarecon.h"
+
+
+
+
+int pcarecon_modes(
+    const float *cube,
+    long nbframe,
+    long framesize,
+    const float *V,
+    const float *S,
+    long nbmode,
+    float *U,
+    float *US,
+    int nbthread
+)
+{
+    if (nbmode < 1) {
+        return 0;
+    }
+    // sum_t V[k][t] cube_t, then scaled in place
+    float *dst = (US != NULL) ? US : U;
+    const float *src[1] = {cube};
+    float *dstcube[1] = {dst};
+    if (blockgemm_dense(V, nbmode, nbframe, src, dstcube, 1, framesize, nbthread) != 0) {
+        return -1;
+    }
+    for (long k = 0; k < nbmode; k++) {
+        float scale = (S[k] > 0.0f) ? 1.0f / S[k] : 0.0f;
+        for (long p = 0; p < framesize; p++) {
+            U[k * framesize + p] = dst[k * framesize + p] * scale;
+        }
+    }
+    return 0;
+}
+
+
+
+
+int pcarecon_project(
+    const float *cube,
+    long nbframe,
+    long framesize,
+    const float *U,
+    long nbmode,
+    float *coeff,
+    int nbthread
+)
+{
+    if (nbmode < 1 || nbframe < 1) {
+        return 0;
+    }
+    double *Yd = (double *) malloc(sizeof(double) * nbframe * nbmode);
+    if (Yd == NULL) {
+        return -1;
+    }
+    if (blockgemm_crossdot(cube, nbframe, U, nbmode, framesize, Yd, nbthread) != 0) {
+        free(Yd);
+        return -1;
+    }
+    for (long t = 0; t < nbframe; t++) {
+        for (long k = 0; k < nbmode; k++) {
+            coeff[k * nbframe + t] = (float) Yd[t * nbmode + k];
+        }
+    }
+    free(Yd);
+    return 0;
+}
+
+
+
+
+int pcarecon_cube(
+    const float *U,
+    const float *S,
+    const float *coeff,
+    long nbmode,
+    long nbframe,
+    long framesize,
+    float *out,
+    int nbthread
+)
+{
+    if (nbframe < 1) {
+        return 0;
+    }
+    // mixing matrix M (nbframe x nbmode): out_t = sum_k M[t][k] U_k
+    float *M = (float *) malloc(sizeof(float) * nbframe * (nbmode > 0 ? nbmode : 1));
+    if (M == NULL) {
+        return -1;
+    }
+    for (long t = 0; t < nbframe; t++) {
+        for (long k = 0; k < nbmode; k++) {
+            M[t * nbmode + k] = coeff[k * nbframe + t] * ((S != NULL) ? S[k] : 1.0f);
+        }
+    }
+    const float *src[1] = {U};
+    float *dst[1] = {out};
+    int status = blockgemm_dense(M, nbframe, nbmode, src, dst, 1, framesize, nbthread);
+    free(M);
+    return status;
+}
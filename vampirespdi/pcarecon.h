@@ -0,0 +1,75 @@
+#ifndef _VAMPIRES_PDI__PCARECON_H
+#define _VAMPIRES_PDI__PCARECON_H
+
+
+// Mode transfer and reconstruction on frame cubes, streamed by pixel tiles
+//
+// Same results as milk compute_SVDU, SVDmkM and computeSGEMM as used by
+// polcycleproc, but computed with blocked products over pixel tiles, so
+// that input and output cubes may be file-backed (SCRATCHCUBE) and
+// larger than memory. Only modes and coefficients are held in memory.
+// Layouts as rsvd: modes nbmode x framesize, coefficients nbmode x nbframe.
+
+
+
+/**
+ * @brief Spatial modes of cube for given temporal coefficients.
+ *
+ * US_k = sum_t V[k][t] cube_t and U_k = US_k / S_k, so that cube is
+ * approximated by V^T S U when V are its temporal modes.
+ *
+ * @param U nbmode x framesize output, modes with S_k = 0 set to 0.
+ * @param US nbmode x framesize output, may be NULL.
+ * @return 0 on success, -1 on failure.
+ */
+int pcarecon_modes(
+    const float *cube,
+    long nbframe,
+    long framesize,
+    const float *V,
+    const float *S,
+    long nbmode,
+    float *U,
+    float *US,
+    int nbthread
+);
+
+/**
+ * @brief Coefficients of cube frames on modes.
+ *
+ * coeff[k * nbframe + t] = <cube_t, U_k>
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int pcarecon_project(
+    const float *cube,
+    long nbframe,
+    long framesize,
+    const float *U,
+    long nbmode,
+    float *coeff,
+    int nbthread
+);
+
+/**
+ * @brief Reconstructs cube from modes.
+ *
+ * out_t = sum_k coeff[k][t] S_k U_k
+ *
+ * @param S Mode weights, NULL for unit weights.
+ * @param out nbframe x framesize output cube.
+ * @return 0 on success, -1 on failure.
+ */
+int pcarecon_cube(
+    const float *U,
+    const float *S,
+    const float *coeff,
+    long nbmode,
+    long nbframe,
+    long framesize,
+    float *out,
+    int nbthread
+);
+
+
+#endif
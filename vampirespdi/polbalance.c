@@ -0,0 +1,737 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blockgemm.h"
+#include "polbalance.h"
+
+
+
+
+int polbalance_parsemode(
+    const char *modestr
+)
+{
+    if (strcmp(modestr, "dense") == 0) {
+        return POLBALANCE_DENSE;
+    }
+    if (strcmp(modestr, "angleclass") == 0) {
+        return POLBALANCE_ANGLECLASS;
+    }
+    if (strcmp(modestr, "window") == 0) {
+        return POLBALANCE_WINDOW;
+    }
+    if (strcmp(modestr, "gemm") == 0) {
+        return POLBALANCE_GEMM;
+    }
+    if (strcmp(modestr, "ingest") == 0) {
+        return POLBALANCE_INGEST;
+    }
+    return -1;
+}
+
+
+
+
+// angle distance modulo 90 deg
+static double angle_distance(
+    double a,
+    double b
+)
+{
+    double d = fmod(fabs(a - b), 90.0);
+    return (d > 45.0) ? 90.0 - d : d;
+}
+
+
+int POLANGLECLASS_build(
+    POLANGLECLASS *pac,
+    const double *WPangle,
+    long nbframe,
+    double angletol
+)
+{
+    memset(pac, 0, sizeof(POLANGLECLASS));
+
+    // class reference angle: first member
+    double *refangle = (double *) malloc(sizeof(double) * (nbframe > 0 ? nbframe : 1));
+    pac->frameclass = (int *) malloc(sizeof(int) * (nbframe > 0 ? nbframe : 1));
+    pac->nbmember = (long *) calloc(nbframe > 0 ? nbframe : 1, sizeof(long));
+    pac->polX = (double *) calloc(nbframe > 0 ? nbframe : 1, sizeof(double));
+    pac->polY = (double *) calloc(nbframe > 0 ? nbframe : 1, sizeof(double));
+    if (refangle == NULL || pac->frameclass == NULL || pac->nbmember == NULL
+            || pac->polX == NULL || pac->polY == NULL) {
+        free(refangle);
+        POLANGLECLASS_free(pac);
+        return -1;
+    }
+
+    for (long i = 0; i < nbframe; i++) {
+        int c;
+        for (c = 0; c < pac->nbclass; c++) {
+            if (angle_distance(WPangle[i], refangle[c]) <= angletol) {
+                break;
+            }
+        }
+        if (c == pac->nbclass) {
+            refangle[c] = WPangle[i];
+            pac->nbclass++;
+        }
+        pac->frameclass[i] = c;
+        pac->nbmember[c]++;
+        pac->polX[c] += cos(4.0 * WPangle[i] * M_PI / 180.0);
+        pac->polY[c] += sin(4.0 * WPangle[i] * M_PI / 180.0);
+    }
+    free(refangle);
+
+    int K = pac->nbclass;
+    for (int c = 0; c < K; c++) {
+        pac->polX[c] /= pac->nbmember[c];
+        pac->polY[c] /= pac->nbmember[c];
+    }
+
+    // class weights, same as dense coefficients for frames of equal angle
+    pac->dot = (double *) calloc((size_t) K * K + 1, sizeof(double));
+    pac->coeff = (double *) calloc((size_t) K * K + 1, sizeof(double));
+    pac->balanced = (int *) calloc(K + 1, sizeof(int));
+    if (pac->dot == NULL || pac->coeff == NULL || pac->balanced == NULL) {
+        POLANGLECLASS_free(pac);
+        return -1;
+    }
+    for (int b = 0; b < K; b++) {
+        double sum_dot_product = 0.0;
+        for (int a = 0; a < K; a++) {
+            double dot_product = pac->polX[a] * pac->polX[b] + pac->polY[a] * pac->polY[b];
+            if (dot_product > 0.0) {
+                dot_product = 0.0;
+            }
+            pac->dot[(size_t) b * K + a] = dot_product;
+            pac->coeff[(size_t) b * K + a] = dot_product;
+            sum_dot_product += pac->nbmember[a] * dot_product;
+        }
+        if (sum_dot_product < 0.0) {
+            pac->balanced[b] = 1;
+            for (int a = 0; a < K; a++) {
+                pac->coeff[(size_t) b * K + a] /= sum_dot_product;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+void POLANGLECLASS_free(
+    POLANGLECLASS *pac
+)
+{
+    free(pac->frameclass);
+    free(pac->nbmember);
+    free(pac->polX);
+    free(pac->polY);
+    free(pac->dot);
+    free(pac->coeff);
+    free(pac->balanced);
+    memset(pac, 0, sizeof(POLANGLECLASS));
+}
+
+
+
+
+// Angle class algorithm
+// Per cube: one sum image per class, one combination image per class,
+// then each output frame is 0.5 * (input + combination of its class)
+static int polbalance_angleclass(
+    const double *WPangle,
+    long nbframe,
+    float *const *imgin,
+    float *const *imgout,
+    int nbcube,
+    long framesize,
+    double angletol
+)
+{
+    POLANGLECLASS pac;
+    if (POLANGLECLASS_build(&pac, WPangle, nbframe, angletol) != 0) {
+        return -1;
+    }
+    int K = pac.nbclass;
+
+    printf("Polarization balancing: %ld frames in %d angle classes (tolerance %.3f deg)\n",
+           nbframe, K, angletol);
+    long nbunbalanced = 0;
+    for (int c = 0; c < K; c++) {
+        printf("  class %2d  pol = (%+6.3f %+6.3f)  %6ld frames%s\n",
+               c, pac.polX[c], pac.polY[c], pac.nbmember[c],
+               pac.balanced[c] ? "" : "  NOT BALANCED");
+        if (!pac.balanced[c]) {
+            nbunbalanced += pac.nbmember[c];
+        }
+    }
+    if (nbunbalanced > 0) {
+        printf("WARNING: %ld frames without opposite polarization frame, not balanced\n", nbunbalanced);
+    }
+
+    double *classsum = (double *) malloc(sizeof(double) * K * framesize);
+    float *classcomb = (float *) malloc(sizeof(float) * K * framesize);
+    if (classsum == NULL || classcomb == NULL) {
+        free(classsum);
+        free(classcomb);
+        POLANGLECLASS_free(&pac);
+        return -1;
+    }
+
+    for (int cube = 0; cube < nbcube; cube++) {
+        // class sums, O(N P)
+        memset(classsum, 0, sizeof(double) * K * framesize);
+        for (long idx = 0; idx < nbframe; idx++) {
+            double *sum = classsum + (size_t) pac.frameclass[idx] * framesize;
+            const float *in = imgin[cube] + idx * framesize;
+            for (long pixi = 0; pixi < framesize; pixi++) {
+                sum[pixi] += in[pixi];
+            }
+        }
+
+        // class combinations, O(K^2 P)
+        for (int b = 0; b < K; b++) {
+            float *comb = classcomb + (size_t) b * framesize;
+            for (long pixi = 0; pixi < framesize; pixi++) {
+                double v = 0.0;
+                for (int a = 0; a < K; a++) {
+                    v += pac.coeff[(size_t) b * K + a] * classsum[(size_t) a * framesize + pixi];
+                }
+                comb[pixi] = (float) v;
+            }
+        }
+
+        // outputs, O(N P)
+        for (long idx = 0; idx < nbframe; idx++) {
+            int c = pac.frameclass[idx];
+            const float *in = imgin[cube] + idx * framesize;
+            float *out = imgout[cube] + idx * framesize;
+            if (!pac.balanced[c]) {
+                memcpy(out, in, framesize * sizeof(float));
+                continue;
+            }
+            const float *comb = classcomb + (size_t) c * framesize;
+            for (long pixi = 0; pixi < framesize; pixi++) {
+                out[pixi] = 0.5f * (in[pixi] + comb[pixi]);
+            }
+        }
+    }
+
+    free(classsum);
+    free(classcomb);
+    POLANGLECLASS_free(&pac);
+    return 0;
+}
+
+
+
+
+int POLBALANCEACC_init(
+    POLBALANCEACC *acc,
+    const double *WPangle,
+    long nbframe,
+    int nbcube,
+    long framesize,
+    double angletol
+)
+{
+    memset(acc, 0, sizeof(POLBALANCEACC));
+    if (POLANGLECLASS_build(&acc->pac, WPangle, nbframe, angletol) != 0) {
+        return -1;
+    }
+    int K = acc->pac.nbclass;
+    acc->nbcube = nbcube;
+    acc->framesize = framesize;
+    acc->classsum = (double **) calloc(nbcube, sizeof(double *));
+    acc->lock = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t) * nbcube * (K > 0 ? K : 1));
+    acc->nbadded = (long *) calloc(nbcube, sizeof(long));
+    if (acc->classsum == NULL || acc->lock == NULL || acc->nbadded == NULL) {
+        POLBALANCEACC_free(acc);
+        return -1;
+    }
+    for (int l = 0; l < nbcube * K; l++) {
+        pthread_mutex_init(&acc->lock[l], NULL);
+    }
+    for (int cube = 0; cube < nbcube; cube++) {
+        acc->classsum[cube] = (double *) calloc((size_t) K * framesize + 1, sizeof(double));
+        if (acc->classsum[cube] == NULL) {
+            POLBALANCEACC_free(acc);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+void POLBALANCEACC_addframe(
+    void *arg,
+    int cube,
+    long frameidx,
+    const float *frame
+)
+{
+    POLBALANCEACC *acc = (POLBALANCEACC *) arg;
+    int c = acc->pac.frameclass[frameidx];
+    double *sum = acc->classsum[cube] + (size_t) c * acc->framesize;
+
+    pthread_mutex_t *lock = &acc->lock[cube * acc->pac.nbclass + c];
+    pthread_mutex_lock(lock);
+    for (long pixi = 0; pixi < acc->framesize; pixi++) {
+        sum[pixi] += frame[pixi];
+    }
+    pthread_mutex_unlock(lock);
+    __atomic_fetch_add(&acc->nbadded[cube], 1, __ATOMIC_RELAXED);
+}
+
+
+int POLBALANCEACC_apply(
+    POLBALANCEACC *acc,
+    float *const *img
+)
+{
+    POLANGLECLASS *pac = &acc->pac;
+    int K = pac->nbclass;
+    long framesize = acc->framesize;
+    long nbframe = 0;
+    for (int c = 0; c < K; c++) {
+        nbframe += pac->nbmember[c];
+    }
+
+    printf("Polarization balancing in place: %ld frames in %d angle classes\n", nbframe, K);
+    long nbunbalanced = 0;
+    for (int c = 0; c < K; c++) {
+        if (!pac->balanced[c]) {
+            nbunbalanced += pac->nbmember[c];
+        }
+    }
+    if (nbunbalanced > 0) {
+        printf("WARNING: %ld frames without opposite polarization frame, not balanced\n", nbunbalanced);
+    }
+
+    float *classcomb = (float *) malloc(sizeof(float) * ((size_t) K * framesize + 1));
+    if (classcomb == NULL) {
+        return -1;
+    }
+
+    for (int cube = 0; cube < acc->nbcube; cube++) {
+        if (acc->nbadded[cube] != nbframe) {
+            // frames never written are zero in cube and in class sums
+            printf("WARNING: cube %d: %ld / %ld frames accumulated\n", cube, acc->nbadded[cube], nbframe);
+        }
+
+        for (int b = 0; b < K; b++) {
+            float *comb = classcomb + (size_t) b * framesize;
+            for (long pixi = 0; pixi < framesize; pixi++) {
+                double v = 0.0;
+                for (int a = 0; a < K; a++) {
+                    v += pac->coeff[(size_t) b * K + a] * acc->classsum[cube][(size_t) a * framesize + pixi];
+                }
+                comb[pixi] = (float) v;
+            }
+        }
+
+        for (long idx = 0; idx < nbframe; idx++) {
+            int c = pac->frameclass[idx];
+            if (!pac->balanced[c]) {
+                continue;
+            }
+            float *frame = img[cube] + idx * framesize;
+            const float *comb = classcomb + (size_t) c * framesize;
+            for (long pixi = 0; pixi < framesize; pixi++) {
+                frame[pixi] = 0.5f * (frame[pixi] + comb[pixi]);
+            }
+        }
+    }
+
+    free(classcomb);
+    return 0;
+}
+
+
+void POLBALANCEACC_free(
+    POLBALANCEACC *acc
+)
+{
+    if (acc->lock != NULL && acc->classsum != NULL && acc->nbadded != NULL) {
+        for (int l = 0; l < acc->nbcube * acc->pac.nbclass; l++) {
+            pthread_mutex_destroy(&acc->lock[l]);
+        }
+    }
+    if (acc->classsum != NULL) {
+        for (int cube = 0; cube < acc->nbcube; cube++) {
+            free(acc->classsum[cube]);
+        }
+    }
+    free(acc->classsum);
+    free(acc->lock);
+    free(acc->nbadded);
+    POLANGLECLASS_free(&acc->pac);
+    memset(acc, 0, sizeof(POLBALANCEACC));
+}
+
+
+
+
+// Sliding window algorithm
+// Window [lo, hi] moves forward monotonically with the output frame, so
+// each input frame is added to and removed from the running class sums
+// once per cube. Cost per output frame is O(nbclass P), independent of
+// window size, memory is nbclass sum images.
+static int polbalance_window(
+    const double *WPangle,
+    const double *tstamp,
+    long nbframe,
+    float *const *imgin,
+    float *const *imgout,
+    int nbcube,
+    long framesize,
+    const POLBALANCECONF *conf
+)
+{
+    if (conf->nbnear <= 0 && (tstamp == NULL || !(conf->window > 0.0))) {
+        fprintf(stderr, "Window balancing requires window > 0 or nbnear > 0\n");
+        return -1;
+    }
+
+    POLANGLECLASS pac;
+    if (POLANGLECLASS_build(&pac, WPangle, nbframe, conf->angletol) != 0) {
+        return -1;
+    }
+    int K = pac.nbclass;
+
+    if (conf->nbnear > 0) {
+        printf("Polarization balancing: %ld frames in %d angle classes, window +/- %ld frames\n",
+               nbframe, K, conf->nbnear);
+    } else {
+        printf("Polarization balancing: %ld frames in %d angle classes, window +/- %.3f s\n",
+               nbframe, K, conf->window);
+    }
+
+    double *classsum = (double *) malloc(sizeof(double) * K * framesize);
+    long *classnb = (long *) malloc(sizeof(long) * K);
+    double *wcoeff = (double *) malloc(sizeof(double) * K);
+    int *actclass = (int *) malloc(sizeof(int) * K);
+    if (classsum == NULL || classnb == NULL || wcoeff == NULL || actclass == NULL) {
+        free(classsum);
+        free(classnb);
+        free(wcoeff);
+        free(actclass);
+        POLANGLECLASS_free(&pac);
+        return -1;
+    }
+
+    long nbunbalanced = 0;
+    for (int cube = 0; cube < nbcube; cube++) {
+        memset(classsum, 0, sizeof(double) * K * framesize);
+        memset(classnb, 0, sizeof(long) * K);
+        long lo = 0;
+        long hi = -1;
+
+        for (long idx = 0; idx < nbframe; idx++) {
+            // extend window end
+            while (hi + 1 < nbframe
+                    && ((conf->nbnear > 0) ? (hi + 1 - idx <= conf->nbnear)
+                        : (tstamp[hi + 1] - tstamp[idx] <= conf->window))) {
+                hi++;
+                int c = pac.frameclass[hi];
+                double *sum = classsum + (size_t) c * framesize;
+                const float *in = imgin[cube] + hi * framesize;
+                for (long pixi = 0; pixi < framesize; pixi++) {
+                    sum[pixi] += in[pixi];
+                }
+                classnb[c]++;
+            }
+            // shrink window start
+            while ((conf->nbnear > 0) ? (idx - lo > conf->nbnear)
+                    : (tstamp[idx] - tstamp[lo] > conf->window)) {
+                int c = pac.frameclass[lo];
+                double *sum = classsum + (size_t) c * framesize;
+                const float *in = imgin[cube] + lo * framesize;
+                for (long pixi = 0; pixi < framesize; pixi++) {
+                    sum[pixi] -= in[pixi];
+                }
+                classnb[c]--;
+                lo++;
+            }
+
+            // class weights within window
+            int b = pac.frameclass[idx];
+            double sum_dot_product = 0.0;
+            for (int a = 0; a < K; a++) {
+                sum_dot_product += classnb[a] * pac.dot[(size_t) b * K + a];
+            }
+
+            const float *in = imgin[cube] + idx * framesize;
+            float *out = imgout[cube] + idx * framesize;
+            if (!(sum_dot_product < 0.0)) {
+                memcpy(out, in, framesize * sizeof(float));
+                if (cube == 0) {
+                    nbunbalanced++;
+                }
+                continue;
+            }
+            // only classes present in window with opposite polarization
+            int nbactive = 0;
+            for (int a = 0; a < K; a++) {
+                if (classnb[a] > 0 && pac.dot[(size_t) b * K + a] < 0.0) {
+                    actclass[nbactive] = a;
+                    wcoeff[nbactive] = pac.dot[(size_t) b * K + a] / sum_dot_product;
+                    nbactive++;
+                }
+            }
+
+            for (long pixi = 0; pixi < framesize; pixi++) {
+                double v = 0.0;
+                for (int ai = 0; ai < nbactive; ai++) {
+                    v += wcoeff[ai] * classsum[(size_t) actclass[ai] * framesize + pixi];
+                }
+                out[pixi] = 0.5f * (in[pixi] + (float) v);
+            }
+        }
+    }
+
+    if (nbunbalanced > 0) {
+        printf("WARNING: %ld frames without opposite polarization frame in window, not balanced\n", nbunbalanced);
+    }
+
+    free(classsum);
+    free(classnb);
+    free(wcoeff);
+    free(actclass);
+    POLANGLECLASS_free(&pac);
+    return 0;
+}
+
+
+
+
+// One row of mixing matrix M = 0.5 (I + W)
+// Input frame range is the whole sequence, or the window around idxout.
+// Entries below eps are dropped, as in dense mode.
+// Returns number of entries written to col and val.
+static long gemm_row(
+    const double *polX,
+    const double *polY,
+    const double *tstamp,
+    long nbframe,
+    const POLBALANCECONF *conf,
+    long idxout,
+    long *col,
+    float *val,
+    int *balanced
+)
+{
+    double eps = 1e-6;
+    long j0 = 0;
+    long j1 = nbframe - 1;
+    if (conf->nbnear > 0) {
+        j0 = (idxout - conf->nbnear > 0) ? idxout - conf->nbnear : 0;
+        j1 = (idxout + conf->nbnear < nbframe - 1) ? idxout + conf->nbnear : nbframe - 1;
+    } else if (tstamp != NULL && conf->window > 0.0) {
+        j0 = idxout;
+        while (j0 > 0 && tstamp[idxout] - tstamp[j0 - 1] <= conf->window) {
+            j0--;
+        }
+        j1 = idxout;
+        while (j1 < nbframe - 1 && tstamp[j1 + 1] - tstamp[idxout] <= conf->window) {
+            j1++;
+        }
+    }
+
+    double sum_dot_product = 0.0;
+    for (long j = j0; j <= j1; j++) {
+        double dot_product = polX[j] * polX[idxout] + polY[j] * polY[idxout];
+        if (dot_product < 0.0) {
+            sum_dot_product += dot_product;
+        }
+    }
+
+    long n = 0;
+    if (!(sum_dot_product < 0.0)) {
+        *balanced = 0;
+        col[n] = idxout;
+        val[n] = 1.0f;
+        return 1;
+    }
+    *balanced = 1;
+    for (long j = j0; j <= j1; j++) {
+        double dot_product = polX[j] * polX[idxout] + polY[j] * polY[idxout];
+        double w = (dot_product < 0.0) ? dot_product / sum_dot_product : 0.0;
+        if (j == idxout || w > eps) {
+            col[n] = j;
+            val[n] = (float)(0.5 * w + ((j == idxout) ? 0.5 : 0.0));
+            n++;
+        }
+    }
+    return n;
+}
+
+
+// Explicit mixing matrix algorithm
+// The matrix is generated and applied by blocks of output rows, so that
+// at most POLBALANCE_BLOCKNNZ entries are held at a time. Each row is
+// generated once, into CSR storage; a block is expanded to dense storage
+// if its fraction of non-zero entries exceeds POLBALANCE_DENSEFRAC.
+// With forcecsr set, CSR storage is used regardless of fill fraction.
+static int polbalance_gemm(
+    const double *WPangle,
+    const double *tstamp,
+    long nbframe,
+    float *const *imgin,
+    float *const *imgout,
+    int nbcube,
+    long framesize,
+    const POLBALANCECONF *conf,
+    int forcecsr
+)
+{
+    if (nbframe < 1) {
+        return 0;
+    }
+    long rowblk = POLBALANCE_BLOCKNNZ / nbframe;
+    if (rowblk < 1) {
+        rowblk = 1;
+    }
+    if (rowblk > nbframe) {
+        rowblk = nbframe;
+    }
+
+    double *polX = (double *) malloc(sizeof(double) * nbframe);
+    double *polY = (double *) malloc(sizeof(double) * nbframe);
+    float **blkout = (float **) malloc(sizeof(float *) * nbcube);
+    float *M = NULL;
+    if (!forcecsr) {
+        M = (float *) malloc(sizeof(float) * rowblk * nbframe);
+    }
+    CSRMATRIX csr;
+    int csrstatus = CSRMATRIX_alloc(&csr, rowblk, nbframe, rowblk * nbframe);
+    if (polX == NULL || polY == NULL || blkout == NULL || (!forcecsr && M == NULL)
+            || csrstatus != 0) {
+        free(polX);
+        free(polY);
+        free(blkout);
+        free(M);
+        if (csrstatus == 0) {
+            CSRMATRIX_free(&csr);
+        }
+        return -1;
+    }
+    for (long idx = 0; idx < nbframe; idx++) {
+        polX[idx] = cos(4.0 * WPangle[idx] * M_PI / 180.0);
+        polY[idx] = sin(4.0 * WPangle[idx] * M_PI / 180.0);
+    }
+
+    long nnz = 0;
+    long nbunbalanced = 0;
+    long nbdenseblk = 0;
+    long nbblk = 0;
+    int status = 0;
+    for (long row0 = 0; row0 < nbframe && status == 0; row0 += rowblk) {
+        long nrow = (row0 + rowblk < nbframe) ? rowblk : nbframe - row0;
+
+        // generate rows of block
+        csr.nrow = nrow;
+        csr.rowptr[0] = 0;
+        for (long i = 0; i < nrow; i++) {
+            int balanced;
+            long n = gemm_row(polX, polY, tstamp, nbframe, conf, row0 + i,
+                              csr.colidx + csr.rowptr[i], csr.val + csr.rowptr[i], &balanced);
+            csr.rowptr[i + 1] = csr.rowptr[i] + n;
+            if (!balanced) {
+                nbunbalanced++;
+            }
+        }
+        long blknnz = csr.rowptr[nrow];
+        csr.nnz = blknnz;
+        nnz += blknnz;
+        nbblk++;
+
+        // apply block to output frames row0 .. row0 + nrow - 1
+        for (int c = 0; c < nbcube; c++) {
+            blkout[c] = imgout[c] + (size_t) row0 * framesize;
+        }
+        if (!forcecsr && (double) blknnz / nrow / nbframe > POLBALANCE_DENSEFRAC) {
+            memset(M, 0, sizeof(float) * nrow * nbframe);
+            for (long i = 0; i < nrow; i++) {
+                for (long e = csr.rowptr[i]; e < csr.rowptr[i + 1]; e++) {
+                    M[i * nbframe + csr.colidx[e]] = csr.val[e];
+                }
+            }
+            status = blockgemm_dense(M, nrow, nbframe, (const float *const *) imgin, blkout,
+                                     nbcube, framesize, conf->nbthread);
+            nbdenseblk++;
+        } else {
+            status = blockgemm_csr(&csr, (const float *const *) imgin, blkout,
+                                   nbcube, framesize, conf->nbthread);
+        }
+    }
+
+    if (status == 0) {
+        double density = (double) nnz / nbframe / nbframe;
+        printf("Polarization balancing: %ld x %ld mixing matrix, %ld non-zero (%.1f%%), %ld row blocks, %ld dense\n",
+               nbframe, nbframe, nnz, 100.0 * density, nbblk, nbdenseblk);
+        if (nbunbalanced > 0) {
+            printf("WARNING: %ld frames without opposite polarization frame, not balanced\n", nbunbalanced);
+        }
+    }
+
+    free(polX);
+    free(polY);
+    free(blkout);
+    free(M);
+    CSRMATRIX_free(&csr);
+    return status;
+}
+
+
+
+
+// Original algorithm: all opposite polarization frames of the sequence
+// Copy, weighted accumulation and 0.5 scaling are folded in one CSR row
+// per output frame, applied by the fused multi-threaded kernel in a
+// single pass over each output pixel tile.
+static int polbalance_dense(
+    const double *WPangle,
+    long nbframe,
+    float *const *imgin,
+    float *const *imgout,
+    int nbcube,
+    long framesize,
+    const POLBALANCECONF *conf
+)
+{
+    POLBALANCECONF denseconf = *conf;
+    denseconf.window = 0.0;
+    denseconf.nbnear = 0;
+    return polbalance_gemm(WPangle, NULL, nbframe, imgin, imgout, nbcube, framesize, &denseconf, 1);
+}
+
+
+
+
+int polbalance_run(
+    const double *WPangle,
+    const double *tstamp,
+    long nbframe,
+    float *const *imgin,
+    float *const *imgout,
+    int nbcube,
+    long framesize,
+    const POLBALANCECONF *conf
+)
+{
+    if (conf->mode == POLBALANCE_DENSE) {
+        return polbalance_dense(WPangle, nbframe, imgin, imgout, nbcube, framesize, conf);
+    }
+    if (conf->mode == POLBALANCE_GEMM) {
+        return polbalance_gemm(WPangle, tstamp, nbframe, imgin, imgout, nbcube, framesize, conf, 0);
+    }
+    if (conf->mode == POLBALANCE_WINDOW) {
+        return polbalance_window(WPangle, tstamp, nbframe, imgin, imgout, nbcube, framesize, conf);
+    }
+    return polbalance_angleclass(WPangle, nbframe, imgin, imgout, nbcube, framesize, conf->angletol);
+}
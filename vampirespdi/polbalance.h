@@ -0,0 +1,185 @@
+#ifndef _VAMPIRES_PDI__POLBALANCE_H
+#define _VAMPIRES_PDI__POLBALANCE_H
+
+#include <pthread.h>
+
+
+// Balancing modes
+#define POLBALANCE_DENSE      0 // all frame pairs, O(N^2 P)
+#define POLBALANCE_ANGLECLASS 1 // per angle class sums, O(N P)
+#define POLBALANCE_WINDOW     2 // per angle class running sums over a sliding window, O(N P)
+#define POLBALANCE_GEMM       3 // explicit mixing matrix, blocked matrix product
+#define POLBALANCE_INGEST     4 // as angleclass, class sums accumulated during ingest, in place
+
+// Mixing matrix stored dense above this fraction of non-zero entries, CSR below
+#define POLBALANCE_DENSEFRAC 0.25
+
+// Mixing matrix entries generated per block of output rows
+#define POLBALANCE_BLOCKNNZ (1L << 22)
+
+
+// Polarization balancing
+//
+// Each frame has a polarization vector p = (cos 4a, sin 4a), a being the
+// half-wave plate angle. Output frame i is
+//   out_i = 0.5 * (in_i + sum_j w_ij in_j)
+// with w_ij = min(0, p_i.p_j) / sum_j min(0, p_i.p_j): the average of
+// opposite polarization frames, weighted by anti-alignment.
+// Frames without any opposite polarization frame are copied unchanged.
+//
+// In window mode, the sum runs over frames j within a time window
+// |t_j - t_i| <= window, or within nbnear frames of i in the matched
+// sequence, so that balancing follows drifting observing conditions.
+//
+// In gemm mode, the mixing matrix M = 0.5 (I + W) is built explicitly,
+// over the window if window or nbnear is set, and applied to all cubes
+// in a blocked multi-threaded matrix product pb = M . cube. M is
+// generated by blocks of output rows, so its storage stays bounded.
+//
+// In ingest mode, angle class sums are accumulated by POLBALANCEACC as
+// frames are written by ingest, and cubes are then balanced in place,
+// so that no second cube is needed. Given to polbalance_run, ingest
+// mode is processed as angleclass.
+
+
+typedef struct {
+    int    mode;      // POLBALANCE_DENSE, _ANGLECLASS, _WINDOW, _GEMM or _INGEST
+    double angletol;  // angle class tolerance [deg], angleclass and window modes
+    double window;    // window half-width [s], window mode, used if nbnear = 0
+    long   nbnear;    // window half-width [frames], window mode
+    int    nbthread;  // number of threads, dense and gemm modes
+} POLBALANCECONF;
+
+
+// Angle classes
+// Frames whose angles are within tolerance (modulo 90 deg, the period
+// of p) share a class; class vector is the mean of member vectors.
+typedef struct {
+    int     nbclass;
+    int    *frameclass; // class of each frame
+    long   *nbmember;   // number of frames in each class
+    double *polX;       // class polarization vector
+    double *polY;
+    double *dot;        // nbclass x nbclass: dot[b*nbclass + a] = min(0, p_a.p_b)
+    double *coeff;      // nbclass x nbclass: coeff[b*nbclass + a] = weight of one class a frame in class b output
+    int    *balanced;   // 0 if class has no opposite polarization class
+} POLANGLECLASS;
+
+
+// Angle class sums accumulated frame by frame
+typedef struct {
+    POLANGLECLASS    pac;
+    int              nbcube;
+    long             framesize;
+    double         **classsum; // per cube, nbclass x framesize
+    pthread_mutex_t *lock;     // per cube and class
+    long            *nbadded;  // per cube, number of frames added
+} POLBALANCEACC;
+
+
+
+/**
+ * @brief Converts balancing mode name to mode.
+ * @param modestr "dense", "angleclass", "window", "gemm" or "ingest".
+ * @return Balancing mode, -1 if unknown.
+ */
+int polbalance_parsemode(
+    const char *modestr
+);
+
+/**
+ * @brief Groups frames by half-wave plate angle.
+ * @param WPangle Angle of each frame [deg].
+ * @param angletol Maximum angle difference within a class [deg].
+ * @return 0 on success, -1 on allocation failure.
+ */
+int POLANGLECLASS_build(
+    POLANGLECLASS *pac,
+    const double *WPangle,
+    long nbframe,
+    double angletol
+);
+
+void POLANGLECLASS_free(
+    POLANGLECLASS *pac
+);
+
+/**
+ * @brief Prepares angle class sums of cubes to be filled frame by frame.
+ * @param WPangle Angle of each frame [deg].
+ * @param nbframe Number of frames.
+ * @param nbcube Number of cubes.
+ * @param framesize Number of pixels per frame.
+ * @param angletol Angle class tolerance [deg].
+ * @return 0 on success, -1 on allocation failure.
+ */
+int POLBALANCEACC_init(
+    POLBALANCEACC *acc,
+    const double *WPangle,
+    long nbframe,
+    int nbcube,
+    long framesize,
+    double angletol
+);
+
+/**
+ * @brief Adds frame to its angle class sum. Thread-safe.
+ *
+ * Signature matches FRAMEINGESTHOOK, with camera index as cube index.
+ *
+ * @param arg POLBALANCEACC.
+ * @param cube Cube index.
+ * @param frameidx Frame index.
+ * @param frame Frame pixels.
+ */
+void POLBALANCEACC_addframe(
+    void *arg,
+    int cube,
+    long frameidx,
+    const float *frame
+);
+
+/**
+ * @brief Polarization-balances cubes in place from accumulated sums.
+ * @param img Cubes, nbframe x framesize floats each, all frames added.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int POLBALANCEACC_apply(
+    POLBALANCEACC *acc,
+    float *const *img
+);
+
+void POLBALANCEACC_free(
+    POLBALANCEACC *acc
+);
+
+/**
+ * @brief Polarization-balances cubes of frames sharing angles.
+ *
+ * Cubes are processed with the same frame weights, e.g. cam1 and cam2
+ * cubes of matched frames.
+ *
+ * @param WPangle Angle of each frame [deg].
+ * @param tstamp Time of each frame [s], non-decreasing. Only used in
+ *               window mode with a time window, may be NULL otherwise.
+ * @param nbframe Number of frames.
+ * @param imgin Input cubes, nbframe x framesize floats each.
+ * @param imgout Output cubes, same size.
+ * @param nbcube Number of cubes.
+ * @param framesize Number of pixels per frame.
+ * @param conf Balancing mode and parameters.
+ * @return 0 on success, -1 on failure.
+ */
+int polbalance_run(
+    const double *WPangle,
+    const double *tstamp,
+    long nbframe,
+    float *const *imgin,
+    float *const *imgout,
+    int nbcube,
+    long framesize,
+    const POLBALANCECONF *conf
+);
+
+
+#endif
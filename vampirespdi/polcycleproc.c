@@ -1,15 +1,28 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>   // Required for fabs()
 #include <float.h>  // Required for DBL_MAX
 
 #include "CLIcore.h"
 //#include "COREMOD_iofits/COREMOD_iofits.h"  // load_fits
-#include "quicksort.h" // sort
 
 
 #include "read_asciiconf.h"
 #include "scanFITSfiles.h"
+#include "FITScatalog.h"
+#include "FITSindex.h"
+#include "FITSkeylookup.h"
+#include "frameingest.h"
+#include "framesort.h"
+#include "grampca.h"
+#include "ipca.h"
+#include "memplan.h"
+#include "pcarecon.h"
+#include "polbalance.h"
+#include "rsvd.h"
+#include "scratchcube.h"
+#include "timesync.h"
 
 //#include "linalgebra/linalgebra.h"
 #include "linalgebra/SingularValueDecomp.h"
@@ -17,11 +30,15 @@
 #include "linalgebra/SingularValueDecomp_mkU.h"
 #include "linalgebra/SGEMM.h"
 
-#define MAXNBFILES 10000
+// Number of synchronized time streams: cam1, cam2
+#define SYNCNBSTREAM 2
+
+// PCA of balanced cam1 cube
+#define PCAMODE_SVD  0 // full decomposition, milk compute_SVD
+#define PCAMODE_RSVD 1 // randomized truncated SVD, top modes only
+#define PCAMODE_IPCA 2 // incremental SVD, new frames folded into saved modes
+#define PCAMODE_GRAM 3 // eigen-decomposition of temporal Gram matrix, frames << pixels
 
-// Maximum number of keywords in single FITS file
-// Used for statistically allocated finfo to load one header at a time
-#define FITSMAXNCARD 10000
 
 
 typedef struct {
@@ -72,162 +89,6 @@ static CLICMDDATA CLIcmddata =
 
 
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-/**
- * @brief Reads an ASCII data file and populates a double array with time values.
- *
- * The function parses a file where each data line contains 7 columns. It extracts
- * an index from column 1 and a time value from column 5, placing the time into
- * the output array at the specified index. Lines starting with '#' are ignored.
- *
- * @param filename The path to the ASCII file to read.
- * @param time_array A pointer to a pre-allocated double array to store the results.
- * @param array_size The total number of elements in time_array (for bounds checking).
- *
- * @return Returns 0 on success, -1 on failure (e.g., file not found).
- */
-static int read_time_data(const char *filename, double *time_array, size_t array_size) {
-    // Open the file for reading ("r" mode)
-    FILE *file_ptr = fopen(filename, "r");
-    if (file_ptr == NULL) {
-        perror("Error opening file");
-        return -1; // Indicate failure
-    }
-
-    char line_buffer[256]; // Buffer to hold one line of the file
-    int line_number = 0;
-
-    // Read the file line by line until the end
-    while (fgets(line_buffer, sizeof(line_buffer), file_ptr) != NULL) {
-        line_number++;
-
-        // Skip comment lines (which start with '#') or empty lines
-        if (line_buffer[0] == '#' || line_buffer[0] == '\n') {
-            continue;
-        }
-
-        int frame_index;
-        double absolute_time;
-
-        // Use sscanf to parse the line.
-        // The '%*...' format specifiers read a value but discard it (assignment suppression).
-        // We only care about the 1st (%d) and 5th (%lf) values.
-        int items_scanned = sscanf(line_buffer, "%d %*d %*f %*f %lf %*d %*d",
-                                   &frame_index, &absolute_time);
-
-        // A correctly formatted data line will result in 2 successfully scanned items.
-        if (items_scanned == 2) {
-            // CRITICAL: Perform a bounds check before writing to the array.
-            if (frame_index >= 0 && (size_t)frame_index < array_size) {
-                time_array[frame_index] = absolute_time;
-            } else {
-                fprintf(stderr, "Warning: Index %d on line %d is out of bounds for array of size %zu. Skipping.\n",
-                        frame_index, line_number, array_size);
-            }
-        }
-    }
-
-    // Close the file stream
-    fclose(file_ptr);
-
-    return 0; // Indicate success
-}
-
-
-
-
-/**
- * @brief Defines the output structure for an aligned point pair.
- * It holds the original index from each of the two streams.
- */
-typedef struct {
-    int index1;
-    int index2;
-} AlignedPoint;
-
-/**
- * @brief Synchronizes two time-series streams based on a maximum time difference.
- *
- * This function finds the best one-to-one matches between two sorted streams of
- * time-stamped data. It uses an efficient two-pointer "greedy" algorithm to
- * iterate through both streams simultaneously. At each step, it decides whether
- * to pair the current points or advance one of the stream pointers to find a
- * better match. A pair is only considered if `abs(time1[i] - time2[j])` is
- * less than or equal to `max_time_diff`.
- *
- * @param time1 Pointer to the time array for stream 1 (must be sorted ascending).
- * @param nbpoint1 The number of points in stream 1.
- * @param time2 Pointer to the time array for stream 2 (must be sorted ascending).
- * @param nbpoint2 The number of points in stream 2.
- * @param max_time_diff The maximum allowed time difference for a valid match.
- * @param aligned_points_out An allocated array to store the resulting aligned pairs.
- * @param max_output_size The maximum capacity of the `aligned_points_out` array.
- * @return The total number of aligned pairs found and written to the output array.
- */
-static int synchronize_timestreams2(
-    const double* time1,
-    int nbpoint1,
-    const double* time2,
-    int nbpoint2,
-    double max_time_diff,
-    AlignedPoint* aligned_points_out,
-    int max_output_size)
-{
-    int i = 0; // Pointer for stream 1
-    int j = 0; // Pointer for stream 2
-    int aligned_count = 0;
-
-    // Continue as long as there are points in both streams and space in the output array
-    while (i < nbpoint1 && j < nbpoint2 && aligned_count < max_output_size) {
-        double time_diff = time1[i] - time2[j];
-        double abs_time_diff = fabs(time_diff);
-
-        // Case 1: The points are within the synchronization window.
-        if (abs_time_diff <= max_time_diff) {
-            // Greedily decide if this is the best local match.
-            // Look ahead: what's the time difference if we advance pointer i?
-            double next_diff1 = (i + 1 < nbpoint1)
-                                ? fabs(time1[i + 1] - time2[j])
-                                : DBL_MAX;
-
-            // Look ahead: what's the time difference if we advance pointer j?
-            double next_diff2 = (j + 1 < nbpoint2)
-                                ? fabs(time1[i] - time2[j + 1])
-                                : DBL_MAX;
-
-            // If the current diff is smaller than or equal to the next possible diffs,
-            // we have found the best match for this pair.
-            if (abs_time_diff <= next_diff1 && abs_time_diff <= next_diff2) {
-                aligned_points_out[aligned_count].index1 = i;
-                aligned_points_out[aligned_count].index2 = j;
-                aligned_count++;
-                // Advance both pointers to find the next unique pair.
-                i++;
-                j++;
-            } else if (next_diff1 < next_diff2) {
-                // Advancing pointer i will lead to a better match.
-                i++;
-            } else {
-                // Advancing pointer j will lead to a better match.
-                j++;
-            }
-        }
-        // Case 2: Point in stream 1 is too "early". Advance pointer i to catch up.
-        else if (time_diff < 0) { // This means time1[i] < time2[j]
-            i++;
-        }
-        // Case 3: Point in stream 2 is too "early". Advance pointer j to catch up.
-        else { // This means time1[i] > time2[j]
-            j++;
-        }
-    }
-
-    return aligned_count;
-}
-
 void print_progress(double progress) {
     const int BAR_WIDTH = 50;
     if (progress < 0.0) {
@@ -255,6 +116,35 @@ void print_progress(double progress) {
 }
 
 
+// Reconstructed cube frame t = sum_k coeff[k][t] S_k U_k, streamed by
+// pixel tiles to file <dir>/<name>.f32 (raw floats, frame-major)
+static int polcycle_reconfile(
+    const char *dir,
+    const char *name,
+    const float *U,
+    const float *S,
+    const float *coeff,
+    long nbmode,
+    long nbframe,
+    long framesize,
+    int nbthread
+)
+{
+    char fname[4096];
+    snprintf(fname, sizeof(fname), "%s/%s.f32", dir, name);
+    printf("RECONSTRUCTING %s to %s\n", name, fname);
+
+    SCRATCHCUBE reccube;
+    if (SCRATCHCUBE_createfile(&reccube, fname, (size_t) framesize * nbframe) != 0) {
+        perror(fname);
+        return -1;
+    }
+    int status = pcarecon_cube(U, S, coeff, nbmode, nbframe, framesize, reccube.F, nbthread);
+    SCRATCHCUBE_close(&reccube);
+    return status;
+}
+
+
 /**
  * @brief Wrapper function, used by all CLI calls
  *
@@ -286,6 +176,43 @@ static MILK_HOT errno_t compute_function()
     long ysize = 512;
     int cropnb = 4;
     long zsize __attribute__((unused)) = 1;
+    int scannbthread = 4; // number of threads reading FITS headers
+    char *scanindexfile = NULL; // header index cache, "none" to disable
+    char *scankeywords = "DETECTOR,RET-ANG1,MJD"; // keywords extracted from headers
+    int scanfullheader = 0; // 1: extract all header cards (debugging)
+    char *scanfilepattern = "*.fits,*.fits.fz"; // file name globs, "*" for all files
+    double synctolerance = 0.1; // max time difference between matched frames [s]
+    int scanmagiccheck = 1; // 1: skip files not starting with FITS signature
+    int sortnbthread = 4; // number of threads sorting frame times
+    FRAMEINGESTCONF ingestconf = {
+        FRAMEINGEST_MMAP, // ingestmode: pixel read strategy, see frameingest.h
+        2,                // ingestreadthreads: threads reading FITS files
+        2,                // ingestworkthreads: threads scattering frames
+        8,                // ingestqueuedepth: number of chunk buffers
+        NULL, NULL        // frame hook, set for polbalancemode ingest
+    };
+    POLBALANCECONF pbconf = {
+        POLBALANCE_ANGLECLASS, // polbalancemode: "dense", "angleclass", "window", "gemm" or "ingest"
+        1.0,                   // polbalanceangletol: max angle difference within angle class [deg]
+        0.0,                   // polbalancewindow: window half-width [s], window mode
+        0,                     // polbalancenbnear: window half-width [frames], window mode, overrides polbalancewindow
+        4                      // polbalancenbthread: number of threads, dense and gemm modes
+    };
+    double memorybudgetGB = 0.0; // memory budget, 0 for 80% of physical memory
+    char *scratchdir = "."; // directory of scratch files, out-of-core execution
+    int outofcore = -1; // 1: file-backed cubes, 0: in-core, -1: automatic from memory budget
+    int pcamode = PCAMODE_SVD; // "svd", "rsvd", "ipca" or "gram"
+    RSVDCONF rsvdconf = {
+        100,    // pcanbmode: number of modes, rsvd, ipca and gram modes
+        10,     // rsvdoversample: additional random vectors
+        2,      // rsvdpoweriter: number of power iterations
+        0.0,    // pcaenergy: if > 0, fewest modes holding this fraction of squared norm, rsvd and gram modes
+        0.0001, // singular value limit, relative to first
+        4       // pcanbthread: number of threads
+    };
+    char *ipcastatefile = "cam1pb_ipca.dat"; // modes saved between runs, ipca mode
+    double ipcaforget = 1.0; // forgetting factor applied to earlier frames at each run, ipca mode
+    int ipcareproject = 0; // 1: re-project all frames on updated modes, O(nbframe), ipca mode
     for (int i = 0; i < pair_count; i++) {
         if (strcmp(config[i].key, "rawdatadir") == 0) {
             rawdatadir = config[i].value;
@@ -301,6 +228,141 @@ static MILK_HOT errno_t compute_function()
         if (strcmp(config[i].key, "cropnb") == 0) {
             cropnb = atoi(config[i].value);
         }
+
+        if (strcmp(config[i].key, "scannbthread") == 0) {
+            scannbthread = atoi(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "scanindexfile") == 0) {
+            scanindexfile = config[i].value;
+        }
+
+        if (strcmp(config[i].key, "scankeywords") == 0) {
+            scankeywords = config[i].value;
+        }
+
+        if (strcmp(config[i].key, "scanfullheader") == 0) {
+            scanfullheader = atoi(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "scanfilepattern") == 0) {
+            scanfilepattern = config[i].value;
+        }
+
+        if (strcmp(config[i].key, "scanmagiccheck") == 0) {
+            scanmagiccheck = atoi(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "synctolerance") == 0) {
+            synctolerance = atof(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "sortnbthread") == 0) {
+            sortnbthread = atoi(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "ingestmode") == 0) {
+            ingestconf.mode = frameingest_parsemode(config[i].value);
+            if (ingestconf.mode < 0) {
+                fprintf(stderr, "Unknown ingestmode %s\n", config[i].value);
+                return 1;
+            }
+        }
+
+        if (strcmp(config[i].key, "ingestreadthreads") == 0) {
+            ingestconf.nbreadthread = atoi(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "ingestworkthreads") == 0) {
+            ingestconf.nbworkthread = atoi(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "ingestqueuedepth") == 0) {
+            ingestconf.queuedepth = atoi(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "polbalancemode") == 0) {
+            pbconf.mode = polbalance_parsemode(config[i].value);
+            if (pbconf.mode < 0) {
+                fprintf(stderr, "Unknown polbalancemode %s\n", config[i].value);
+                return 1;
+            }
+        }
+
+        if (strcmp(config[i].key, "polbalanceangletol") == 0) {
+            pbconf.angletol = atof(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "polbalancewindow") == 0) {
+            pbconf.window = atof(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "polbalancenbnear") == 0) {
+            pbconf.nbnear = atol(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "polbalancenbthread") == 0) {
+            pbconf.nbthread = atoi(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "memorybudgetGB") == 0) {
+            memorybudgetGB = atof(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "scratchdir") == 0) {
+            scratchdir = config[i].value;
+        }
+
+        if (strcmp(config[i].key, "outofcore") == 0) {
+            outofcore = (strcmp(config[i].value, "auto") == 0) ? -1 : atoi(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "pcamode") == 0) {
+            if (strcmp(config[i].value, "svd") == 0) {
+                pcamode = PCAMODE_SVD;
+            } else if (strcmp(config[i].value, "rsvd") == 0) {
+                pcamode = PCAMODE_RSVD;
+            } else if (strcmp(config[i].value, "ipca") == 0) {
+                pcamode = PCAMODE_IPCA;
+            } else if (strcmp(config[i].value, "gram") == 0) {
+                pcamode = PCAMODE_GRAM;
+            } else {
+                fprintf(stderr, "Unknown pcamode %s\n", config[i].value);
+                return 1;
+            }
+        }
+
+        if (strcmp(config[i].key, "pcanbmode") == 0) {
+            rsvdconf.nbmode = atol(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "pcaenergy") == 0) {
+            rsvdconf.energy = atof(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "rsvdoversample") == 0) {
+            rsvdconf.oversample = atol(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "rsvdpoweriter") == 0) {
+            rsvdconf.poweriter = atoi(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "pcanbthread") == 0) {
+            rsvdconf.nbthread = atoi(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "ipcastatefile") == 0) {
+            ipcastatefile = config[i].value;
+        }
+
+        if (strcmp(config[i].key, "ipcaforget") == 0) {
+            ipcaforget = atof(config[i].value);
+        }
+
+        if (strcmp(config[i].key, "ipcareproject") == 0) {
+            ipcareproject = atoi(config[i].value);
+        }
     }
     long xysize = xsize * ysize * cropnb;
 
@@ -353,64 +415,81 @@ static MILK_HOT errno_t compute_function()
 
     // Scan FITS files in directory
 
-    int file_count = 0;
+    // Entries will be collected to this catalog, in directory order
+    FITScatalog catalog;
+    FITScatalog_init(&catalog);
 
-    // Temporary structure used to read a single header
-    FITSfileinfo finfo;
-    // Allow for max FITSMAXNCARD of keyword
-    finfo.kw = (FITSkeyword *)malloc(sizeof(FITSkeyword) * FITSMAXNCARD);
+    // Keywords to extract from headers
+    FITSkwprojection kwproj;
+    if (FITSkwprojection_parse(&kwproj, scankeywords, scanfullheader) != 0) {
+        free_config(config, pair_count);
+        return 1;
+    }
+    uint64_t projhash = FITSkwprojection_hash(&kwproj);
 
-    // Entries will then be copied to this array, one by one
-    FITSfileinfo* fitsfileinfo = (FITSfileinfo *)malloc(sizeof(FITSfileinfo) * MAXNBFILES);
+    // Directory entries to consider
+    FITSprefilter prefilter;
+    if (FITSprefilter_parse(&prefilter, scanfilepattern, scanmagiccheck) != 0) {
+        free_config(config, pair_count);
+        return 1;
+    }
 
-    int scanOK = 1;
-    while (scanOK == 1)
-    {
-        int scanstatus = scan_nextFITSfiles(rawdatadir, &finfo);
-        if (scanstatus == 1) // found FITS file
-        {
-            snprintf(fitsfileinfo[file_count].fname, FITSFNAMESTRLEN, "%s", finfo.fname);
-
-            fitsfileinfo[file_count].bitpix = finfo.bitpix;
-            fitsfileinfo[file_count].naxis = finfo.naxis;
-            for(int i=0; i<finfo.naxis; i++)
-            {
-                fitsfileinfo[file_count].naxes[i] = finfo.naxes[i];
-            }
-            fitsfileinfo[file_count].nbkey = finfo.nbkey;
-            fitsfileinfo[file_count].kw = (FITSkeyword *)malloc(sizeof(FITSkeyword) * finfo.nbkey);
-            for(int kwi=0; kwi<finfo.nbkey; kwi++)
-            {
-                fitsfileinfo[file_count].kw[kwi].hdu = finfo.kw[kwi].hdu;
-                snprintf(fitsfileinfo[file_count].kw[kwi].keyname, FLEN_KEYWORD, "%s", finfo.kw[kwi].keyname);
-                snprintf(fitsfileinfo[file_count].kw[kwi].value, FLEN_VALUE, "%s", finfo.kw[kwi].value);
-                snprintf(fitsfileinfo[file_count].kw[kwi].comment, FLEN_COMMENT, "%s", finfo.kw[kwi].comment);
-                /*printf("   \"%8s\"  %12s  %s\n",
-                       fitsfileinfo[file_count].kw[kwi].keyname,
-                       fitsfileinfo[file_count].kw[kwi].value,
-                       fitsfileinfo[file_count].kw[kwi].comment
-                      );*/
-            }
+    // Header index cache
+    // Default is a sidecar file in rawdatadir
+    char indexfname[FITSFNAMESTRLEN];
+    if (scanindexfile != NULL) {
+        snprintf(indexfname, FITSFNAMESTRLEN, "%s", scanindexfile);
+    } else {
+        snprintf(indexfname, FITSFNAMESTRLEN, "%s/.vamppdi.index", rawdatadir);
+    }
+    int useindex = (strcmp(indexfname, "none") != 0);
 
-            fitsfileinfo[file_count].destframeidx = (int *)malloc(sizeof(int) * finfo.naxes[2]);
-            for(int frame_idx=0; frame_idx<finfo.naxes[2]; frame_idx++)
-            {
-                fitsfileinfo[file_count].destframeidx[frame_idx] = -1;
-            }
+    FITSindex scanindex;
+    if (useindex && FITSindex_open(&scanindex, indexfname, projhash) == 0) {
+        printf("Loaded header index %s : %ld entries\n", indexfname, scanindex.nbentry);
+    }
 
-            file_count++;
+    FITSscanCTX scanctx;
+    if (FITSscan_init(&scanctx, rawdatadir, scannbthread, &prefilter) != 0) {
+        fprintf(stderr, "Failed to scan directory %s\n", rawdatadir);
+        if (useindex) {
+            FITSindex_close(&scanindex);
         }
-        if (scanstatus == 2) // error
-        {
-            scanOK = 0;
+        free_config(config, pair_count);
+        return 1;
+    }
+    scanctx.proj = &kwproj;
+    if (useindex) {
+        scanctx.index = &scanindex;
+    }
+    printf("Scanning %ld / %ld entries in %s with %d threads\n", scanctx.nbentry, scanctx.nblisted, rawdatadir, scanctx.nbthread);
+    FITSscan_run(&scanctx);
+    if (FITSscan_collect(&scanctx, &catalog) < 0) {
+        fprintf(stderr, "Failed to collect scanned files\n");
+        if (useindex) {
+            FITSindex_close(&scanindex);
         }
-        if (scanstatus == -1) // no more files
-        {
-            scanOK = 0;
+        FITSscan_free(&scanctx);
+        FITScatalog_free(&catalog);
+        free_config(config, pair_count);
+        return 1;
+    }
+    // catalog is complete: entries no longer move
+    FITSfileinfo *fitsfileinfo = catalog.file;
+    int file_count = catalog.nbfile;
+    printf("%d FITS files (%.1f MB catalog) : %ld from index, %ld scanned, %ld rejected by signature\n",
+           file_count, catalog.arena.nbbytes / 1048576.0, scanctx.nbcached, scanctx.nbscanned, scanctx.nbrejected);
+
+    if (useindex) {
+        // rewrite index if any file was added, modified or removed
+        if (scanctx.nbscanned > 0 || file_count != scanindex.nbentry) {
+            if (FITSindex_write(indexfname, projhash, fitsfileinfo, file_count) == 0) {
+                printf("Wrote header index %s\n", indexfname);
+            }
         }
+        FITSindex_close(&scanindex);
     }
-    // Free temporary finfo
-    free(finfo.kw);
+    FITSscan_free(&scanctx);
 
 
 
@@ -440,32 +519,25 @@ static MILK_HOT errno_t compute_function()
         frame_pdiinfo.WPangle = -1;
         double mjd = 0.0;
 
-        for(int kwi=0; kwi<fitsfileinfo[file_idx].nbkey; kwi++)
-        {
-            // Look for keyname DETECTOR
-            if (strcmp(fitsfileinfo[file_idx].kw[kwi].keyname, "DETECTOR") == 0) {
-                //printf("Found DETECTOR at %d\n", kwi);
-                // check if value contains CAM1
-                if (strstr(fitsfileinfo[file_idx].kw[kwi].value, "CAM1") != NULL) {
-                    frame_pdiinfo.camindex = 1;
-                }
-                else if (strstr(fitsfileinfo[file_idx].kw[kwi].value, "CAM2") != NULL)
-                {
-                    frame_pdiinfo.camindex = 2;
-                }
+        // Look for keyname DETECTOR
+        // check if value contains CAM1 or CAM2
+        const char *detector = NULL;
+        if (FITSfileinfo_getstring(&fitsfileinfo[file_idx], "DETECTOR", &detector) == 0) {
+            if (strstr(detector, "CAM1") != NULL) {
+                frame_pdiinfo.camindex = 1;
             }
-
-            // Look for keyname RET-ANG1
-            if (strcmp(fitsfileinfo[file_idx].kw[kwi].keyname, "RET-ANG1") == 0) {
-                frame_pdiinfo.WPangle = atof(fitsfileinfo[file_idx].kw[kwi].value);
-            }
-
-            // Look for MJD
-            if (strcmp(fitsfileinfo[file_idx].kw[kwi].keyname, "MJD") == 0) {
-                mjd = atof(fitsfileinfo[file_idx].kw[kwi].value);
+            else if (strstr(detector, "CAM2") != NULL)
+            {
+                frame_pdiinfo.camindex = 2;
             }
         }
 
+        // Look for keyname RET-ANG1
+        FITSfileinfo_getdouble(&fitsfileinfo[file_idx], "RET-ANG1", &frame_pdiinfo.WPangle);
+
+        // Look for MJD
+        FITSfileinfo_getdouble(&fitsfileinfo[file_idx], "MJD", &mjd);
+
         if(frame_pdiinfo.camindex == 1) {
             cam1time[cam1nbfile] = (mjd - 40587.0) * 86400.0;
             cam1index[cam1nbfile] = file_idx;
@@ -525,53 +597,21 @@ static MILK_HOT errno_t compute_function()
 
             // Get WP angle
             double current_WPangle = -1.0;
-            for(int kwi_file=0; kwi_file<fitsfileinfo[current_index[camfileidx]].nbkey; kwi_file++) {
-                if (strcmp(fitsfileinfo[current_index[camfileidx]].kw[kwi_file].keyname, "RET-ANG1") == 0) {
-                    current_WPangle = atof(fitsfileinfo[current_index[camfileidx]].kw[kwi_file].value);
-                    break;
-                }
-            }
+            FITSfileinfo_getdouble(&fitsfileinfo[current_index[camfileidx]], "RET-ANG1", &current_WPangle);
 
 
-            // get timing data
+            // timing data was read at scan time
             printf("File index %ld, name %s\n", current_index[camfileidx], fitsfileinfo[current_index[camfileidx]].fname);
 
-            char *timingfname = malloc(strlen(fitsfileinfo[current_index[camfileidx]].fname) + 8);
-            if (timingfname == NULL) {
-                // Handle memory allocation failure
-                free(cam_PDIframe[cam_idx]);
-                if (cam_idx > 0) free(cam_PDIframe[0]);
-                return 2;
-            }
-
-            strcpy(timingfname, fitsfileinfo[current_index[camfileidx]].fname);
-            char *dot_fits_ptr = strstr(timingfname, ".fits");
-            if (dot_fits_ptr != NULL) {
-                strcpy(dot_fits_ptr, ".txt");
-            }
-
-            /*printf("cam%d %2d/%2d %4d/%4d  FILE name %s -> %s\n",
-                   cam_idx + 1, camfileidx, current_nbfile,
-                   camframe_counter, current_nbframe,
-                   fitsfileinfo[current_index[camfileidx]].fname, timingfname);*/
-
-            double* timearray = (double*)malloc(sizeof(double) * fitsfileinfo[current_index[camfileidx]].naxes[2]);
+            double* timearray = fitsfileinfo[current_index[camfileidx]].frametime;
             if (timearray == NULL) {
-                // Handle memory allocation failure
-                free(cam_PDIframe[cam_idx]);
-                if (cam_idx > 0) free(cam_PDIframe[0]);
-                return 2;
+                printf("WARNING: no timing data for %s, skipped\n", fitsfileinfo[current_index[camfileidx]].fname);
+                continue;
             }
-
-
-            read_time_data(timingfname,
-                           timearray,
-                           fitsfileinfo[current_index[camfileidx]].naxes[2]);
             // print times
             for (int i = 0; i < fitsfileinfo[current_index[camfileidx]].naxes[2]; i++) {
                 printf("time %4d = %.6f\n", i, timearray[i]);
             }
-            free(timingfname);
 
             printf("WRITING %ld frames\n", fitsfileinfo[current_index[camfileidx]].naxes[2]);
 
@@ -582,8 +622,9 @@ static MILK_HOT errno_t compute_function()
                 cam_PDIframe[cam_idx][camframe_counter].frameindex = frameidx;
                 camframe_counter++;
             }
-            free(timearray);
         }
+        // files without timing data were skipped
+        *nbframe_arr[cam_idx] = camframe_counter;
     }
 
 
@@ -615,8 +656,12 @@ static MILK_HOT errno_t compute_function()
     }
 
 
-    quick_sort2l(cam1frametime, cam1frameindex, cam1nbframe);
-    quick_sort2l(cam2frametime, cam2frameindex, cam2nbframe);
+    // frame times are concatenated per-file sorted runs
+    if (framesort(cam1frametime, cam1frameindex, cam1nbframe, sortnbthread) != 0
+            || framesort(cam2frametime, cam2frameindex, cam2nbframe, sortnbthread) != 0) {
+        fprintf(stderr, "Failed to sort frame times.\n");
+        return 1;
+    }
 
     for(int frame_idx=0; frame_idx<10; frame_idx++)
     {
@@ -625,17 +670,26 @@ static MILK_HOT errno_t compute_function()
                cam2frametime[frame_idx]);
     }
 
-    AlignedPoint* syncseq = (AlignedPoint *)malloc(sizeof(AlignedPoint) * (cam1nbframe+cam2nbframe));
+    // Synchronization table: one row per matched point
+    // column 0: index in cam1frametime, column 1: index in cam2frametime
+    long syncmaxrow = (cam1nbframe < cam2nbframe) ? cam1nbframe : cam2nbframe;
+    int *synctable = (int *)malloc(sizeof(int) * SYNCNBSTREAM * (syncmaxrow > 0 ? syncmaxrow : 1));
 
+    const double *syncstream[SYNCNBSTREAM] = {cam1frametime, cam2frametime};
+    long syncnbpt[SYNCNBSTREAM] = {cam1nbframe, cam2nbframe};
     int nbmatchedpts =
-        synchronize_timestreams2(
-            cam1frametime, cam1nbframe,
-            cam2frametime, cam2nbframe,
-            0.1, syncseq, (cam1nbframe+cam2nbframe));
+        timesync_multiway(
+            syncstream, syncnbpt, SYNCNBSTREAM,
+            synctolerance, synctable, syncmaxrow);
+    printf("%d matched points, tolerance %.4f s\n", nbmatchedpts, synctolerance);
 
 
 
 
+    // half-wave plate angle and time of each matched point
+    double *matchedWPangle = (double *)malloc(sizeof(double) * (nbmatchedpts > 0 ? nbmatchedpts : 1));
+    double *matchedtstamp = (double *)malloc(sizeof(double) * (nbmatchedpts > 0 ? nbmatchedpts : 1));
+
     cam1nbframe = 0;
     cam2nbframe = 0;
     int previndex1 = -1;
@@ -643,7 +697,7 @@ static MILK_HOT errno_t compute_function()
     for(int i=0; i<nbmatchedpts; i++)
     {
         // print unmatched index1
-        while(syncseq[i].index1 - previndex1 > 1) {
+        while(synctable[SYNCNBSTREAM*i] - previndex1 > 1) {
             previndex1++;
             printf("MISSED %5d -----    %.6f ------ \n",
                    previndex1,
@@ -651,7 +705,7 @@ static MILK_HOT errno_t compute_function()
                   );
         }
         // print unmatched index2
-        while(syncseq[i].index2 - previndex2 > 1) {
+        while(synctable[SYNCNBSTREAM*i+1] - previndex2 > 1) {
             previndex2++;
             printf("MISSED ----- %5d    ------ %.6f\n",
                    previndex2,
@@ -660,16 +714,16 @@ static MILK_HOT errno_t compute_function()
         }
 
 
-        int franeidx1 = cam1frameindex[syncseq[i].index1];
-        int franeidx2 = cam2frameindex[syncseq[i].index2];
+        int franeidx1 = cam1frameindex[synctable[SYNCNBSTREAM*i]];
+        int franeidx2 = cam2frameindex[synctable[SYNCNBSTREAM*i+1]];
         // print each matched point
         printf("[%4d]  %4.1f %4.1f   %5d %5d    %.6f %.6f   %6f    (%2d %3d) (%2d %3d)     %s %s\n", i,
                cam_PDIframe[0][franeidx1].WPangle,
                cam_PDIframe[1][franeidx2].WPangle,
-               syncseq[i].index1, syncseq[i].index2,
-               cam1frametime[syncseq[i].index1],
-               cam2frametime[syncseq[i].index2],
-               cam1frametime[syncseq[i].index1]-cam2frametime[syncseq[i].index2],
+               synctable[SYNCNBSTREAM*i], synctable[SYNCNBSTREAM*i+1],
+               cam1frametime[synctable[SYNCNBSTREAM*i]],
+               cam2frametime[synctable[SYNCNBSTREAM*i+1]],
+               cam1frametime[synctable[SYNCNBSTREAM*i]]-cam2frametime[synctable[SYNCNBSTREAM*i+1]],
                cam_PDIframe[0][franeidx1].fileindex, cam_PDIframe[0][franeidx1].frameindex,
                cam_PDIframe[1][franeidx2].fileindex, cam_PDIframe[1][franeidx2].frameindex,
                fitsfileinfo[cam_PDIframe[0][franeidx1].fileindex].fname,
@@ -682,8 +736,11 @@ static MILK_HOT errno_t compute_function()
         fitsfileinfo[cam_PDIframe[0][franeidx1].fileindex].destframeidx[cam_PDIframe[0][franeidx1].frameindex] = i;
         fitsfileinfo[cam_PDIframe[1][franeidx2].fileindex].destframeidx[cam_PDIframe[1][franeidx2].frameindex] = i;
 
-        previndex1 = syncseq[i].index1;
-        previndex2 = syncseq[i].index2;
+        matchedWPangle[i] = cam_PDIframe[0][franeidx1].WPangle;
+        matchedtstamp[i] = cam1frametime[synctable[SYNCNBSTREAM*i]];
+
+        previndex1 = synctable[SYNCNBSTREAM*i];
+        previndex2 = synctable[SYNCNBSTREAM*i+1];
     }
 
 
@@ -693,235 +750,191 @@ static MILK_HOT errno_t compute_function()
     printf("xsize = %ld  ysize = %ld\n", xsize, ysize);
     printf("cropnb = %d\n", cropnb);
 
-    IMGID imgcam1  = imgid_make_from_name_3D("cam1", xsize*cropnb, ysize, nbmatchedpts);
-    imcreateIMGID(&imgcam1);
-
-    IMGID imgcam2  = imgid_make_from_name_3D("cam2", xsize*cropnb, ysize, nbmatchedpts);
-    imcreateIMGID(&imgcam2);
-
-    list_image_ID();
+    CROPGEOM cropgeom[2] = {
+        {xsize, ysize, cropnb, cam1crop_xcenter, cam1crop_ycenter},
+        {xsize, ysize, cropnb, cam2crop_xcenter, cam2crop_ycenter}
+    };
 
-    for(int file_idx=0; file_idx<file_count; file_idx++)
+    // Memory plan: in-core, or out-of-core with file-backed cubes
+    uint32_t SVDmaxNBmode = 2000;
+    long pcanbmode = SVDmaxNBmode;
+    if (pcamode == PCAMODE_RSVD) {
+        pcanbmode = rsvdconf.nbmode + rsvdconf.oversample;
+    }
+    if (pcamode == PCAMODE_GRAM) {
+        pcanbmode = rsvdconf.nbmode;
+    }
+    // PCA and reconstruction stream file-backed cubes, except milk SVD
+    int pcastream = (pcamode != PCAMODE_SVD);
+    MEMPLAN memplan;
     {
-        // read pixel array
-        fitsfile *fptr;     // FITS file pointer
-        int status = 0;     // CFITSIO status value MUST be initialized to 0
-        int bitpix, naxis;
-        long naxes[3];      // Dimensions of the image (NAXIS1, NAXIS2)
-        long fpixel = 1;    // First pixel to read (1-based)
-        long nelements;     // Total number of pixels to read
-        float *buffer;      // Memory buffer to hold the image
-
-        // Open the FITS file for reading
-        if (fits_open_file(&fptr, fitsfileinfo[file_idx].fname, READONLY, &status)) {
-            fits_report_error(stderr, status);
-            return(status);
+        int nbclass = 1;
+        POLANGLECLASS pac;
+        if (POLANGLECLASS_build(&pac, matchedWPangle, nbmatchedpts, pbconf.angletol) == 0) {
+            nbclass = pac.nbclass;
+            POLANGLECLASS_free(&pac);
         }
-        else {
-            // If we get here, status is still 0, meaning the file opened successfully.
-            int total_hdus = 0;
-            // Get the total number of HDUs in the file
-            printf("Getting total number of HDUs\n");
-            if (fits_get_num_hdus(fptr, &total_hdus, &status)) {
-                fits_report_error(stderr, status);
-                fits_close_file(fptr, &status);
-                return(status);
-            }
-            printf("Total number of HDUs: %d\n", total_hdus);
-
-            // move to last HDU
-            printf("Moving to last HDU\n");
-            if (fits_movabs_hdu(fptr, total_hdus, NULL, &status)) {
-                fits_report_error(stderr, status);
-                return(status);
-            }
-
-            // get image size, bitpix
-            printf("Getting image size and bitpix\n");
-            if (fits_get_img_param(fptr, 8, &bitpix, &naxis, naxes, &status)) {
-                fits_report_error(stderr, status);
-                return(status);
-            }
-
-
-
-            // Calculate the total number of pixels
-            nelements = naxes[0] * naxes[1] * naxes[2];
-            printf("Image input size : %ld x %ld x %ld = %ld pixels\n", naxes[0], naxes[1], naxes[2], nelements);
-
-
-            // Allocate memory for the image buffer
-            buffer = (float *) malloc(nelements * sizeof(float));
-            if (buffer == NULL) {
-                printf("Memory allocation error\n");
-                return(1);
-            }
-
-            // Read the entire image into the buffer
-            // TFLOAT specifies that we want the data converted to float in our buffer.
-            if (fits_read_img(fptr, TFLOAT, fpixel, nelements, NULL, buffer, NULL, &status)) {
-                fits_report_error(stderr, status);
-            } else {
-                printf("Image read successfully into buffer.\n");
-                // Example: Print the value of the first pixel
-                printf("Value of the first pixel (1,1): %f\n", buffer[0]);
-            }
-            // Close the FITS file
-            fits_close_file(fptr, &status);
-
-
-
-
-            if(fitsfileinfo[file_idx].selected == 1)
-            {
-                // write pixels to cam1
-                int nbframe = fitsfileinfo[file_idx].naxes[2];
-                for(int frame_idx=0; frame_idx<nbframe; frame_idx++)
-                {
-                    int destframeidx = fitsfileinfo[file_idx].destframeidx[frame_idx];
-                    printf("FILE %s frame %d  -> cam1 frame %d\n", fitsfileinfo[file_idx].fname, frame_idx, destframeidx);
-
-                    for(int crop=0; crop<cropnb; crop++)
-                    {
-                        long ii0offset = cam1crop_xcenter[crop] - xsize/2;
-                        long jj0offset = cam1crop_ycenter[crop] - ysize/2;
-                        long ii1offset = crop * xsize;
-                        long jj1offset = 0;
-
-                        for(long ii=0; ii<xsize; ii++)
-                        {
-                            long ii0 = ii + ii0offset;
-                            long ii1 = ii + ii1offset;
-                            for(long jj=0; jj<ysize; jj++)
-                            {
-                                long jj0 = jj + jj0offset;
-                                long jj1 = jj + jj1offset;
-                                imgcam1.im->array.F[xsize*ysize*cropnb*destframeidx + jj1*xsize*cropnb + ii1] = buffer[naxes[0]*naxes[1]*frame_idx + jj0*naxes[0] + ii0];
-                            }
-
-                        }
-                    }
-                }
-            }
+        double budget = (memorybudgetGB > 0.0) ? 1.0e9 * memorybudgetGB : memplan_defaultbudget();
+        double ingestmem = frameingest_memsize(fitsfileinfo, file_count, cropgeom, &ingestconf);
+        int planstatus = memplan_build(&memplan, nbmatchedpts, xysize, nbclass, pbconf.mode,
+                                       pcanbmode, ingestmem, pcastream, budget, outofcore);
+        memplan_print(&memplan);
+        if (planstatus != 0) {
+            fprintf(stderr, "Data does not fit in memory budget, set outofcore 0 to run in-core anyway\n");
+            return 1;
+        }
+    }
 
-            if(fitsfileinfo[file_idx].selected == 2)
-            {
-                // write pixels to cam2
-                int nbframe = fitsfileinfo[file_idx].naxes[2];
-                for(int frame_idx=0; frame_idx<nbframe; frame_idx++)
-                {
-                    int destframeidx = fitsfileinfo[file_idx].destframeidx[frame_idx];
-                    printf("FILE %s frame %d  -> cam2 frame %d\n", fitsfileinfo[file_idx].fname, frame_idx, destframeidx);
-
-                    for(int crop=0; crop<cropnb; crop++)
-                    {
-                        long ii0offset = cam2crop_xcenter[crop] - xsize/2;
-                        long jj0offset = cam2crop_ycenter[crop] - ysize/2;
-                        long ii1offset = crop * xsize;
-                        long jj1offset = 0;
-
-                        for(long ii=0; ii<xsize; ii++)
-                        {
-                            long ii0 = ii + ii0offset;
-                            long ii1 = ii + ii1offset;
-                            for(long jj=0; jj<ysize; jj++)
-                            {
-                                long jj0 = jj + jj0offset;
-                                long jj1 = jj + jj1offset;
-                                imgcam2.im->array.F[xsize*ysize*cropnb*destframeidx + jj1*xsize*cropnb + ii1] = buffer[naxes[0]*naxes[1]*frame_idx + jj0*naxes[0] + ii0];
-                            }
-
-                        }
-                    }
-                }
+    // In ingest balancing mode, frames are read straight into the balanced
+    // cubes while angle class sums are accumulated, then balanced in place:
+    // raw cubes are not allocated, peak memory is one cube per camera.
+    int pbinplace = (pbconf.mode == POLBALANCE_INGEST);
+
+    // Out-of-core: raw and balanced cubes are scratch files, memory-mapped
+    // and paged in and out by kernel. PCA and reconstruction stream them
+    // by pixel tiles, and write reconstructed cubes to files in scratchdir.
+    // With milk SVD, balanced cubes are copied to images for PCA and
+    // reconstruction, which work on whole cubes in memory.
+    if (memplan.outofcore) {
+        printf("Out-of-core: %s cubes in %s\n", pcastream ? "all" : "ingest and balancing", scratchdir);
+        if (memplan_ramdir(scratchdir)) {
+            printf("WARNING: scratchdir %s is RAM-backed\n", scratchdir);
+        }
+    }
 
+    IMGID imgcam1;
+    IMGID imgcam2;
+    SCRATCHCUBE rawcube[2];
+    memset(rawcube, 0, sizeof(rawcube));
+    float *rawdest[2] = {NULL, NULL};
+    if (!pbinplace && memplan.outofcore) {
+        for (int cam = 0; cam < 2; cam++) {
+            if (SCRATCHCUBE_create(&rawcube[cam], scratchdir, (size_t) xysize * nbmatchedpts) != 0) {
+                perror("Error creating scratch cube");
+                SCRATCHCUBE_close(&rawcube[0]);
+                return 1;
             }
-            // Free the memory
-            free(buffer);
+            rawdest[cam] = rawcube[cam].F;
         }
     }
+    else if (!pbinplace) {
+        imgcam1  = imgid_make_from_name_3D("cam1", xsize*cropnb, ysize, nbmatchedpts);
+        imcreateIMGID(&imgcam1);
 
+        imgcam2  = imgid_make_from_name_3D("cam2", xsize*cropnb, ysize, nbmatchedpts);
+        imcreateIMGID(&imgcam2);
+
+        rawdest[0] = imgcam1.im->array.F;
+        rawdest[1] = imgcam2.im->array.F;
+    }
 
     // Construct a set of polarization-balanced modes
     // For each mode, an average of the opposite polarization states is added
 
     IMGID imgcam1pb  = imgid_make_from_name_3D("cam1pb", xsize*cropnb, ysize, nbmatchedpts);
-    imcreateIMGID(&imgcam1pb);
-
     IMGID imgcam2pb  = imgid_make_from_name_3D("cam2pb", xsize*cropnb, ysize, nbmatchedpts);
-    imcreateIMGID(&imgcam2pb);
-
-
-
-    // Polarization vector for each frame
-    // Define polX and polY arrays for polarization balancing
-    // Both need to be zero on the linear combination of output frames
-    double *polXidx = (double *)malloc(sizeof(double) * nbmatchedpts);
-    double *polYidx = (double *)malloc(sizeof(double) * nbmatchedpts);
-
-    for(int idx=0; idx<nbmatchedpts; idx++)
-    {
-        double WPangle = cam_PDIframe[0][idx].WPangle;
-        polXidx[idx] = cos(4.0*WPangle * M_PI / 180.0);
-        polYidx[idx] = sin(4.0*WPangle * M_PI / 180.0);
+    SCRATCHCUBE pbcube[2];
+    memset(pbcube, 0, sizeof(pbcube));
+    float *pbdest[2] = {NULL, NULL};
+    if (memplan.outofcore) {
+        for (int cam = 0; cam < 2; cam++) {
+            if (SCRATCHCUBE_create(&pbcube[cam], scratchdir, (size_t) xysize * nbmatchedpts) != 0) {
+                perror("Error creating scratch cube");
+                SCRATCHCUBE_close(&pbcube[0]);
+                SCRATCHCUBE_close(&rawcube[0]);
+                SCRATCHCUBE_close(&rawcube[1]);
+                return 1;
+            }
+            pbdest[cam] = pbcube[cam].F;
+        }
+    }
+    else {
+        imcreateIMGID(&imgcam1pb);
+        imcreateIMGID(&imgcam2pb);
+        pbdest[0] = imgcam1pb.im->array.F;
+        pbdest[1] = imgcam2pb.im->array.F;
+        list_image_ID();
     }
 
-    // defines linear combination of input images to create output (polarization balanced) images
-    double *vecarray = (double *)malloc(sizeof(double) * nbmatchedpts);
-    double eps = 1e-6; // don't bother mixing this component if coefficient is below this limit
-
-    for (int idxout = 0; idxout <nbmatchedpts; idxout++) {
+    POLBALANCEACC pbacc;
+    if (pbinplace) {
+        if (POLBALANCEACC_init(&pbacc, matchedWPangle, nbmatchedpts, 2, xysize, pbconf.angletol) != 0) {
+            fprintf(stderr, "Memory allocation error\n");
+            return 1;
+        }
+        ingestconf.framehook = POLBALANCEACC_addframe;
+        ingestconf.framehookarg = &pbacc;
+    }
 
-        double sum_dot_product = 0.0;
-        for (int idxin = 0; idxin <nbmatchedpts; idxin++) {
-            // Compute dot product between 2D polarization vectors idx0 and idx1
-            double dot_product = polXidx[idxin] * polXidx[idxout] + polYidx[idxin] * polYidx[idxout];
-            // only keep points for which dot_product is negative, otherwise set to zero
-            if (dot_product > 0.0) {
-                dot_product = 0.0;
-            }
-            vecarray[idxin] = dot_product;
-            sum_dot_product += dot_product;
-        }
-        // set sum to 1.0 for flux balancing
-        for (int idxin = 0; idxin <nbmatchedpts; idxin++) {
-            vecarray[idxin] /= sum_dot_product;
-        }
-
-
-        // Initialize output to input
-        memcpy(imgcam1pb.im->array.F + idxout * xysize, imgcam1.im->array.F + idxout * xysize, xysize * sizeof(float));
-        memcpy(imgcam2pb.im->array.F + idxout * xysize, imgcam2.im->array.F + idxout * xysize, xysize * sizeof(float));
-
-        // Subtract the vecarray components
-        for (int idxin = 0; idxin <nbmatchedpts; idxin++) {
-            // subtract slice idxin of imgcam1 from slice idxout of imgcam1pb
-            if (fabs(vecarray[idxin]) > eps) {
-                for(long pixi=0; pixi<xysize; pixi++)
-                {
-                    imgcam1pb.im->array.F[idxout*xysize + pixi] += vecarray[idxin] * imgcam1.im->array.F[idxin*xysize + pixi];
-                }
-                for(long pixi=0; pixi<xysize; pixi++)
-                {
-                    imgcam2pb.im->array.F[idxout*xysize + pixi] += vecarray[idxin] * imgcam2.im->array.F[idxin*xysize + pixi];
-                }
+    float *ingestdest[2] = {pbdest[0], pbdest[1]};
+    if (!pbinplace) {
+        ingestdest[0] = rawdest[0];
+        ingestdest[1] = rawdest[1];
+    }
+    {
+        int status = frameingest_run(fitsfileinfo, file_count, cropgeom, ingestdest, &ingestconf);
+        if (status != 0) {
+            if (pbinplace) {
+                POLBALANCEACC_free(&pbacc);
             }
+            SCRATCHCUBE_close(&rawcube[0]);
+            SCRATCHCUBE_close(&rawcube[1]);
+            SCRATCHCUBE_close(&pbcube[0]);
+            SCRATCHCUBE_close(&pbcube[1]);
+            return(status);
         }
-
-        // Multiply by 0.5 to match original flux level
-        for(long pixi=0; pixi<xysize; pixi++)
-        {
-            imgcam1pb.im->array.F[idxout*xysize + pixi] *= 0.5;
-            imgcam2pb.im->array.F[idxout*xysize + pixi] *= 0.5;
+    }
+    // written back to scratch files, streamed in again by balancing
+    SCRATCHCUBE_release(&rawcube[0], 0, rawcube[0].nbelem);
+    SCRATCHCUBE_release(&rawcube[1], 0, rawcube[1].nbelem);
+
+
+    // Both cameras share the frame weights: cam1 and cam2 frames are matched
+    if (pbinplace) {
+        int status = POLBALANCEACC_apply(&pbacc, ingestdest);
+        POLBALANCEACC_free(&pbacc);
+        if (status != 0) {
+            fprintf(stderr, "Polarization balancing failed\n");
+            SCRATCHCUBE_close(&pbcube[0]);
+            SCRATCHCUBE_close(&pbcube[1]);
+            return(status);
         }
-
+    }
+    else {
+        int status = polbalance_run(matchedWPangle, matchedtstamp, nbmatchedpts,
+                                    rawdest, pbdest, 2, xysize, &pbconf);
+        SCRATCHCUBE_close(&rawcube[0]);
+        SCRATCHCUBE_close(&rawcube[1]);
+        if (status != 0) {
+            fprintf(stderr, "Polarization balancing failed\n");
+            SCRATCHCUBE_close(&pbcube[0]);
+            SCRATCHCUBE_close(&pbcube[1]);
+            return(status);
+        }
+    }
+    free(matchedWPangle);
+
+    // Out-of-core milk SVD: balanced cubes to images, one at a time, raw
+    // cubes are freed
+    if (memplan.outofcore && !pcastream) {
+        IMGID *pbimg[2] = {&imgcam1pb, &imgcam2pb};
+        for (int cam = 0; cam < 2; cam++) {
+            imcreateIMGID(pbimg[cam]);
+            memcpy(pbimg[cam]->im->array.F, pbcube[cam].F, sizeof(float) * pbcube[cam].nbelem);
+            SCRATCHCUBE_close(&pbcube[cam]);
+        }
+        list_image_ID();
     }
 
-    free(vecarray);
-    free(polXidx);
-    free(polYidx);
 
 
+    // balanced cubes: scratch files if streamed out-of-core, images otherwise
+    int pbscratch = (memplan.outofcore && pcastream);
+    float *pbF[2] = {pbdest[0], pbdest[1]};
+    if (!pbscratch) {
+        pbF[0] = imgcam1pb.im->array.F;
+        pbF[1] = imgcam2pb.im->array.F;
+    }
 
     // PCA of imgcam1pb
     // modes are in imgU
@@ -932,22 +945,174 @@ static MILK_HOT errno_t compute_function()
     IMGID img1pbV  = imgid_make_from_name("cam1pb_V");
     int GPUdev = -1;
     float SVlimit = 0.0001;
-    uint32_t SVDmaxNBmode = 2000;
     uint64_t compSVDmode = 0; // PCA
     uint32_t Vdim0 = 0;
 
-    compute_SVD(
-        imgcam1pb,
-        &img1pbU,
-        &img1pbS,
-        &img1pbV,
-        Vdim0,
-        SVlimit,
-        SVDmaxNBmode,
-        GPUdev,
-        compSVDmode,
-        "cam1Un", "cam1Vn"
-    );
+    if (pcamode == PCAMODE_RSVD) {
+        // same layout as compute_SVD output: U modes as frames, S, V as nbframe x nbmode
+        RSVDRESULT rsvdres;
+        rsvdconf.SVlimit = SVlimit;
+        if (rsvd_compute(pbF[0], nbmatchedpts, xysize, &rsvdconf, &rsvdres) != 0) {
+            fprintf(stderr, "Randomized SVD failed\n");
+            SCRATCHCUBE_close(&pbcube[0]);
+            SCRATCHCUBE_close(&pbcube[1]);
+            return 1;
+        }
+        long nbmode = rsvdres.nbmode;
+
+        img1pbU = imgid_make_from_name_3D("cam1pb_U", xsize*cropnb, ysize, nbmode);
+        imcreateIMGID(&img1pbU);
+
+        img1pbS.datatype = _DATATYPE_FLOAT;
+        img1pbS.naxis = 1;
+        img1pbS.size[0] = nbmode;
+        imcreateIMGID(&img1pbS);
+
+        img1pbV.datatype = _DATATYPE_FLOAT;
+        img1pbV.naxis = 2;
+        img1pbV.size[0] = nbmatchedpts;
+        img1pbV.size[1] = nbmode;
+        imcreateIMGID(&img1pbV);
+
+        int status = rsvd_getmodes(&rsvdres, img1pbU.im->array.F, img1pbS.im->array.F,
+                                   img1pbV.im->array.F, rsvdconf.nbthread);
+        RSVDRESULT_free(&rsvdres);
+        if (status != 0) {
+            fprintf(stderr, "Randomized SVD failed\n");
+            SCRATCHCUBE_close(&pbcube[0]);
+            SCRATCHCUBE_close(&pbcube[1]);
+            return 1;
+        }
+    }
+    else if (pcamode == PCAMODE_GRAM) {
+        GRAMPCARESULT gramres;
+        rsvdconf.SVlimit = SVlimit;
+        if (grampca_compute(pbF[0], nbmatchedpts, xysize, &rsvdconf, &gramres) != 0) {
+            fprintf(stderr, "Gram matrix PCA failed\n");
+            SCRATCHCUBE_close(&pbcube[0]);
+            SCRATCHCUBE_close(&pbcube[1]);
+            return 1;
+        }
+        long nbmode = gramres.nbmode;
+
+        img1pbU = imgid_make_from_name_3D("cam1pb_U", xsize*cropnb, ysize, nbmode);
+        imcreateIMGID(&img1pbU);
+
+        img1pbS.datatype = _DATATYPE_FLOAT;
+        img1pbS.naxis = 1;
+        img1pbS.size[0] = nbmode;
+        imcreateIMGID(&img1pbS);
+
+        img1pbV.datatype = _DATATYPE_FLOAT;
+        img1pbV.naxis = 2;
+        img1pbV.size[0] = nbmatchedpts;
+        img1pbV.size[1] = nbmode;
+        imcreateIMGID(&img1pbV);
+
+        int status = grampca_getmodes(&gramres, pbF[0], img1pbU.im->array.F,
+                                      img1pbS.im->array.F, img1pbV.im->array.F, rsvdconf.nbthread);
+        GRAMPCARESULT_free(&gramres);
+        if (status != 0) {
+            fprintf(stderr, "Gram matrix PCA failed\n");
+            SCRATCHCUBE_close(&pbcube[0]);
+            SCRATCHCUBE_close(&pbcube[1]);
+            return 1;
+        }
+    }
+    else if (pcamode == PCAMODE_IPCA) {
+        IPCASTATE ipcastate;
+        int loadstatus = IPCASTATE_load(&ipcastate, ipcastatefile);
+        if (loadstatus < 0) {
+            SCRATCHCUBE_close(&pbcube[0]);
+            SCRATCHCUBE_close(&pbcube[1]);
+            return 1;
+        }
+
+        // matched points are time-sorted: frames already folded in come first
+        long nbold = 0;
+        if (loadstatus == 0) {
+            while (nbold < nbmatchedpts && matchedtstamp[nbold] <= ipcastate.lasttstamp) {
+                nbold++;
+            }
+            if (ipcastate.framesize != xysize || ipcastate.nbframe != nbold) {
+                printf("WARNING: %s does not match current data, restarting incremental PCA\n",
+                       ipcastatefile);
+                IPCASTATE_free(&ipcastate);
+                loadstatus = 1;
+            }
+        }
+        if (loadstatus == 1) {
+            ipcastate.framesize = xysize;
+            nbold = 0;
+        }
+        printf("Incremental PCA: %ld frames in %s, %ld new\n",
+               nbold, ipcastatefile, nbmatchedpts - nbold);
+
+        if (ipca_update(&ipcastate, pbF[0] + nbold * xysize, nbmatchedpts - nbold,
+                        rsvdconf.nbmode, ipcaforget, SVlimit, rsvdconf.nbthread) != 0) {
+            fprintf(stderr, "Incremental PCA failed\n");
+            IPCASTATE_free(&ipcastate);
+            SCRATCHCUBE_close(&pbcube[0]);
+            SCRATCHCUBE_close(&pbcube[1]);
+            return 1;
+        }
+        if (nbmatchedpts > nbold) {
+            ipcastate.lasttstamp = matchedtstamp[nbmatchedpts - 1];
+        }
+        // new frames are projected on the updated modes; earlier frames keep
+        // their coefficients unless re-projection is requested, as balancing
+        // over the whole sequence changes them slightly
+        long frame0 = ipcareproject ? 0 : nbold;
+        if (ipca_project(&ipcastate, pbF[0] + frame0 * xysize, frame0,
+                         nbmatchedpts - frame0, rsvdconf.nbthread) != 0) {
+            fprintf(stderr, "Incremental PCA failed\n");
+            IPCASTATE_free(&ipcastate);
+            SCRATCHCUBE_close(&pbcube[0]);
+            SCRATCHCUBE_close(&pbcube[1]);
+            return 1;
+        }
+        if (IPCASTATE_save(&ipcastate, ipcastatefile) != 0) {
+            fprintf(stderr, "Failed to save incremental PCA state to %s\n", ipcastatefile);
+        }
+        long nbmode = ipcastate.nbmode;
+
+        img1pbU = imgid_make_from_name_3D("cam1pb_U", xsize*cropnb, ysize, nbmode);
+        imcreateIMGID(&img1pbU);
+        memcpy(img1pbU.im->array.F, ipcastate.U, sizeof(float) * nbmode * xysize);
+
+        img1pbS.datatype = _DATATYPE_FLOAT;
+        img1pbS.naxis = 1;
+        img1pbS.size[0] = nbmode;
+        imcreateIMGID(&img1pbS);
+        for (long k = 0; k < nbmode; k++) {
+            img1pbS.im->array.F[k] = (float) ipcastate.S[k];
+        }
+
+        img1pbV.datatype = _DATATYPE_FLOAT;
+        img1pbV.naxis = 2;
+        img1pbV.size[0] = nbmatchedpts;
+        img1pbV.size[1] = nbmode;
+        imcreateIMGID(&img1pbV);
+        memcpy(img1pbV.im->array.F, ipcastate.V, sizeof(float) * nbmode * nbmatchedpts);
+
+        IPCASTATE_free(&ipcastate);
+    }
+    else {
+        compute_SVD(
+            imgcam1pb,
+            &img1pbU,
+            &img1pbS,
+            &img1pbV,
+            Vdim0,
+            SVlimit,
+            SVDmaxNBmode,
+            GPUdev,
+            compSVDmode,
+            "cam1Un", "cam1Vn"
+        );
+    }
+
+    free(matchedtstamp);
 
     list_image_ID();
     printf("[%d]\n", __LINE__);
@@ -958,29 +1123,51 @@ static MILK_HOT errno_t compute_function()
     // Compute cam2 mode conterparts to cam1 modes
     IMGID img2pbU = imgid_make_from_name("cam2U");
     IMGID img2pbUS = imgid_make_from_name("cam2US");
-    compute_SVDU(
-        imgcam2pb,
-        img1pbV,
-        img1pbS,
-        &img2pbU,
-        &img2pbUS,
-        GPUdev
-    );
-
-    printf("[%d]\n", __LINE__);
-    fflush(stdout);
-    printf("[%d] img1pbU %s naxis = %d\n", __LINE__, img1pbU.md->name, img1pbU.md->naxis);
-    fflush(stdout);
-
-    printf("RECONSTRUCTING imcam2\n");
-    IMGID img2pbM  = imgid_make_from_name("cam2rec");
-    SVDmkM(
-        img2pbU,
-        img1pbS,
-        img1pbV,
-        &img2pbM,
-        GPUdev
-    );
+    long nbmode = img1pbS.md->size[0];
+    if (pbscratch) {
+        // streamed by pixel tiles: cam2U = V cam2pb / S, cam2rec = cam2U S V^T
+        img2pbU = imgid_make_from_name_3D("cam2U", xsize*cropnb, ysize, nbmode);
+        imcreateIMGID(&img2pbU);
+        img2pbUS = imgid_make_from_name_3D("cam2US", xsize*cropnb, ysize, nbmode);
+        imcreateIMGID(&img2pbUS);
+        if (pcarecon_modes(pbF[1], nbmatchedpts, xysize, img1pbV.im->array.F,
+                           img1pbS.im->array.F, nbmode, img2pbU.im->array.F,
+                           img2pbUS.im->array.F, rsvdconf.nbthread) != 0
+                || polcycle_reconfile(scratchdir, "cam2rec", img2pbU.im->array.F,
+                                      img1pbS.im->array.F, img1pbV.im->array.F, nbmode,
+                                      nbmatchedpts, xysize, rsvdconf.nbthread) != 0) {
+            fprintf(stderr, "Reconstruction failed\n");
+            SCRATCHCUBE_close(&pbcube[0]);
+            SCRATCHCUBE_close(&pbcube[1]);
+            return 1;
+        }
+        SCRATCHCUBE_close(&pbcube[1]);
+    }
+    else {
+        compute_SVDU(
+            imgcam2pb,
+            img1pbV,
+            img1pbS,
+            &img2pbU,
+            &img2pbUS,
+            GPUdev
+        );
+
+        printf("[%d]\n", __LINE__);
+        fflush(stdout);
+        printf("[%d] img1pbU %s naxis = %d\n", __LINE__, img1pbU.md->name, img1pbU.md->naxis);
+        fflush(stdout);
+
+        printf("RECONSTRUCTING imcam2\n");
+        IMGID img2pbM  = imgid_make_from_name("cam2rec");
+        SVDmkM(
+            img2pbU,
+            img1pbS,
+            img1pbV,
+            &img2pbM,
+            GPUdev
+        );
+    }
 
 
     // Reconstruct arbitrary image
@@ -1013,30 +1200,48 @@ static MILK_HOT errno_t compute_function()
     printf("[%d] img1pbU %s naxis = %d\n", __LINE__, img1pbU.md->name, img1pbU.md->naxis);
     fflush(stdout);
 
-    computeSGEMM(
-        imgcam1pb, //imgspots,
-        img1pbU,
-        &img1spotsV,
-        1, 0, GPUdev);
-
-
-    // Reconstruct
-    IMGID img2spots  = imgid_make_from_name("cam2spots");
-    computeSGEMM(
-        img2pbU,
-        img1spotsV,
-        &img2spots,
-        0, 1, GPUdev);
+    if (pbscratch) {
+        img1spotsV.datatype = _DATATYPE_FLOAT;
+        img1spotsV.naxis = 2;
+        img1spotsV.size[0] = nbmatchedpts;
+        img1spotsV.size[1] = nbmode;
+        imcreateIMGID(&img1spotsV);
+        int status = pcarecon_project(pbF[0], nbmatchedpts, xysize, img1pbU.im->array.F,
+                                      nbmode, img1spotsV.im->array.F, rsvdconf.nbthread);
+        SCRATCHCUBE_close(&pbcube[0]);
+
+        // Reconstruct
+        if (status != 0
+                || polcycle_reconfile(scratchdir, "cam2spots", img2pbU.im->array.F, NULL,
+                                      img1spotsV.im->array.F, nbmode, nbmatchedpts, xysize,
+                                      rsvdconf.nbthread) != 0) {
+            fprintf(stderr, "Reconstruction failed\n");
+            return 1;
+        }
+    }
+    else {
+        computeSGEMM(
+            imgcam1pb, //imgspots,
+            img1pbU,
+            &img1spotsV,
+            1, 0, GPUdev);
+
+
+        // Reconstruct
+        IMGID img2spots  = imgid_make_from_name("cam2spots");
+        computeSGEMM(
+            img2pbU,
+            img1spotsV,
+            &img2spots,
+            0, 1, GPUdev);
+    }
 
 
     // Free the allocated memory when done.
     printf("Cleaning up allocated memory...\n");
 
-    // Clean up already allocated filenames
-    for (int i = 0; i < file_count; i++) {
-        free(fitsfileinfo[file_count].kw);
-    }
-    free(fitsfileinfo);
+    // File names, keywords and frame indices are all in catalog arena
+    FITScatalog_free(&catalog);
 
 
     free_config(config, pair_count);
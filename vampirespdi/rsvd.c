@@ -0,0 +1,404 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blockgemm.h"
+#include "rsvd.h"
+
+
+// Relative eigenvalue below which a direction is considered null
+// Vectors are float: Gram eigenvalues below a few float epsilons of the
+// largest one are rounding noise.
+#define RSVD_RANKEPS 1e-6
+
+
+
+
+int rsvd_symeig(
+    double *a,
+    long n,
+    double *eigval,
+    double *eigvec
+)
+{
+    for (long i = 0; i < n; i++) {
+        for (long j = 0; j < n; j++) {
+            eigvec[i * n + j] = (i == j) ? 1.0 : 0.0;
+        }
+    }
+
+    for (int sweep = 0; sweep < 100; sweep++) {
+        double offdiag = 0.0;
+        double diag = 0.0;
+        for (long i = 0; i < n; i++) {
+            diag += a[i * n + i] * a[i * n + i];
+            for (long j = i + 1; j < n; j++) {
+                offdiag += a[i * n + j] * a[i * n + j];
+            }
+        }
+        if (offdiag <= 1e-30 * diag || offdiag == 0.0) {
+            break;
+        }
+
+        for (long p = 0; p < n; p++) {
+            for (long q = p + 1; q < n; q++) {
+                double apq = a[p * n + q];
+                if (fabs(apq) < 1e-300) {
+                    continue;
+                }
+                double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                double t = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0);
+                double s = t * c;
+                for (long k = 0; k < n; k++) {
+                    double akp = a[k * n + p];
+                    double akq = a[k * n + q];
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+                for (long k = 0; k < n; k++) {
+                    double apk = a[p * n + k];
+                    double aqk = a[q * n + k];
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+                for (long k = 0; k < n; k++) {
+                    double vkp = eigvec[k * n + p];
+                    double vkq = eigvec[k * n + q];
+                    eigvec[k * n + p] = c * vkp - s * vkq;
+                    eigvec[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    // sort decreasing, selection sort on columns
+    for (long k = 0; k < n; k++) {
+        eigval[k] = a[k * n + k];
+    }
+    for (long k = 0; k < n; k++) {
+        long kmax = k;
+        for (long k1 = k + 1; k1 < n; k1++) {
+            if (eigval[k1] > eigval[kmax]) {
+                kmax = k1;
+            }
+        }
+        if (kmax != k) {
+            double tmp = eigval[k];
+            eigval[k] = eigval[kmax];
+            eigval[kmax] = tmp;
+            for (long i = 0; i < n; i++) {
+                tmp = eigvec[i * n + k];
+                eigvec[i * n + k] = eigvec[i * n + kmax];
+                eigvec[i * n + kmax] = tmp;
+            }
+        }
+    }
+    return 0;
+}
+
+
+
+
+// xorshift64* generator, standard normal deviates by Box-Muller
+static double rsvd_gauss(
+    uint64_t *state
+)
+{
+    double u[2];
+    for (int k = 0; k < 2; k++) {
+        *state ^= *state >> 12;
+        *state ^= *state << 25;
+        *state ^= *state >> 27;
+        u[k] = ((*state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+    }
+    return sqrt(-2.0 * log(u[0] + 1e-300)) * cos(2.0 * M_PI * u[1]);
+}
+
+
+// One orthonormalization pass, X <- L^-1/2 W^T X
+static long rsvd_orthpass(
+    float *X,
+    long nbvec,
+    long n,
+    int nbthread
+)
+{
+    double *G = (double *) malloc(sizeof(double) * nbvec * nbvec);
+    double *eigval = (double *) malloc(sizeof(double) * nbvec);
+    double *eigvec = (double *) malloc(sizeof(double) * nbvec * nbvec);
+    float *M = (float *) malloc(sizeof(float) * nbvec * nbvec);
+    float *Xo = (float *) malloc(sizeof(float) * nbvec * n);
+    long rank = -1;
+    if (G != NULL && eigval != NULL && eigvec != NULL && M != NULL && Xo != NULL
+            && blockgemm_crossdot(X, nbvec, X, nbvec, n, G, nbthread) == 0
+            && rsvd_symeig(G, nbvec, eigval, eigvec) == 0) {
+        rank = 0;
+        for (long k = 0; k < nbvec; k++) {
+            if (eigval[k] > RSVD_RANKEPS * eigval[0] && eigval[k] > 0.0) {
+                rank++;
+            }
+        }
+        memset(M, 0, sizeof(float) * nbvec * nbvec);
+        for (long k = 0; k < rank; k++) {
+            for (long j = 0; j < nbvec; j++) {
+                M[k * nbvec + j] = (float)(eigvec[j * nbvec + k] / sqrt(eigval[k]));
+            }
+        }
+        const float *src[1] = {X};
+        float *dst[1] = {Xo};
+        if (blockgemm_dense(M, nbvec, nbvec, src, dst, 1, n, nbthread) == 0) {
+            memcpy(X, Xo, sizeof(float) * nbvec * n);
+        } else {
+            rank = -1;
+        }
+    }
+    free(G);
+    free(eigval);
+    free(eigvec);
+    free(M);
+    free(Xo);
+    return rank;
+}
+
+
+long rsvd_orth(
+    float *X,
+    long nbvec,
+    long n,
+    int nbthread
+)
+{
+    // Gram-based pass squares the condition number: orthogonality is
+    // only restored to float accuracy by a second pass on its output
+    long rank = rsvd_orthpass(X, nbvec, n, nbthread);
+    if (rank > 0) {
+        rank = rsvd_orthpass(X, rank, n, nbthread);
+    }
+    return rank;
+}
+
+
+// Y (nbvec x nbframe) = Z A^T, i.e. A projected on rows of Z
+static int rsvd_project(
+    const float *cube,
+    long nbframe,
+    long framesize,
+    const float *Z,
+    long nbvec,
+    float *Y,
+    int nbthread
+)
+{
+    double *Yd = (double *) malloc(sizeof(double) * nbframe * nbvec);
+    if (Yd == NULL) {
+        return -1;
+    }
+    if (blockgemm_crossdot(cube, nbframe, Z, nbvec, framesize, Yd, nbthread) != 0) {
+        free(Yd);
+        return -1;
+    }
+    for (long i = 0; i < nbframe; i++) {
+        for (long j = 0; j < nbvec; j++) {
+            Y[j * nbframe + i] = (float) Yd[i * nbvec + j];
+        }
+    }
+    free(Yd);
+    return 0;
+}
+
+
+// Z (nbvec x framesize) = Y A, combination of frames with rows of Y
+static int rsvd_combine(
+    const float *cube,
+    long nbframe,
+    long framesize,
+    const float *Y,
+    long nbvec,
+    float *Z,
+    int nbthread
+)
+{
+    const float *src[1] = {cube};
+    float *dst[1] = {Z};
+    return blockgemm_dense(Y, nbvec, nbframe, src, dst, 1, framesize, nbthread);
+}
+
+
+
+
+int rsvd_compute(
+    const float *cube,
+    long nbframe,
+    long framesize,
+    const RSVDCONF *conf,
+    RSVDRESULT *res
+)
+{
+    memset(res, 0, sizeof(RSVDRESULT));
+    long maxrank = (nbframe < framesize) ? nbframe : framesize;
+    long l = conf->nbmode + (conf->oversample > 0 ? conf->oversample : 0);
+    if (l > maxrank) {
+        l = maxrank;
+    }
+    if (l < 1 || conf->nbmode < 1) {
+        return -1;
+    }
+    int nbthread = (conf->nbthread > 0) ? conf->nbthread : 1;
+
+    res->nbframe = nbframe;
+    res->framesize = framesize;
+    res->nbvec = l;
+    res->Q = (float *) malloc(sizeof(float) * l * nbframe);
+    res->B = (float *) malloc(sizeof(float) * l * framesize);
+    res->W = (double *) malloc(sizeof(double) * l * l);
+    res->S = (double *) malloc(sizeof(double) * l);
+    double *G = (double *) malloc(sizeof(double) * l * l);
+    if (res->Q == NULL || res->B == NULL || res->W == NULL || res->S == NULL || G == NULL) {
+        free(G);
+        RSVDRESULT_free(res);
+        return -1;
+    }
+
+    // random test vectors, in pixel space
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (long e = 0; e < l * framesize; e++) {
+        res->B[e] = (float) rsvd_gauss(&state);
+    }
+
+    // range finder with power iterations, re-orthonormalized at each pass
+    int status = 0;
+    long rank = l;
+    status |= rsvd_project(cube, nbframe, framesize, res->B, l, res->Q, nbthread);
+    rank = rsvd_orth(res->Q, l, nbframe, nbthread);
+    for (int it = 0; it < conf->poweriter && rank > 0 && status == 0; it++) {
+        status |= rsvd_combine(cube, nbframe, framesize, res->Q, l, res->B, nbthread);
+        if (rsvd_orth(res->B, l, framesize, nbthread) <= 0) {
+            break;
+        }
+        status |= rsvd_project(cube, nbframe, framesize, res->B, l, res->Q, nbthread);
+        rank = rsvd_orth(res->Q, l, nbframe, nbthread);
+    }
+    if (status != 0 || rank < 0) {
+        free(G);
+        RSVDRESULT_free(res);
+        return -1;
+    }
+
+    // B = Q A, small SVD from eigen-decomposition of B B^T
+    if (rsvd_combine(cube, nbframe, framesize, res->Q, l, res->B, nbthread) != 0
+            || blockgemm_crossdot(res->B, l, res->B, l, framesize, G, nbthread) != 0
+            || rsvd_symeig(G, l, res->S, res->W) != 0) {
+        free(G);
+        RSVDRESULT_free(res);
+        return -1;
+    }
+    free(G);
+    for (long k = 0; k < l; k++) {
+        res->S[k] = (res->S[k] > 0.0) ? sqrt(res->S[k]) : 0.0;
+    }
+
+    // modes kept
+    long nbmode = (conf->nbmode < rank) ? conf->nbmode : rank;
+    for (long k = 0; k < nbmode; k++) {
+        if (!(res->S[k] > 0.0) || res->S[k] < conf->SVlimit * res->S[0]) {
+            nbmode = k;
+            break;
+        }
+    }
+    if (conf->energy > 0.0) {
+        double total = 0.0;
+        for (long e = 0; e < nbframe * framesize; e++) {
+            total += (double) cube[e] * cube[e];
+        }
+        double sum = 0.0;
+        long k;
+        for (k = 0; k < nbmode; k++) {
+            sum += res->S[k] * res->S[k];
+            if (sum >= conf->energy * total) {
+                k++;
+                break;
+            }
+        }
+        if (sum < conf->energy * total) {
+            printf("WARNING: %ld modes hold %.6f of squared norm, below energy %.6f\n",
+                   nbmode, (total > 0.0) ? sum / total : 0.0, conf->energy);
+        }
+        nbmode = k;
+    }
+    res->nbmode = nbmode;
+
+    printf("Randomized SVD: %ld x %ld, %ld vectors, %d power iterations, %ld modes\n",
+           nbframe, framesize, l, conf->poweriter, nbmode);
+    return 0;
+}
+
+
+
+
+int rsvd_getmodes(
+    const RSVDRESULT *res,
+    float *U,
+    float *S,
+    float *V,
+    int nbthread
+)
+{
+    long l = res->nbvec;
+    long nbmode = res->nbmode;
+    if (nbmode < 1) {
+        return 0;
+    }
+    if (S != NULL) {
+        for (long k = 0; k < nbmode; k++) {
+            S[k] = (float) res->S[k];
+        }
+    }
+
+    float *M = (float *) malloc(sizeof(float) * nbmode * l);
+    if (M == NULL) {
+        return -1;
+    }
+    int status = 0;
+
+    // spatial modes: U_k = B^T W_k / S_k
+    if (U != NULL) {
+        for (long k = 0; k < nbmode; k++) {
+            for (long j = 0; j < l; j++) {
+                M[k * l + j] = (float)(res->W[j * l + k] / res->S[k]);
+            }
+        }
+        const float *src[1] = {res->B};
+        float *dst[1] = {U};
+        status |= blockgemm_dense(M, nbmode, l, src, dst, 1, res->framesize, nbthread);
+    }
+
+    // temporal coefficients: V_k = Q^T W_k
+    if (V != NULL) {
+        for (long k = 0; k < nbmode; k++) {
+            for (long j = 0; j < l; j++) {
+                M[k * l + j] = (float) res->W[j * l + k];
+            }
+        }
+        const float *src[1] = {res->Q};
+        float *dst[1] = {V};
+        status |= blockgemm_dense(M, nbmode, l, src, dst, 1, res->nbframe, nbthread);
+    }
+
+    free(M);
+    return (status != 0) ? -1 : 0;
+}
+
+
+void RSVDRESULT_free(
+    RSVDRESULT *res
+)
+{
+    free(res->Q);
+    free(res->B);
+    free(res->W);
+    free(res->S);
+    memset(res, 0, sizeof(RSVDRESULT));
+}
@@ -0,0 +1,109 @@
+#ifndef _VAMPIRES_PDI__RSVD_H
+#define _VAMPIRES_PDI__RSVD_H
+
+
+// Randomized truncated SVD of a frame cube
+//
+// The cube A (nbframe x framesize) is decomposed as A ~ V^T S U:
+// U holds spatial modes (framesize each), V temporal coefficients
+// (nbframe each), both mode-major and orthonormal, S singular values in
+// decreasing order.
+// A range finder with l = nbmode + oversample random vectors and
+// poweriter power iterations captures the top modes; every pass over
+// the cube is a multi-threaded blocked product, cost O(nbframe
+// framesize l) per pass.
+
+
+typedef struct {
+    long   nbmode;     // maximum number of modes
+    long   oversample; // additional random vectors
+    int    poweriter;  // number of power iterations
+    double energy;     // if > 0, fewest modes holding this fraction of squared norm
+    double SVlimit;    // drop modes with singular value below SVlimit * first singular value
+    int    nbthread;
+} RSVDCONF;
+
+
+// Decomposition, before mode extraction
+typedef struct {
+    long    nbframe;
+    long    framesize;
+    long    nbvec;     // range dimension l
+    long    nbmode;    // modes kept
+    float  *Q;         // nbvec x nbframe, orthonormal range basis
+    float  *B;         // nbvec x framesize, Q A
+    double *W;         // nbvec x nbvec eigenvectors of B B^T, column k for mode k
+    double *S;         // nbvec singular values
+} RSVDRESULT;
+
+
+
+/**
+ * @brief Eigen-decomposition of symmetric matrix, cyclic Jacobi.
+ *
+ * @param a n x n symmetric matrix, destroyed.
+ * @param n Matrix size.
+ * @param eigval Eigenvalues, decreasing.
+ * @param eigvec n x n, column k (eigvec[i*n + k]) is eigenvector k.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int rsvd_symeig(
+    double *a,
+    long n,
+    double *eigval,
+    double *eigvec
+);
+
+/**
+ * @brief Orthonormalizes vectors in place.
+ *
+ * Rows of X are replaced through eigen-decomposition of their Gram
+ * matrix, X <- L^-1/2 W^T X, in two passes. Directions with eigenvalue
+ * below 1e-6 times the largest (float rounding) are dropped, remaining ones are
+ * moved first.
+ *
+ * @param X nbvec x n vectors.
+ * @return Number of orthonormal vectors, -1 on failure.
+ */
+long rsvd_orth(
+    float *X,
+    long nbvec,
+    long n,
+    int nbthread
+);
+
+/**
+ * @brief Computes randomized truncated SVD of cube.
+ * @param cube nbframe x framesize floats.
+ * @return 0 on success, -1 on failure.
+ */
+int rsvd_compute(
+    const float *cube,
+    long nbframe,
+    long framesize,
+    const RSVDCONF *conf,
+    RSVDRESULT *res
+);
+
+/**
+ * @brief Writes modes of decomposition.
+ *
+ * @param U res->nbmode x framesize spatial modes, may be NULL.
+ * @param S res->nbmode singular values, may be NULL.
+ * @param V res->nbmode x nbframe temporal coefficients, may be NULL.
+ * @return 0 on success, -1 on failure.
+ */
+int rsvd_getmodes(
+    const RSVDRESULT *res,
+    float *U,
+    float *S,
+    float *V,
+    int nbthread
+);
+
+void RSVDRESULT_free(
+    RSVDRESULT *res
+);
+
+
+#endif
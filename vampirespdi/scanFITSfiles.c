@@ -1,144 +1,775 @@
-#include <dirent.h> // opendir
+#include <dirent.h> // DT_DIR
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "fitsio.h"
 #include "scanFITSfiles.h"
+#include "FITScatalog.h"
+#include "FITSindex.h"
+#include "FITSkeylookup.h"
+#include "timingdata.h"
 
 
 
-// scan one file at a time
+
+// getdents64 buffer size
+#define DIRENTBUFFSIZE (1024 * 1024)
+
+// getdents64 record, not exported by glibc headers
+struct linux_dirent64 {
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+
+
+
+int FITSprefilter_parse(
+    FITSprefilter *prefilter,
+    const char *patternlist,
+    int magiccheck
+)
+{
+    memset(prefilter, 0, sizeof(FITSprefilter));
+    prefilter->magiccheck = magiccheck;
+
+    const char *ptr = patternlist;
+    while (*ptr != '\0') {
+        // skip separators
+        while (*ptr == ',' || isspace((unsigned char)*ptr)) {
+            ptr++;
+        }
+        size_t len = 0;
+        while (ptr[len] != '\0' && ptr[len] != ',' && !isspace((unsigned char)ptr[len])) {
+            len++;
+        }
+        if (len == 0) {
+            break;
+        }
+        if (prefilter->nbpattern == FITSPREFILTERMAXPATTERN) {
+            fprintf(stderr, "Too many file name patterns (max %d)\n", FITSPREFILTERMAXPATTERN);
+            return -1;
+        }
+        if (len >= FLEN_FILENAME) {
+            len = FLEN_FILENAME - 1;
+        }
+        memcpy(prefilter->pattern[prefilter->nbpattern], ptr, len);
+        prefilter->pattern[prefilter->nbpattern][len] = '\0';
+        prefilter->nbpattern++;
+        ptr += len;
+    }
+    return 0;
+}
+
+
+
+// returns 1 if name matches any prefilter pattern
+static int prefilter_match(
+    const FITSprefilter *prefilter,
+    const char *name
+)
+{
+    if (prefilter == NULL || prefilter->nbpattern == 0) {
+        return 1;
+    }
+    for (int p = 0; p < prefilter->nbpattern; p++) {
+        if (fnmatch(prefilter->pattern[p], name, 0) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+
+int FITSfile_checkmagic(
+    const char *filename
+)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+    char card[80];
+    ssize_t nbread = pread(fd, card, sizeof(card), 0);
+    close(fd);
+
+    return (nbread == (ssize_t) sizeof(card) && memcmp(card, "SIMPLE  =", 9) == 0);
+}
+
+
+
+
+int FITSkwprojection_parse(
+    FITSkwprojection *proj,
+    const char *keylist,
+    int fullheader
+)
+{
+    memset(proj, 0, sizeof(FITSkwprojection));
+    proj->fullheader = fullheader;
+
+    const char *ptr = keylist;
+    while (*ptr != '\0') {
+        // skip separators
+        while (*ptr == ',' || isspace((unsigned char)*ptr)) {
+            ptr++;
+        }
+        size_t len = 0;
+        while (ptr[len] != '\0' && ptr[len] != ',' && !isspace((unsigned char)ptr[len])) {
+            len++;
+        }
+        if (len == 0) {
+            break;
+        }
+        if (proj->nbkey == FITSPROJMAXKEY) {
+            fprintf(stderr, "Too many keywords in projection (max %d)\n", FITSPROJMAXKEY);
+            return -1;
+        }
+        if (len >= FLEN_KEYWORD) {
+            len = FLEN_KEYWORD - 1;
+        }
+        memcpy(proj->keyname[proj->nbkey], ptr, len);
+        proj->keyname[proj->nbkey][len] = '\0';
+        proj->nbkey++;
+        ptr += len;
+    }
+    return 0;
+}
+
+
+
+uint64_t FITSkwprojection_hash(
+    const FITSkwprojection *proj
+)
+{
+    // FNV-1a over mode and keyword names
+    uint64_t hash = 14695981039346656037ULL;
+    hash = (hash ^ (uint64_t) proj->fullheader) * 1099511628211ULL;
+    if (proj->fullheader) {
+        return hash;
+    }
+    for (int k = 0; k < proj->nbkey; k++) {
+        for (const char *c = proj->keyname[k]; *c != '\0'; c++) {
+            hash = (hash ^ (unsigned char) *c) * 1099511628211ULL;
+        }
+        hash = (hash ^ (unsigned char) ',') * 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+
+int FITSkeyword_parse(
+    const char *card,
+    int hdu,
+    FITSkeyword *kw
+)
+{
+    int status = 0;
+    int klen = 0;
+
+    kw->hdu = hdu;
+    kw->type = 'U';
+    kw->ival = 0;
+    kw->dval = 0.0;
+
+    fits_get_keyname(card, kw->keyname, &klen, &status);
+    fits_parse_value(card, kw->value, kw->comment, &status);
+    if (status != 0) {
+        return status;
+    }
+
+    char dtype = 'U';
+    if (kw->value[0] != '\0' && fits_get_keytype(kw->value, &dtype, &status)) {
+        // undefined or unparsable value
+        kw->type = 'U';
+        return 0;
+    }
+
+    switch (dtype) {
+    case 'C': {
+        // remove quotes, unescape '' and trim trailing blanks
+        char *src = kw->value + 1;
+        char *dst = kw->value;
+        while (*src != '\0') {
+            if (*src == '\'') {
+                if (src[1] != '\'') {
+                    break;
+                }
+                src++;
+            }
+            *dst++ = *src++;
+        }
+        *dst = '\0';
+        while (dst > kw->value && dst[-1] == ' ') {
+            *--dst = '\0';
+        }
+        break;
+    }
+    case 'L':
+        kw->ival = (kw->value[0] == 'T') ? 1 : 0;
+        kw->dval = kw->ival;
+        break;
+    case 'I':
+        kw->ival = strtol(kw->value, NULL, 10);
+        kw->dval = strtod(kw->value, NULL);
+        break;
+    case 'F': {
+        // FITS allows 'D' exponent
+        char tmp[FLEN_VALUE];
+        snprintf(tmp, FLEN_VALUE, "%s", kw->value);
+        for (char *c = tmp; *c != '\0'; c++) {
+            if (*c == 'D' || *c == 'd') {
+                *c = 'E';
+            }
+        }
+        kw->dval = strtod(tmp, NULL);
+        kw->ival = (long) kw->dval;
+        break;
+    }
+    default:
+        break;
+    }
+    kw->type = dtype;
+
+    return 0;
+}
+
+
+
+
+// scan a single file
 // returns 1 if file scanned and FITS file
 // returns 0 if file scanned by not FITS file
-// returns -1 if no more file to scan
-// retruns 2 if erroring
-int scan_nextFITSfiles(
-    char *directory,
-    FITSfileinfo *finfo
+// returns 2 if erroring
+int scan_FITSfile(
+    const char *filename,
+    FITSfileinfo *finfo,
+    const FITSkwprojection *proj,
+    FITSkeyword *kwbuff,
+    int kwbuffsize
 )
 {
-    static int init = 0; // toggles to 1 when starting scan
+    fitsfile *fptr;   // Pointer to the FITS file
+    int status = 0;   // FITSIO status, MUST be initialized to 0
 
-    static int file_count __attribute__((unused)) = 0;
-    static DIR *d;
-    static struct dirent *dir;
+    finfo->fname = NULL;
+    finfo->kw = NULL;
+    finfo->nbkey = 0;
+    finfo->kwhash = NULL;
+    finfo->kwhashsize = 0;
+    finfo->frametime = NULL;
+    finfo->dataoffset = -1;
+    finfo->compressed = 0;
+    finfo->bscale = 1.0;
+    finfo->bzero = 0.0;
 
-    if (init == 0)
-    {
-        init = 1;
-        d = opendir(directory);
+    // Attempt to open the file in read-only mode
+    // The fits_open_file function will try to read the primary header.
+    // If it fails, it will set the status variable to a non-zero value.
+    if (fits_open_file(&fptr, filename, READONLY, &status)) {
+        return 0; // not a FITS file
     }
 
-    if ((dir = readdir(d)) != NULL) {
-        fitsfile *fptr;   // Pointer to the FITS file
-        int status = 0;   // FITSIO status, MUST be initialized to 0
+    // If we get here, status is still 0, meaning the file opened successfully.
+    int total_hdus = 0;
+    // Get the total number of HDUs in the file
+    if (fits_get_num_hdus(fptr, &total_hdus, &status)) {
+        fits_report_error(stderr, status);
+        fits_close_file(fptr, &status);
+        return 2;
+    }
 
-        // assemble full filename from directory and file name
-        size_t path_len = strlen(directory) + 1 + strlen(dir->d_name) + 1;
-        char *filename = (char *)malloc(sizeof(char) * path_len);
-        snprintf(filename, path_len, "%s/%s", directory, dir->d_name);
-
-        //printf("CHECKING file %s\n", filename);
-
-        // Attempt to open the file in read-only mode
-        // The fits_open_file function will try to read the primary header.
-        // If it fails, it will set the status variable to a non-zero value.
-        if (fits_open_file(&fptr, filename, READONLY, &status)) {
-            //printf("'%s' is not a valid FITS file or cannot be opened.\n", filename);
-            //fits_report_error(stderr, status); // Print the detailed error message
-            free(filename);
-            return 0; // not a FITS file
-        }
-        else {
-            // If we get here, status is still 0, meaning the file opened successfully.
-            int total_hdus = 0;
-            // Get the total number of HDUs in the file
-            if (fits_get_num_hdus(fptr, &total_hdus, &status)) {
-                fits_report_error(stderr, status);
-                fits_close_file(fptr, &status);
-                free(filename);
-                return 2; // Exit loop on error
+    // move to last HDU
+    if (fits_movabs_hdu(fptr, total_hdus, NULL, &status)) {
+        fits_report_error(stderr, status);
+        fits_close_file(fptr, &status);
+        return 2;
+    }
+    // get image size, bitpix
+    if (fits_get_img_param(fptr, 8, &finfo->bitpix, &finfo->naxis, finfo->naxes, &status)) {
+        fits_report_error(stderr, status);
+        fits_close_file(fptr, &status);
+        return 2;
+    }
+    // unused axes have size 1, so that a 2D image counts as 1 frame
+    for(int i=finfo->naxis; i<8; i++) {
+        finfo->naxes[i] = 1;
+    }
+
+    // data unit location and scaling, used by direct (mmap) pixel readers
+    LONGLONG headstart, datastart, dataend;
+    if (fits_is_compressed_image(fptr, &status)) {
+        finfo->compressed = 1;
+    }
+    else if (fits_get_hduaddrll(fptr, &headstart, &datastart, &dataend, &status) == 0) {
+        finfo->dataoffset = datastart;
+    }
+    if (fits_read_key(fptr, TDOUBLE, "BSCALE", &finfo->bscale, NULL, &status) == KEY_NO_EXIST) {
+        status = 0;
+    }
+    if (fits_read_key(fptr, TDOUBLE, "BZERO", &finfo->bzero, NULL, &status) == KEY_NO_EXIST) {
+        status = 0;
+    }
+    if (status != 0) {
+        fits_report_error(stderr, status);
+        fits_close_file(fptr, &status);
+        return 2;
+    }
+
+
+    int fullheader = (proj == NULL || proj->fullheader);
+    if (!fullheader && total_hdus > FITSPROJMAXHDU) {
+        total_hdus = FITSPROJMAXHDU;
+    }
+
+    int nbkey = 0;
+    for(int hdu=1; hdu<=total_hdus; hdu++)
+    {
+        // HDU numbers are 1-based
+        if (fits_movabs_hdu(fptr, hdu, NULL, &status)) {
+            fits_report_error(stderr, status);
+            fits_close_file(fptr, &status);
+            return 2;
+        }
+
+        char card[FLEN_CARD];
+
+        if (!fullheader) {
+            // Projection: only look up wanted keywords
+            for (int k = 0; k < proj->nbkey && nbkey < kwbuffsize; k++) {
+                if (fits_read_card(fptr, proj->keyname[k], card, &status)) {
+                    if (status != KEY_NO_EXIST) {
+                        fits_report_error(stderr, status);
+                    }
+                    status = 0;
+                    continue;
+                }
+                if (FITSkeyword_parse(card, hdu, &kwbuff[nbkey]) == 0) {
+                    nbkey++;
+                }
             }
+            continue;
+        }
 
-            // move to last HDU
-            if (fits_movabs_hdu(fptr, total_hdus, NULL, &status)) {
-                fits_report_error(stderr, status);
-                free(filename);
-                return 2; // Exit loop on error
+        // Get the number of header keywords within this hdu
+        int hdunkeys = 0;
+        if (fits_get_hdrspace(fptr, &hdunkeys, NULL, &status)) {
+            fits_report_error(stderr, status);
+            fits_close_file(fptr, &status);
+            return 2;
+        }
+
+        // Loop through each header card
+        for (int i = 1; i <= hdunkeys; i++) {
+            if (nbkey == kwbuffsize) {
+                fprintf(stderr, "Warning: %s has more than %d cards, truncating\n", filename, kwbuffsize);
+                break;
             }
-            // get image size, bitpix
-            if (fits_get_img_param(fptr, 8, &finfo->bitpix, &finfo->naxis, finfo->naxes, &status)) {
+
+            // Read the 80-character card
+            if (fits_read_record(fptr, i, card, &status)) {
                 fits_report_error(stderr, status);
-                free(filename);
-                return 2; // Exit loop on error
+                break;
             }
 
+            // Parse the card into its components
+            FITSkeyword_parse(card, hdu, &kwbuff[nbkey]);
+            nbkey++;
+        }
+    }
 
 
 
+    int close_status = 0;
+    if (fits_close_file(fptr, &close_status)) {
+        fits_report_error(stderr, close_status);
+        return 2;
+    }
 
-            finfo->nbkey = 0;
+    // copy keywords to exact size array
+    finfo->kw = (FITSkeyword *)malloc(sizeof(FITSkeyword) * (nbkey > 0 ? nbkey : 1));
+    if (finfo->kw == NULL) {
+        fprintf(stderr, "Memory allocation failed for %s keywords\n", filename);
+        return 2;
+    }
+    memcpy(finfo->kw, kwbuff, sizeof(FITSkeyword) * nbkey);
+    finfo->nbkey = nbkey;
 
-            for(int hdu=1; hdu<=total_hdus; hdu++)
-            {
-                // HDU numbers are 1-based
-                if (fits_movabs_hdu(fptr, hdu, NULL, &status)) {
-                    fits_report_error(stderr, status);
-                    free(filename);
-                    return 2; // Exit loop on error
-                }
+    finfo->fname = strdup(filename);
+    if (finfo->fname == NULL) {
+        fprintf(stderr, "Memory allocation failed for %s file name\n", filename);
+        return 2;
+    }
+    finfo->selected = 0;
+    finfo->destframeidx = NULL;
 
-                // Get the number of header keywords within this hdu
-                int hdunkeys = 0;
-                if (fits_get_hdrspace(fptr, &hdunkeys, NULL, &status)) {
-                    fits_report_error(stderr, status);
-                    free(filename);
-                    return 2; // Exit loop on error
-                }
+    return 1;
+}
 
-                // Loop through each header card
-                {
-                    char card[FLEN_CARD];
-
-                    for (int i = 1; i <= hdunkeys; i++) {
-                        // Read the 80-character card
-                        if (fits_read_record(fptr, i, card, &status)) {
-                            fits_report_error(stderr, status);
-                            break;
-                        }
-
-                        // Parse the card into its components
-                        int klen = 0;
-                        finfo->kw[finfo->nbkey].hdu = hdu;
-                        fits_get_keyname(card, finfo->kw[finfo->nbkey].keyname, &klen, &status);
-                        fits_parse_value(card, finfo->kw[finfo->nbkey].value, finfo->kw[finfo->nbkey].comment, &status);
-                        finfo->nbkey++;
-                    }
+
+
+
+int FILESTAMP_get(
+    const char *filename,
+    FILESTAMP *stamp
+)
+{
+    struct stat st;
+    if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) {
+        stamp->size = -1;
+        stamp->mtime_ns = 0;
+        return -1;
+    }
+    stamp->size = st.st_size;
+    stamp->mtime_ns = (long long) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return 0;
+}
+
+
+
+
+static int compare_entryname(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+
+int FITSscan_init(
+    FITSscanCTX *ctx,
+    const char *directory,
+    int nbthread,
+    const FITSprefilter *prefilter
+)
+{
+    memset(ctx, 0, sizeof(FITSscanCTX));
+
+    if (directory == NULL) {
+        fprintf(stderr, "No directory to scan\n");
+        return -1;
+    }
+
+    int fd = open(directory, O_RDONLY | O_DIRECTORY);
+    if (fd == -1) {
+        perror("Error opening directory");
+        return -1;
+    }
+
+    char *direntbuff = (char *) malloc(DIRENTBUFFSIZE);
+    if (direntbuff == NULL) {
+        fprintf(stderr, "Memory allocation failed for directory buffer\n");
+        close(fd);
+        return -1;
+    }
+
+    ctx->directory = strdup(directory);
+    if (ctx->directory == NULL) {
+        fprintf(stderr, "Memory allocation failed for directory name\n");
+        free(direntbuff);
+        close(fd);
+        return -1;
+    }
+    ctx->nbthread = (nbthread < 1) ? 1 : nbthread;
+    ctx->magiccheck = (prefilter != NULL) ? prefilter->magiccheck : 0;
+
+    // cfitsio can only be called concurrently if built reentrant
+    if (ctx->nbthread > 1 && !fits_is_reentrant()) {
+        printf("cfitsio not built reentrant: scanning with 1 thread\n");
+        ctx->nbthread = 1;
+    }
+
+    // list directory entries, many per system call
+    long capacity = 0;
+    long nbread;
+    while ((nbread = syscall(SYS_getdents64, fd, direntbuff, DIRENTBUFFSIZE)) > 0) {
+        for (long pos = 0; pos < nbread;) {
+            struct linux_dirent64 *dent = (struct linux_dirent64 *)(direntbuff + pos);
+            pos += dent->d_reclen;
+            ctx->nblisted++;
+
+            // d_type may be DT_UNKNOWN on some filesystems:
+            // those entries are checked with stat by the workers
+            if (dent->d_type == DT_DIR) {
+                continue;
+            }
+            if (!prefilter_match(prefilter, dent->d_name)) {
+                continue;
+            }
+
+            if (ctx->nbentry == capacity) {
+                long new_capacity = (capacity == 0) ? 256 : 2 * capacity;
+                char **temp = realloc(ctx->entryname, sizeof(char *) * new_capacity);
+                if (temp == NULL) {
+                    perror("Failed to reallocate memory");
+                    free(direntbuff);
+                    close(fd);
+                    FITSscan_free(ctx);
+                    return -1;
                 }
+                ctx->entryname = temp;
+                capacity = new_capacity;
+            }
+            ctx->entryname[ctx->nbentry] = strdup(dent->d_name);
+            if (ctx->entryname[ctx->nbentry] == NULL) {
+                fprintf(stderr, "Memory allocation failed for entry name\n");
+                free(direntbuff);
+                close(fd);
+                FITSscan_free(ctx);
+                return -1;
             }
+            ctx->nbentry++;
+        }
+    }
+    free(direntbuff);
+    close(fd);
+    if (nbread < 0) {
+        // partial listing would silently drop files
+        perror("Error reading directory");
+        FITSscan_free(ctx);
+        return -1;
+    }
+
+    // readdir order is filesystem-dependent
+    // sort so that results are deterministic
+    qsort(ctx->entryname, ctx->nbentry, sizeof(char *), compare_entryname);
 
+    ctx->result = (FITSfileinfo *)calloc(ctx->nbentry > 0 ? ctx->nbentry : 1, sizeof(FITSfileinfo));
+    ctx->status = (int *)calloc(ctx->nbentry > 0 ? ctx->nbentry : 1, sizeof(int));
+    if (ctx->result == NULL || ctx->status == NULL) {
+        fprintf(stderr, "Memory allocation failed for scan context\n");
+        FITSscan_free(ctx);
+        return -1;
+    }
+
+    return 0;
+}
 
 
-            int close_status = 0;
-            if (fits_close_file(fptr, &close_status)) {
-                fits_report_error(stderr, close_status);
-                return 2;
+
+
+// scan a single directory entry, without keyword hash table
+// header and frame times are loaded from index if up to date,
+// read from disk otherwise
+// returns same values as scan_FITSfile
+static int scan_entry_data(
+    FITSscanCTX *ctx,
+    const char *filename,
+    FITSfileinfo *finfo,
+    FITSkeyword *kwbuff,
+    int kwbuffsize
+)
+{
+    FILESTAMP fstamp;
+    if (FILESTAMP_get(filename, &fstamp) != 0) {
+        return 0; // not a regular file
+    }
+
+    char tfname[FITSFNAMESTRLEN];
+    FILESTAMP tstamp;
+    if (timing_filename(filename, tfname, FITSFNAMESTRLEN) != 0) {
+        return 2;
+    }
+    FILESTAMP_get(tfname, &tstamp);
+
+    if (ctx->index != NULL) {
+        const FITSindexentry *entry = FITSindex_lookup(ctx->index, filename);
+        if (entry != NULL && FITSindex_match(entry, &fstamp, &tstamp)) {
+            int status = FITSindex_restore(ctx->index, entry, finfo);
+            if (status == 1) {
+                __atomic_fetch_add(&ctx->nbcached, 1, __ATOMIC_RELAXED);
+                return 1;
             }
-            snprintf(finfo->fname, FITSFNAMESTRLEN, "%s", filename);
+        }
+    }
+
+    // cheap signature check before cfitsio open
+    if (ctx->magiccheck && !FITSfile_checkmagic(filename)) {
+        __atomic_fetch_add(&ctx->nbrejected, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    int status = scan_FITSfile(filename, finfo, ctx->proj, kwbuff, kwbuffsize);
+    if (status != 1) {
+        return status;
+    }
+    __atomic_fetch_add(&ctx->nbscanned, 1, __ATOMIC_RELAXED);
+    finfo->fstamp = fstamp;
+    finfo->tstamp = tstamp;
+
+    // frame times, 0.0 for frames missing from timing file
+    // left NULL without usable timing file
+    if (tstamp.size < 0) {
+        fprintf(stderr, "Warning: no timing file %s\n", tfname);
+        return 1;
+    }
+    finfo->frametime = (double *) calloc(finfo->naxes[2], sizeof(double));
+    if (finfo->frametime == NULL) {
+        fprintf(stderr, "Memory allocation failed for %s frame times\n", filename);
+        return 2;
+    }
+    if (read_time_data_mmap(tfname, finfo->frametime, finfo->naxes[2]) != 0) {
+        fprintf(stderr, "Warning: cannot read timing file %s\n", tfname);
+        free(finfo->frametime);
+        finfo->frametime = NULL;
+    }
+
+    return 1;
+}
+
+
+// scan a single directory entry and index its keywords
+static int scan_entry(
+    FITSscanCTX *ctx,
+    const char *filename,
+    FITSfileinfo *finfo,
+    FITSkeyword *kwbuff,
+    int kwbuffsize
+)
+{
+    int status = scan_entry_data(ctx, filename, finfo, kwbuff, kwbuffsize);
+    if (status == 1 && FITSfileinfo_buildkwhash(finfo) != 0) {
+        fprintf(stderr, "Memory allocation failed for %s keyword table\n", filename);
+        return 2;
+    }
+    return status;
+}
+
+
+static void *FITSscan_worker(void *arg)
+{
+    FITSscanCTX *ctx = (FITSscanCTX *)arg;
 
-            printf("✅ '%s' nkey=%d\n", filename, finfo->nbkey);
+    // per-thread scratch header buffer
+    // full header needs room for all cards, projection only for wanted keywords
+    int kwbuffsize = FITSMAXNCARD;
+    if (ctx->proj != NULL && !ctx->proj->fullheader) {
+        kwbuffsize = FITSPROJMAXKEY * FITSPROJMAXHDU;
+    }
+    FITSkeyword *kwbuff = (FITSkeyword *)malloc(sizeof(FITSkeyword) * kwbuffsize);
+    if (kwbuff == NULL) {
+        fprintf(stderr, "Memory allocation failed for keyword buffer\n");
+        return NULL;
+    }
+
+    long entry;
+    while ((entry = __atomic_fetch_add(&ctx->nextentry, 1, __ATOMIC_RELAXED)) < ctx->nbentry) {
+        // assemble full filename from directory and file name
+        size_t path_len = strlen(ctx->directory) + 1 + strlen(ctx->entryname[entry]) + 1;
+        char *filename = (char *)malloc(sizeof(char) * path_len);
+        if (filename == NULL) {
+            ctx->status[entry] = 2;
+            continue;
         }
+        snprintf(filename, path_len, "%s/%s", ctx->directory, ctx->entryname[entry]);
+
+        ctx->status[entry] = scan_entry(ctx, filename, &ctx->result[entry], kwbuff, kwbuffsize);
         free(filename);
-        return 1;
     }
-    else {
-        closedir(d);
-        init = 0;
+
+    free(kwbuff);
+    return NULL;
+}
+
+
+int FITSscan_run(
+    FITSscanCTX *ctx
+)
+{
+    ctx->nextentry = 0;
+    ctx->nbcached = 0;
+    ctx->nbscanned = 0;
+    ctx->nbrejected = 0;
+
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * ctx->nbthread);
+    if (threads == NULL) {
+        fprintf(stderr, "Memory allocation failed for scan threads\n");
         return -1;
     }
+
+    int nbstarted = 0;
+    for (int t = 0; t < ctx->nbthread; t++) {
+        if (pthread_create(&threads[t], NULL, FITSscan_worker, ctx) != 0) {
+            fprintf(stderr, "Failed to start scan thread %d\n", t);
+            break;
+        }
+        nbstarted++;
+    }
+    if (nbstarted == 0) {
+        // no worker could be started: scan in calling thread
+        FITSscan_worker(ctx);
+    }
+    for (int t = 0; t < nbstarted; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+
+    return 0;
+}
+
+
+
+
+long FITSscan_collect(
+    FITSscanCTX *ctx,
+    FITScatalog *catalog
+)
+{
+    long file_count = 0;
+
+    for (long entry = 0; entry < ctx->nbentry; entry++) {
+        if (ctx->status[entry] == 2) {
+            fprintf(stderr, "Error reading %s/%s, skipping\n", ctx->directory, ctx->entryname[entry]);
+            continue;
+        }
+        if (ctx->status[entry] != 1) {
+            continue;
+        }
+
+        FITSfileinfo *finfo = FITScatalog_add(catalog, &ctx->result[entry]);
+        if (finfo == NULL) {
+            return -1;
+        }
+
+        printf("✅ '%s' nkey=%d\n", finfo->fname, finfo->nbkey);
+        file_count++;
+    }
+
+    return file_count;
 }
 
 
 
+void FITSscan_free(
+    FITSscanCTX *ctx
+)
+{
+    for (long entry = 0; entry < ctx->nbentry; entry++) {
+        if (ctx->result != NULL) {
+            free(ctx->result[entry].fname);
+            free(ctx->result[entry].kw);
+            free(ctx->result[entry].kwhash);
+            free(ctx->result[entry].frametime);
+        }
+        free(ctx->entryname[entry]);
+    }
+    free(ctx->entryname);
+    free(ctx->result);
+    free(ctx->status);
+    free(ctx->directory);
+
+    memset(ctx, 0, sizeof(FITSscanCTX));
+}
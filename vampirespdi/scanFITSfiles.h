@@ -1,39 +1,256 @@
 #ifndef _VAMPIRES_PDI__SCANFITSFILES_H
 #define _VAMPIRES_PDI__SCANFITSFILES_H
 
+#include <stdint.h>
 #include <fitsio.h> // FITSIO
 
 #define FITSFNAMESTRLEN 1000
 
+// Maximum number of keywords in single FITS file
+// Used for statically sized per-thread buffer to load one header at a time
+#define FITSMAXNCARD 10000
+
+// Maximum number of keywords in keyword projection
+#define FITSPROJMAXKEY 64
+
+// Maximum number of HDUs searched in keyword projection mode
+#define FITSPROJMAXHDU 16
+
 // FITS keyword entry
+// Value is parsed to its type at scan time
 typedef struct {
     int hdu;
+    char type;    // 'C' string, 'L' logical, 'I' integer, 'F' float, 'U' undefined
+    long ival;    // value of integer and logical keywords
+    double dval;  // value of numeric and logical keywords
     char keyname[FLEN_KEYWORD];
-    char value[FLEN_VALUE];
+    char value[FLEN_VALUE];  // value string, unquoted for type 'C'
     char comment[FLEN_COMMENT];
 } FITSkeyword;
 
 
 
+// Maximum number of file name patterns in prefilter
+#define FITSPREFILTERMAXPATTERN 16
+
+// Directory entry prefilter
+// Applied before files are opened with cfitsio
+typedef struct {
+    int  nbpattern;   // 0: all names accepted
+    char pattern[FITSPREFILTERMAXPATTERN][FLEN_FILENAME]; // fnmatch globs, e.g. "*.fits"
+    int  magiccheck;  // 1: file must start with "SIMPLE  ="
+} FITSprefilter;
+
+
+
+// Keyword projection
+// Selects which keywords are extracted from headers at scan time
+typedef struct {
+    int  fullheader; // 1: extract all cards (debugging), keyname list is ignored
+    int  nbkey;
+    char keyname[FITSPROJMAXKEY][FLEN_KEYWORD];
+} FITSkwprojection;
+
+
+
+// File identity used to detect changes on disk
+typedef struct {
+    long long size;     // file size in bytes, -1 if file does not exist
+    long long mtime_ns; // modification time, ns since epoch
+} FILESTAMP;
+
+
+
 // Structure holding basic info about FITS files
 // File name on disk and header info
 typedef struct {
-    char fname[FITSFNAMESTRLEN];
+    char *fname;
     int bitpix;
     int naxis;
     long naxes[8]; // max 8 dim
+
+    // image data unit (last HDU)
+    long long dataoffset; // byte offset of data unit in file, -1 if unknown
+    int    compressed;    // 1: tile-compressed image
+    double bscale;        // BSCALE, 1 if absent
+    double bzero;         // BZERO, 0 if absent
+
     int  nbkey;
     FITSkeyword *kw;
-    int selected; // selection flag, -1 if not selected
+    int *kwhash;    // keyword hash table, indices in kw, -1 if empty slot
+    int  kwhashsize; // power of 2, 0 if not built
+    int selected; // selection flag: camera index (1 or 2), 0 if not selected
     int *destframeidx; // array of destination frame indices
+
+    FILESTAMP fstamp;  // FITS file stamp at scan time
+    FILESTAMP tstamp;  // timing file stamp at scan time
+    double *frametime; // per-frame time from timing file, naxes[2] entries, NULL without timing file
 } FITSfileinfo;
 
 
 
+struct FITSindex;
+struct FITScatalog;
+typedef struct FITScatalog FITScatalog;
+
+// Scan context
+// Holds all state of a directory scan, so that multiple scans can run
+// independently. Directory entries are listed and sorted up front, then
+// headers are read concurrently by a pool of worker threads, each
+// writing to the result slot of the entry it claimed.
+typedef struct {
+    char *directory;
+    int   nbthread;
+
+    long   nbentry;     // number of directory entries passing name filter
+    char **entryname;   // entry names, sorted alphabetically
+    long   nblisted;    // number of directory entries listed
+
+    int    magiccheck;  // check FITS signature before cfitsio open
+
+    FITSfileinfo *result; // one slot per entry
+    int          *status; // per entry: 1 FITS, 0 not FITS, 2 error
+
+    long nextentry;     // next entry to be claimed by a worker
+
+    // keywords to extract, NULL for full header
+    const FITSkwprojection *proj;
+
+    // optional header index cache, NULL if not used
+    // entries matching path, size and mtime are loaded from index
+    const struct FITSindex *index;
+    long nbcached;      // number of FITS files loaded from index
+    long nbscanned;     // number of FITS files read from disk
+    long nbrejected;    // number of entries failing FITS signature check
+} FITSscanCTX;
+
+
+
+/**
+ * @brief Builds prefilter from comma- or space-separated glob list.
+ * @param patternlist File name globs, e.g. "*.fits,*.fits.fz". Empty or "*" for all.
+ * @param magiccheck If 1, files must start with FITS signature.
+ * @return 0 on success, -1 if too many patterns.
+ */
+int FITSprefilter_parse(
+    FITSprefilter *prefilter,
+    const char *patternlist,
+    int magiccheck
+);
+
+/**
+ * @brief Checks if file starts with FITS signature.
+ *
+ * Reads the first 80-byte card only, much cheaper than fits_open_file.
+ *
+ * @return 1 if file starts with "SIMPLE  =", 0 otherwise.
+ */
+int FITSfile_checkmagic(
+    const char *filename
+);
+
+/**
+ * @brief Builds keyword projection from comma- or space-separated list.
+ * @param keylist Keyword names, e.g. "DETECTOR,RET-ANG1,MJD".
+ * @param fullheader If 1, all cards are extracted.
+ * @return 0 on success, -1 if too many keywords.
+ */
+int FITSkwprojection_parse(
+    FITSkwprojection *proj,
+    const char *keylist,
+    int fullheader
+);
+
+/**
+ * @brief Hash identifying projection, used to validate cached headers.
+ */
+uint64_t FITSkwprojection_hash(
+    const FITSkwprojection *proj
+);
+
+/**
+ * @brief Parses a header card into a typed keyword entry.
+ * @return 0 on success, cfitsio status otherwise.
+ */
+int FITSkeyword_parse(
+    const char *card,
+    int hdu,
+    FITSkeyword *kw
+);
+
+/**
+ * @brief Reads header information of a single FITS file.
+ *
+ * Reentrant: all state is held in arguments.
+ *
+ * @param filename Full path to the file.
+ * @param finfo Output structure. finfo->fname and finfo->kw are allocated on success.
+ * @param proj Keywords to extract, NULL or proj->fullheader for all cards.
+ * @param kwbuff Scratch keyword buffer.
+ * @param kwbuffsize Size of kwbuff, extra keywords are dropped.
+ * @return 1 if FITS file, 0 if not a FITS file, 2 on error.
+ */
+int scan_FITSfile(
+    const char *filename,
+    FITSfileinfo *finfo,
+    const FITSkwprojection *proj,
+    FITSkeyword *kwbuff,
+    int kwbuffsize
+);
+
+/**
+ * @brief Reads size and modification time of a file.
+ * @return 0 if regular file, -1 otherwise (stamp size set to -1).
+ */
+int FILESTAMP_get(
+    const char *filename,
+    FILESTAMP *stamp
+);
+
+/**
+ * @brief Initializes scan context: lists and sorts directory entries.
+ *
+ * Entries are listed with batched getdents64 calls. Directories and
+ * names not matching prefilter patterns are dropped at this stage.
+ *
+ * @param nbthread Number of worker threads reading headers.
+ * @param prefilter Entry prefilter, NULL to consider all entries.
+ * ctx->proj and ctx->index may be set between FITSscan_init and FITSscan_run.
+ * @return 0 on success, -1 on failure.
+ */
+int FITSscan_init(
+    FITSscanCTX *ctx,
+    const char *directory,
+    int nbthread,
+    const FITSprefilter *prefilter
+);
+
+/**
+ * @brief Reads all entry headers using the context worker pool.
+ * @return 0 on success, -1 on failure.
+ */
+int FITSscan_run(
+    FITSscanCTX *ctx
+);
+
+/**
+ * @brief Appends FITS file entries to catalog, in directory entry order.
+ *
+ * Entries are copied to the catalog arena; the context keeps ownership
+ * of its own arrays until FITSscan_free.
+ *
+ * @return Number of FITS files added to catalog, -1 on allocation failure.
+ */
+long FITSscan_collect(
+    FITSscanCTX *ctx,
+    FITScatalog *catalog
+);
 
-int scan_nextFITSfiles(
-    char *directory,
-    FITSfileinfo *finfo
+/**
+ * @brief Frees scan context, including entries not collected.
+ */
+void FITSscan_free(
+    FITSscanCTX *ctx
 );
 
 
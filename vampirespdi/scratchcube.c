@@ -0,0 +1,113 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scratchcube.h"
+
+
+
+
+// Sizes and maps open file as cube
+static int scratchcube_map(
+    SCRATCHCUBE *sc,
+    int fd,
+    size_t nbelem
+)
+{
+    size_t size = sizeof(float) * (nbelem > 0 ? nbelem : 1);
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    sc->F = (float *) map;
+    sc->nbelem = nbelem;
+    sc->fd = fd;
+    return 0;
+}
+
+
+int SCRATCHCUBE_create(
+    SCRATCHCUBE *sc,
+    const char *dir,
+    size_t nbelem
+)
+{
+    memset(sc, 0, sizeof(SCRATCHCUBE));
+    sc->fd = -1;
+
+    char fname[4096];
+    snprintf(fname, sizeof(fname), "%s/vampirespdi_scratch_XXXXXX", dir);
+    int fd = mkstemp(fname);
+    if (fd == -1) {
+        return -1;
+    }
+    unlink(fname);
+    return scratchcube_map(sc, fd, nbelem);
+}
+
+
+int SCRATCHCUBE_createfile(
+    SCRATCHCUBE *sc,
+    const char *fname,
+    size_t nbelem
+)
+{
+    memset(sc, 0, sizeof(SCRATCHCUBE));
+    sc->fd = -1;
+
+    int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+    return scratchcube_map(sc, fd, nbelem);
+}
+
+
+void SCRATCHCUBE_release(
+    SCRATCHCUBE *sc,
+    size_t elem0,
+    size_t n
+)
+{
+    if (sc->F == NULL || n == 0) {
+        return;
+    }
+    long pagesize = sysconf(_SC_PAGESIZE);
+    size_t start = sizeof(float) * elem0;
+    size_t end = sizeof(float) * (elem0 + n);
+    // whole pages within range only
+    start = (start + pagesize - 1) / pagesize * pagesize;
+    end = end / pagesize * pagesize;
+    if (end <= start) {
+        return;
+    }
+    char *addr = (char *) sc->F + start;
+    msync(addr, end - start, MS_SYNC);
+    madvise(addr, end - start, MADV_DONTNEED);
+    posix_fadvise(sc->fd, start, end - start, POSIX_FADV_DONTNEED);
+}
+
+
+void SCRATCHCUBE_close(
+    SCRATCHCUBE *sc
+)
+{
+    // file descriptor is valid only while mapped
+    if (sc->F != NULL) {
+        munmap(sc->F, sizeof(float) * (sc->nbelem > 0 ? sc->nbelem : 1));
+        close(sc->fd);
+    }
+    sc->F = NULL;
+    sc->nbelem = 0;
+    sc->fd = -1;
+}
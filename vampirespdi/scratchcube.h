@@ -0,0 +1,63 @@
+#ifndef _VAMPIRES_PDI__SCRATCHCUBE_H
+#define _VAMPIRES_PDI__SCRATCHCUBE_H
+
+#include <stddef.h>
+
+
+// Float cube backed by a memory-mapped scratch file
+// The file is unlinked as soon as it is created, so its disk space is
+// returned when the cube is closed or the process exits. Output cubes
+// may instead be created in a named file, kept after close. Pages written
+// are flushed to the file by the kernel under memory pressure, so the
+// cube may be much larger than RAM.
+typedef struct {
+    float *F;       // NULL if not mapped
+    size_t nbelem;
+    int    fd;
+} SCRATCHCUBE;
+
+
+/**
+ * @brief Creates zero-filled scratch cube of nbelem floats in directory dir.
+ * @return 0 on success, -1 on failure (errno set).
+ */
+int SCRATCHCUBE_create(
+    SCRATCHCUBE *sc,
+    const char *dir,
+    size_t nbelem
+);
+
+/**
+ * @brief Creates zero-filled cube of nbelem floats in file fname, kept after close.
+ *
+ * Raw floats, frame-major, native byte order.
+ * @return 0 on success, -1 on failure (errno set).
+ */
+int SCRATCHCUBE_createfile(
+    SCRATCHCUBE *sc,
+    const char *fname,
+    size_t nbelem
+);
+
+/**
+ * @brief Writes back and drops pages of elements [elem0, elem0+n) from memory.
+ *
+ * Content is kept in the scratch file and read back on next access.
+ */
+void SCRATCHCUBE_release(
+    SCRATCHCUBE *sc,
+    size_t elem0,
+    size_t n
+);
+
+/**
+ * @brief Unmaps cube and frees scratch file.
+ *
+ * No-op on a zero-filled or already closed SCRATCHCUBE.
+ */
+void SCRATCHCUBE_close(
+    SCRATCHCUBE *sc
+);
+
+
+#endif
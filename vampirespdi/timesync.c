@@ -0,0 +1,165 @@
+#include <float.h>  // DBL_MAX
+#include <math.h>   // fabs
+#include <stdlib.h>
+
+#include "timesync.h"
+
+
+
+
+// Two-stream kernel
+// Loop body has no data-dependent branch: pointer increments and output
+// count are computed from comparison results.
+static long timesync_2(
+    const double *time1,
+    long nbpoint1,
+    const double *time2,
+    long nbpoint2,
+    double tolerance,
+    int *idxtable,
+    long maxrow
+)
+{
+    long i = 0; // Pointer for stream 1
+    long j = 0; // Pointer for stream 2
+    long aligned_count = 0;
+
+    while (i < nbpoint1 && j < nbpoint2 && aligned_count < maxrow) {
+        double t1 = time1[i];
+        double t2 = time2[j];
+        double abs_time_diff = fabs(t1 - t2);
+
+        // Look-ahead differences, DBL_MAX at end of stream
+        double next_diff1 = (i + 1 < nbpoint1) ? fabs(time1[i + 1] - t2) : DBL_MAX;
+        double next_diff2 = (j + 1 < nbpoint2) ? fabs(t1 - time2[j + 1]) : DBL_MAX;
+
+        int inwindow = (abs_time_diff <= tolerance);
+        int match = inwindow & (abs_time_diff <= next_diff1) & (abs_time_diff <= next_diff2);
+        int prefer1 = (next_diff1 < next_diff2);
+        int early1 = (t1 < t2);
+
+        // in window: advance both on match, else the stream with better look-ahead
+        // out of window: advance the earlier stream
+        int adv1 = inwindow ? (match | prefer1) : early1;
+        int adv2 = inwindow ? (match | !prefer1) : !early1;
+
+        // row written unconditionally, kept only if match
+        idxtable[2 * aligned_count] = (int) i;
+        idxtable[2 * aligned_count + 1] = (int) j;
+        aligned_count += match;
+
+        i += adv1;
+        j += adv2;
+    }
+
+    return aligned_count;
+}
+
+
+
+
+// General K-stream kernel
+static long timesync_K(
+    const double *const *tstream,
+    const long *nbpt,
+    int K,
+    double tolerance,
+    int *idxtable,
+    long maxrow
+)
+{
+    long *head = (long *) calloc(K, sizeof(long));
+    if (head == NULL) {
+        return 0;
+    }
+
+    long aligned_count = 0;
+    while (aligned_count < maxrow) {
+        int done = 0;
+        for (int k = 0; k < K; k++) {
+            done |= (head[k] >= nbpt[k]);
+        }
+        if (done) {
+            break;
+        }
+
+        // min, second min and max of head times
+        int kmin = 0;
+        double tmin = DBL_MAX;
+        double tmin2 = DBL_MAX;
+        double tmax = -DBL_MAX;
+        for (int k = 0; k < K; k++) {
+            double t = tstream[k][head[k]];
+            if (t < tmin) {
+                tmin2 = tmin;
+                tmin = t;
+                kmin = k;
+            } else if (t < tmin2) {
+                tmin2 = t;
+            }
+            tmax = (t > tmax) ? t : tmax;
+        }
+        double spread = tmax - tmin;
+
+        if (spread > tolerance) {
+            // earliest head cannot be matched
+            head[kmin]++;
+            continue;
+        }
+
+        // Look-ahead: spread if stream k is advanced
+        // Next time is >= current, so only max can grow, and min only
+        // changes if k holds the minimum
+        int kbest = -1;
+        double bestspread = spread;
+        for (int k = 0; k < K; k++) {
+            if (head[k] + 1 >= nbpt[k]) {
+                continue;
+            }
+            double tnext = tstream[k][head[k] + 1];
+            double newmax = (tnext > tmax) ? tnext : tmax;
+            double newmin = (k == kmin) ? ((tnext < tmin2) ? tnext : tmin2) : tmin;
+            double newspread = newmax - newmin;
+            // ties resolved towards last stream, as in two-stream case
+            if (newspread < spread && newspread <= bestspread) {
+                bestspread = newspread;
+                kbest = k;
+            }
+        }
+
+        if (kbest >= 0) {
+            head[kbest]++;
+            continue;
+        }
+
+        for (int k = 0; k < K; k++) {
+            idxtable[aligned_count * K + k] = (int) head[k];
+            head[k]++;
+        }
+        aligned_count++;
+    }
+
+    free(head);
+    return aligned_count;
+}
+
+
+
+
+long timesync_multiway(
+    const double *const *tstream,
+    const long *nbpt,
+    int K,
+    double tolerance,
+    int *idxtable,
+    long maxrow
+)
+{
+    if (K < 1) {
+        return 0;
+    }
+    if (K == 2) {
+        return timesync_2(tstream[0], nbpt[0], tstream[1], nbpt[1], tolerance, idxtable, maxrow);
+    }
+    return timesync_K(tstream, nbpt, K, tolerance, idxtable, maxrow);
+}
@@ -0,0 +1,41 @@
+#ifndef _VAMPIRES_PDI__TIMESYNC_H
+#define _VAMPIRES_PDI__TIMESYNC_H
+
+
+/**
+ * @brief Synchronizes K sorted time streams.
+ *
+ * Finds one-to-one matches across K streams of time-stamped data in a
+ * single linear pass over all streams. A match (row) takes one point
+ * from each stream, with spread max(t) - min(t) <= tolerance.
+ *
+ * At each step, with heads h[k] of all streams:
+ * - if the spread of head times exceeds tolerance, the earliest head
+ *   cannot be matched and is advanced.
+ * - otherwise, if advancing one stream would reduce the spread, that
+ *   stream is advanced (look-ahead); if not, the heads form a row and
+ *   all streams are advanced.
+ * For K = 2 this is the greedy two-pointer algorithm of the previous
+ * synchronize_timestreams2, which it replaces; a dedicated branch-light
+ * kernel is used in that case.
+ *
+ * @param tstream Array of K time arrays, each sorted ascending.
+ * @param nbpt Array of K stream lengths.
+ * @param K Number of streams.
+ * @param tolerance Maximum time spread within a row.
+ * @param idxtable Output row-major table, row r holds the K stream indices
+ *                 at idxtable[r*K .. r*K+K-1].
+ * @param maxrow Capacity of idxtable, in rows.
+ * @return Number of rows written to idxtable.
+ */
+long timesync_multiway(
+    const double *const *tstream,
+    const long *nbpt,
+    int K,
+    double tolerance,
+    int *idxtable,
+    long maxrow
+);
+
+
+#endif
@@ -0,0 +1,336 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "timingdata.h"
+
+
+
+
+int timing_filename(const char *fitsfname, char *tfname, size_t len)
+{
+    if (strlen(fitsfname) >= len) {
+        return -1;
+    }
+    strcpy(tfname, fitsfname);
+
+    char *dot_fits_ptr = strstr(tfname, ".fits");
+    if (dot_fits_ptr != NULL) {
+        // ".txt" is shorter than ".fits": no overflow
+        strcpy(dot_fits_ptr, ".txt");
+    }
+    return 0;
+}
+
+
+
+
+int read_time_data(const char *filename, double *time_array, size_t array_size) {
+    // Open the file for reading ("r" mode)
+    FILE *file_ptr = fopen(filename, "r");
+    if (file_ptr == NULL) {
+        perror("Error opening file");
+        return -1; // Indicate failure
+    }
+
+    char line_buffer[256]; // Buffer to hold one line of the file
+    int line_number = 0;
+
+    // Read the file line by line until the end
+    while (fgets(line_buffer, sizeof(line_buffer), file_ptr) != NULL) {
+        line_number++;
+
+        // Skip comment lines (which start with '#') or empty lines
+        if (line_buffer[0] == '#' || line_buffer[0] == '\n') {
+            continue;
+        }
+
+        int frame_index;
+        double absolute_time;
+
+        // Use sscanf to parse the line.
+        // The '%*...' format specifiers read a value but discard it (assignment suppression).
+        // We only care about the 1st (%d) and 5th (%lf) values.
+        int items_scanned = sscanf(line_buffer, "%d %*d %*f %*f %lf %*d %*d",
+                                   &frame_index, &absolute_time);
+
+        // A correctly formatted data line will result in 2 successfully scanned items.
+        if (items_scanned == 2) {
+            // CRITICAL: Perform a bounds check before writing to the array.
+            if (frame_index >= 0 && (size_t)frame_index < array_size) {
+                time_array[frame_index] = absolute_time;
+            } else {
+                fprintf(stderr, "Warning: Index %d on line %d is out of bounds for array of size %zu. Skipping.\n",
+                        frame_index, line_number, array_size);
+            }
+        }
+    }
+
+    // Close the file stream
+    fclose(file_ptr);
+
+    return 0; // Indicate success
+}
+
+
+
+
+
+// Exact powers of 10 in double precision
+static const double pow10tab[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+// Powers of 5, exact in 64 bits
+static const uint64_t pow5tab[] = {
+    1ULL, 5ULL, 25ULL, 125ULL, 625ULL, 3125ULL, 15625ULL, 78125ULL, 390625ULL,
+    1953125ULL, 9765625ULL, 48828125ULL, 244140625ULL, 1220703125ULL,
+    6103515625ULL, 30517578125ULL, 152587890625ULL, 762939453125ULL,
+    3814697265625ULL, 19073486328125ULL, 95367431640625ULL,
+    476837158203125ULL, 2384185791015625ULL
+};
+
+
+static inline int is_blank(char c)
+{
+    return (c == ' ' || c == '\t' || c == '\r');
+}
+
+
+// skip one whitespace-separated token and following blanks
+static inline const char *skip_token(const char *ptr, const char *end)
+{
+    while (ptr < end && !is_blank(*ptr) && *ptr != '\n') {
+        ptr++;
+    }
+    while (ptr < end && is_blank(*ptr)) {
+        ptr++;
+    }
+    return ptr;
+}
+
+
+// parse decimal integer
+// returns pointer past number, NULL if no digit
+static inline const char *parse_int(const char *ptr, const char *end, long *value)
+{
+    int neg = 0;
+    if (ptr < end && (*ptr == '-' || *ptr == '+')) {
+        neg = (*ptr == '-');
+        ptr++;
+    }
+    const char *start = ptr;
+    long v = 0;
+    while (ptr < end && (unsigned)(*ptr - '0') < 10) {
+        v = 10 * v + (*ptr - '0');
+        ptr++;
+    }
+    if (ptr == start) {
+        return NULL;
+    }
+    *value = neg ? -v : v;
+    return ptr;
+}
+
+
+#ifdef __SIZEOF_INT128__
+// Correctly rounded mantissa / 10^nbfrac, for mantissa > 0, nbfrac <= 22
+// 10^q = 5^q 2^q: the quotient by 5^q is computed in 128-bit integer
+// arithmetic with at least 54 significant bits, then rounded to nearest
+// even with the remainder as sticky bit. The power of 2 goes to the
+// exponent. Exact for any 64-bit mantissa, e.g. 19-digit unix times.
+static inline double decimal_to_double(uint64_t mantissa, int nbfrac)
+{
+    int lz = __builtin_clzll(mantissa);
+    uint64_t div = pow5tab[nbfrac];
+    // bit length of 5^nbfrac, at most 52
+    int nbdiv = 64 - __builtin_clzll(div);
+    // numerator (mantissa << lz) << shift, below 2^(64 + shift) <= 2^107
+    int shift = nbdiv - 9;
+    if (shift < 0) {
+        shift = 0;
+    }
+    unsigned __int128 num = (unsigned __int128)(mantissa << lz) << shift;
+    unsigned __int128 quot = num / div;
+    int sticky = (num - quot * div) != 0;
+
+    // quotient has 54 to 64 bits: keep 53
+    uint64_t q = (uint64_t) quot;
+    int extra = (64 - __builtin_clzll(q)) - 53;
+    uint64_t m = q >> extra;
+    uint64_t rem = q & ((1ULL << extra) - 1);
+    uint64_t half = 1ULL << (extra - 1);
+    if (rem > half || (rem == half && (sticky || (m & 1)))) {
+        m++;
+        if (m == (1ULL << 53)) {
+            m >>= 1;
+            extra++;
+        }
+    }
+
+    // value = m 2^e, m in [2^52, 2^53): normal double
+    int e = extra - shift - lz - nbfrac;
+    uint64_t bits = ((uint64_t)(e + 52 + 1023) << 52) | (m & ((1ULL << 52) - 1));
+    double v;
+    memcpy(&v, &bits, sizeof(double));
+    return v;
+}
+#endif
+
+
+// parse floating point number
+// Fast path: plain decimal with up to 15 significant digits, which is
+// exact in the mantissa, divided once by an exact power of 10: the result
+// is correctly rounded, same as strtod. Up to 19 significant digits
+// (unix times at us or ns resolution) are converted in integer
+// arithmetic by decimal_to_double, also correctly rounded.
+// Other forms (exponent, more digits, inf/nan) fall back to strtod.
+// returns pointer past number, NULL if not a number
+static inline const char *parse_double(const char *ptr, const char *end, double *value)
+{
+    const char *start = ptr;
+    int neg = 0;
+    if (ptr < end && (*ptr == '-' || *ptr == '+')) {
+        neg = (*ptr == '-');
+        ptr++;
+    }
+
+    uint64_t mantissa = 0;
+    int nbdigit = 0;
+    int nbfrac = 0;
+    while (ptr < end && (unsigned)(*ptr - '0') < 10) {
+        mantissa = 10 * mantissa + (*ptr - '0');
+        nbdigit += (mantissa != 0);
+        ptr++;
+    }
+    if (ptr < end && *ptr == '.') {
+        ptr++;
+        while (ptr < end && (unsigned)(*ptr - '0') < 10) {
+            mantissa = 10 * mantissa + (*ptr - '0');
+            nbdigit += (mantissa != 0);
+            nbfrac++;
+            ptr++;
+        }
+    }
+
+    int fastpath = (nbdigit <= 19) && (nbfrac < 23)
+                   && (ptr == end || is_blank(*ptr) || *ptr == '\n');
+    if (fastpath && ptr > start + neg) {
+        double v;
+        if (nbdigit <= 15) {
+            v = (double) mantissa / pow10tab[nbfrac];
+        } else {
+#ifdef __SIZEOF_INT128__
+            v = decimal_to_double(mantissa, nbfrac);
+#else
+            fastpath = 0;
+#endif
+        }
+        if (fastpath) {
+            *value = neg ? -v : v;
+            return ptr;
+        }
+    }
+
+    // slow path: copy token for strtod, mapped file is not nul-terminated
+    char token[64];
+    size_t len = 0;
+    ptr = start;
+    while (ptr < end && !is_blank(*ptr) && *ptr != '\n' && len < sizeof(token) - 1) {
+        token[len++] = *ptr++;
+    }
+    token[len] = '\0';
+    char *tokenend;
+    *value = strtod(token, &tokenend);
+    if (tokenend == token) {
+        return NULL;
+    }
+    return start + (tokenend - token);
+}
+
+
+
+
+int read_time_data_mmap(const char *filename, double *time_array, size_t array_size)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("Error opening file");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("Error reading file size");
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Error mapping file");
+        return -1;
+    }
+    madvise((void *) map, st.st_size, MADV_SEQUENTIAL);
+
+    const char *ptr = map;
+    const char *end = map + st.st_size;
+    int line_number = 0;
+
+    while (ptr < end) {
+        line_number++;
+        const char *eol = memchr(ptr, '\n', end - ptr);
+        if (eol == NULL) {
+            eol = end;
+        }
+
+        // Skip comment lines (which start with '#') or empty lines
+        if (*ptr != '#' && *ptr != '\n') {
+            long frame_index;
+            double absolute_time;
+
+            const char *p = ptr;
+            while (p < eol && is_blank(*p)) {
+                p++;
+            }
+            // column 1: frame index
+            p = parse_int(p, eol, &frame_index);
+            if (p != NULL && p < eol && is_blank(*p)) {
+                // skip columns 1 (remainder) to 4
+                for (int col = 0; col < 4 && p != NULL; col++) {
+                    p = skip_token(p, eol);
+                    if (p == eol) {
+                        p = NULL;
+                    }
+                }
+                // column 5: absolute time
+                if (p != NULL && parse_double(p, eol, &absolute_time) != NULL) {
+                    if (frame_index >= 0 && (size_t)frame_index < array_size) {
+                        time_array[frame_index] = absolute_time;
+                    } else {
+                        fprintf(stderr, "Warning: Index %ld on line %d is out of bounds for array of size %zu. Skipping.\n",
+                                frame_index, line_number, array_size);
+                    }
+                }
+            }
+        }
+
+        ptr = eol + 1;
+    }
+
+    munmap((void *) map, st.st_size);
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef _VAMPIRES_PDI__TIMINGDATA_H
+#define _VAMPIRES_PDI__TIMINGDATA_H
+
+#include <stddef.h>
+
+
+/**
+ * @brief Builds the timing file name associated with a FITS file.
+ *
+ * The first ".fits" occurrence in the FITS file name is replaced by ".txt".
+ *
+ * @param fitsfname FITS file name.
+ * @param tfname Output timing file name.
+ * @param len Size of tfname buffer.
+ * @return 0 on success, -1 if the name does not fit in tfname.
+ */
+int timing_filename(const char *fitsfname, char *tfname, size_t len);
+
+/**
+ * @brief Reads an ASCII data file and populates a double array with time values.
+ *
+ * The function parses a file where each data line contains 7 columns. It extracts
+ * an index from column 1 and a time value from column 5, placing the time into
+ * the output array at the specified index. Lines starting with '#' are ignored.
+ *
+ * @param filename The path to the ASCII file to read.
+ * @param time_array A pointer to a pre-allocated double array to store the results.
+ * @param array_size The total number of elements in time_array (for bounds checking).
+ *
+ * @return Returns 0 on success, -1 on failure (e.g., file not found).
+ */
+int read_time_data(const char *filename, double *time_array, size_t array_size);
+
+/**
+ * @brief Memory-mapped parser for timing files.
+ *
+ * Same file format, output and return value as read_time_data.
+ * The file is mapped read-only and tokenized in place: columns 1 and 5
+ * are converted with a hand-written number parser, other columns are
+ * skipped without conversion.
+ * Reentrant, may be called concurrently on different files.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int read_time_data_mmap(const char *filename, double *time_array, size_t array_size);
+
+#endif
@@ -12,6 +12,11 @@
 #include "CLIcore.h"
 
 #include "polcycleproc.h"
+#include "benchtiming.h"
+#include "benchtimesync.h"
+#include "benchcrop.h"
+#include "benchpbkernel.h"
+#include "benchrsvd.h"
 
 
 // Module initialization macro in CLIcore.h
@@ -30,6 +35,11 @@ static errno_t init_module_CLI()
 {
 
     CLIADDCMD_vampires_pdi__polcycleproc();
+    CLIADDCMD_vampires_pdi__benchtiming();
+    CLIADDCMD_vampires_pdi__benchtimesync();
+    CLIADDCMD_vampires_pdi__benchcrop();
+    CLIADDCMD_vampires_pdi__benchpbkernel();
+    CLIADDCMD_vampires_pdi__benchrsvd();
 
     // optional: add atexit functions here
 